@@ -42,6 +42,10 @@ struct Constants {
   DMatrix* ttab;
   DMatrix* ptab;
   DMatrix* gtab;
+  InterpolationTable CLa_interp;
+  InterpolationTable CD0_interp;
+  InterpolationTable eta_interp;
+  InterpolationTable T_interp;
 };
 
 typedef struct Constants Constants_;
@@ -99,16 +103,6 @@ void dae(adouble* derivatives, adouble* path, adouble* states,
   double Isp  = CONSTANTS.Isp;
   double mu   = CONSTANTS.mu;
 
-  DMatrix& M1         = *CONSTANTS.M1;
-  DMatrix& M2         = *CONSTANTS.M2;
-  DMatrix& h1         = *CONSTANTS.h1;
-  DMatrix& CLa_table  = *CONSTANTS.CLa_table;
-  DMatrix& CD0_table  = *CONSTANTS.CD0_table;
-  DMatrix& eta_table  = *CONSTANTS.eta_table;
-  DMatrix& T_table    = *CONSTANTS.T_table;
-
-  int lM1 = length(M1);
-
   adouble rho;
   adouble   m = w/g0;
   adouble   M;
@@ -118,10 +112,11 @@ void dae(adouble* derivatives, adouble* path, adouble* states,
   adouble CL_a, CD0, eta, T;
 
 
-  spline_interpolation( &CL_a, M, M1, CLa_table,  lM1);
-  spline_interpolation( &CD0,  M, M1, CD0_table, lM1);
-  spline_interpolation( &eta,  M, M1, eta_table, lM1);
-  spline_2d_interpolation(&T, M, h, M2, h1, T_table, workspace);
+  // The spline tables are precomputed in main()
+  table_interpolation( &CL_a, M, CONSTANTS.CLa_interp);
+  table_interpolation( &CD0,  M, CONSTANTS.CD0_interp);
+  table_interpolation( &eta,  M, CONSTANTS.eta_interp);
+  table_interpolation( &T, M, h, CONSTANTS.T_interp);
 
 //  smooth_linear_interpolation( &CL_a, M, M1, CLa_table,  lM1);
 //  smooth_linear_interpolation( &CD0,  M, M1, CD0_table, lM1);
@@ -319,6 +314,11 @@ int main(void)
    T_table.Print("T_table");
 
 
+   build_interpolation_table( CONSTANTS.CLa_interp, M1, CLa_table, "spline");
+   build_interpolation_table( CONSTANTS.CD0_interp, M1, CD0_table, "spline");
+   build_interpolation_table( CONSTANTS.eta_interp, M1, eta_table, "spline");
+   build_interpolation_table( CONSTANTS.T_interp, M2, h1, T_table, "spline");
+
    CONSTANTS.M1         = &M1;
    CONSTANTS.M2         = &M2;
    CONSTANTS.h1         = &h1;
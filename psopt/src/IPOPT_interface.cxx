@@ -47,24 +47,178 @@ IPOPT_PSOPT::IPOPT_PSOPT(Workspace *pr, void *user_data)
 IPOPT_PSOPT::~IPOPT_PSOPT()
 {}
 
-adouble Lagrangian_ad(adouble* xad, double* lambda, double& obj_factor, Index& m, Workspace* workspace)
+// Each phase is recorded on its own tapes, tag_g_tape[i] for its constraints and
+// tag_hess_tape[i] for its part of the Lagrangian, and the linkage constraints on a
+// last pair of tapes. All the NLP variables are independents of every tape, as the
+// phases may share parameters, but each tape only holds the operations of one phase.
+
+int get_tape_constraint_offset(int t, Workspace* workspace)
 {
-	adouble L;
-	adouble f;
-	adouble *g = workspace->gad;
-	Index i;
+	// Position in g of the first constraint recorded on tape t
+	int i;
+	int offset = 0;
+
+	for(i=0; i<t; i++) {
+		offset += get_ncons_phase_i(*workspace->problem, i, workspace);
+	}
+
+	return offset;
+}
+
+int get_tape_ncons(int t, Workspace* workspace)
+{
+	if ( t < workspace->problem->nphases )
+		return get_ncons_phase_i(*workspace->problem, t, workspace);
+	else
+		return workspace->problem->nlinkages;
+}
+
+adouble* unscale_tape_variables(adouble* xad, int t, Workspace* workspace)
+{
+	// A phase tape only reads the variables of its own phase and, when the phases
+	// share the static parameters, those of the first phase, so only these are
+	// unscaled on the tape.
+	adouble* xun = workspace->xunscaled;
+
+	if ( t < workspace->problem->nphases )
+		unscale_phase_variables(xad, xun, t, workspace);
+
+	return xun;
+}
+
+void tape_constraints_ad(adouble* xad, adouble* xun, adouble* gad, int t, Workspace* workspace)
+{
+	// Scaled constraints recorded on tape t, with xun as returned by unscale_tape_variables()
+	int first = get_tape_constraint_offset(t, workspace);
+	int last  = first + get_tape_ncons(t, workspace) - 1;
+
+	if ( t < workspace->problem->nphases ) {
+		gg_ad_phase(xad, xun, gad, t, first, workspace);
+	}
+	else {
+		gg_ad_linkages(xad, gad, first, workspace);
+	}
 
-	L = obj_factor*ff_ad(xad, workspace);
+	scale_constraints_ad(gad, first, last, workspace);
+}
 
-	gg_ad(xad, g, workspace);
+adouble Lagrangian_tape_ad(adouble* xad, double* lambda, double obj_factor, int t, Workspace* workspace)
+{
+	// Part of the Lagrangian recorded on tape t: the cost and constraints of
+	// phase t, or the linkage constraints.
+	adouble L = 0.0;
+	adouble *g = workspace->gad;
+	Prob& problem = *workspace->problem;
+	int i;
+	int first = get_tape_constraint_offset(t, workspace);
+	int last  = first + get_tape_ncons(t, workspace) - 1;
+	adouble* xun = unscale_tape_variables(xad, t, workspace);
+
+	if ( t < problem.nphases ) {
+		adouble f = ff_ad_phase(xad, xun, t, workspace);
+		if (problem.scale.objective != -1)
+			f *= problem.scale.objective;
+		L = obj_factor*f;
+	}
+
+	tape_constraints_ad(xad, xun, g, t, workspace);
 
-	for(i=0; i<m ; i++) {
+	for(i=first; i<=last ; i++) {
 		L += lambda[ i ]*g[ i ];
 	}
 
 	return L;
 }
 
+void trace_constraint_tape(int t, double* x, Workspace* workspace)
+{
+	adouble *xad = workspace->xad;
+	adouble *gad = workspace->gad;
+	double  *g   = workspace->fg;
+	int first = get_tape_constraint_offset(t, workspace);
+	int last  = first + get_tape_ncons(t, workspace) - 1;
+	int i;
+
+	trace_on(workspace->tag_g_tape[t]);
+	for(i=0;i<workspace->nvars;i++)
+		xad[i] <<= x[i];
+	// The interpolation data memoised for xad were computed outside this trace
+	invalidate_spline_cache(workspace);
+
+	tape_constraints_ad(xad, unscale_tape_variables(xad, t, workspace), gad, t, workspace);
+
+	for(i=first;i<=last;i++)
+		gad[i] >>= g[i];
+	trace_off();
+}
+
+void trace_lagrangian_tape(int t, double* x, double* lambda, double obj_factor, Workspace* workspace)
+{
+	adouble *xad = workspace->xad;
+	adouble Lad;
+	double  L;
+	int i;
+
+	trace_on(workspace->tag_hess_tape[t]);
+	for(i=0;i<workspace->nvars;i++)
+		xad[i] <<= x[i];
+	// The interpolation data memoised for xad were computed outside this trace
+	invalidate_spline_cache(workspace);
+	Lad = Lagrangian_tape_ad(xad, lambda, obj_factor, t, workspace);
+	Lad >>= L;
+	trace_off();
+}
+
+void tape_sparse_jac(int t, int repeat, double* x, Workspace* workspace)
+{
+	// Jacobian of the constraints on tape t, kept in the per-tape arrays so that
+	// later calls with repeat=1 reuse the sparsity pattern and the colouring.
+	int m = get_tape_ncons(t, workspace);
+	int n = workspace->nvars;
+
+	if (repeat==0) {
+		workspace->jac_rind_tape[t]   = NULL;
+		workspace->jac_cind_tape[t]   = NULL;
+		workspace->jac_values_tape[t] = NULL;
+	}
+
+#ifdef ADOLC_VERSION_1
+	sparse_jac(workspace->tag_g_tape[t], m, n, repeat, x, &workspace->jac_nnz_tape[t], &workspace->jac_rind_tape[t],
+	           &workspace->jac_cind_tape[t], &workspace->jac_values_tape[t]);
+#endif
+
+#ifdef ADOLC_VERSION_2
+	int options[4];
+	options[0]=0; options[1]=0; options[2]=0;options[3]=0;
+	sparse_jac(workspace->tag_g_tape[t], m, n, repeat, x, &workspace->jac_nnz_tape[t], &workspace->jac_rind_tape[t],
+	           &workspace->jac_cind_tape[t], &workspace->jac_values_tape[t], options);
+#endif
+}
+
+void tape_sparse_hess(int t, double* x, int* nnz, unsigned int** hess_ir, unsigned int** hess_jc, double** hess_values, Workspace* workspace)
+{
+#ifdef ADOLC_VERSION_1
+	sparse_hess(workspace->tag_hess_tape[t], workspace->nvars, 0, x, nnz, hess_ir, hess_jc, hess_values);
+#endif
+
+#ifdef ADOLC_VERSION_2
+	int options[2];
+	options[0]=1; options[1]=0;
+	sparse_hess(workspace->tag_hess_tape[t], workspace->nvars, 0, x, nnz, hess_ir, hess_jc, hess_values, options);
+#endif
+}
+
+int compare_hessian_entries(const void* a, const void* b)
+{
+	// Entries are (row, column, position) triplets, sorted by row and then by column
+	const unsigned int* ea = (const unsigned int*) a;
+	const unsigned int* eb = (const unsigned int*) b;
+
+	if (ea[0]!=eb[0]) return (ea[0]<eb[0]) ? -1 : 1;
+	if (ea[1]!=eb[1]) return (ea[1]<eb[1]) ? -1 : 1;
+	return 0;
+}
+
 
 bool check_no_cancel(void *user_data)
 {
@@ -92,6 +246,31 @@ bool IPOPT_PSOPT::intermediate_callback(AlgorithmMode mode,
                                        const IpoptData* ip_data,
                                        IpoptCalculatedQuantities* ip_cq)
 {
+    // With the "adaptive" Hessian option a limited-memory solve is stopped when the
+    // larger of the primal and dual infeasibilities has not been halved over the last
+    // STALL_WINDOW iterations, so that it may be continued with the exact Hessian.
+
+    const int STALL_WINDOW = 10;
+
+    if ( workspace->algorithm->hessian == "adaptive" && !workspace->exact_hessian
+         && useAutomaticDifferentiation(*workspace->algorithm) && mode == RegularMode ) {
+
+         double error = MAX( inf_pr, inf_du );
+
+         if ( iter == 0 ) {
+              workspace->stall_reference_iter  = 0;
+              workspace->stall_reference_error = error;
+         }
+         else if ( iter - workspace->stall_reference_iter >= STALL_WINDOW ) {
+              if ( iter >= 2*STALL_WINDOW && error > 0.5*workspace->stall_reference_error ) {
+                   workspace->hessian_switch_requested = true;
+                   return false;
+              }
+              workspace->stall_reference_iter  = iter;
+              workspace->stall_reference_error = error;
+         }
+    }
+
     return check_no_cancel(_user_data);
 }
 
@@ -147,44 +326,31 @@ bool IPOPT_PSOPT::get_nlp_info(Index& n, Index& m, Index& nnz_jac_g,
 
   if( useAutomaticDifferentiation(*workspace->algorithm) ) {
 
-	unsigned int *jac_rind  = NULL;
-	unsigned int *jac_cind  = NULL;
-	double       *jac_values = NULL;
+	int t;
 
-	adouble *xad = workspace->xad;
-	adouble *gad = workspace->gad;
-	double  *g   = workspace->fg;
-
-	/* Tracing of function gg() */
-	trace_on(workspace->tag_g);
-	for(i=0;i<n;i++)
-		xad[i] <<= x[i];
-
-	gg_ad(xad, gad, workspace);
-
-	for(i=0;i<m;i++)
-		gad[i] >>= g[i];
-	trace_off();
+	nnz = 0;
 
+	/* Tracing of the constraints phase by phase, the rows of each tape are placed
+	   after those of the previous tapes */
+	for(t=0;t<workspace->ntapes;t++)
+	{
+		int offset = get_tape_constraint_offset(t, workspace);
 
-	/* Entries in row-compressed format using sparse_jac: */
+		workspace->jac_nnz_tape[t] = 0;
 
-#ifdef ADOLC_VERSION_1
-	sparse_jac(workspace->tag_g, m, n, 0, x, &nnz, &jac_rind, &jac_cind, &jac_values);
-#endif
+		if (get_tape_ncons(t, workspace)==0) continue;
 
+		trace_constraint_tape(t, x, workspace);
 
-#ifdef ADOLC_VERSION_2
-    int options[4];
-    options[0]=0; options[1]=0; options[2]=0;options[3]=0;
-    sparse_jac(workspace->tag_g, m, n, 0, x, &nnz, &jac_rind, &jac_cind, &jac_values, options);
-#endif
+		tape_sparse_jac(t, 0, x, workspace);
 
+		for(i=0;i<workspace->jac_nnz_tape[t];i++)
+		{
+			workspace->jGcol[nnz+i] = workspace->jac_cind_tape[t][i];
+			workspace->iGrow[nnz+i] = workspace->jac_rind_tape[t][i] + offset;
+		}
 
-	for(i=0;i<nnz;i++)
-	{
-		workspace->jGcol[i] = jac_cind[i];
-		workspace->iGrow[i] = jac_rind[i];
+		nnz += workspace->jac_nnz_tape[t];
 	}
 
         sprintf(workspace->text,"\nJacobian sparsity detected using ADOLC:");
@@ -204,48 +370,75 @@ bool IPOPT_PSOPT::get_nlp_info(Index& n, Index& m, Index& nnz_jac_g,
 
   int activate_hess;
 
-  if (workspace->algorithm->hessian=="exact")
+  if (workspace->exact_hessian)
       activate_hess = 1;
   else
       activate_hess = 0;
 
   if( activate_hess*useAutomaticDifferentiation(*workspace->algorithm)  ) {
 
-	double       *hess_values = NULL;
-	adouble *xad = workspace->xad;
-	adouble Lad;
+	clock_t setup_start = clock();
 	double  obj_factor = 1.0;
 	double *lambda = workspace->lambda->GetPr();
-	double  L;
         int nnz_hess;
-	/* Tracing of function Lagrangian_ad() */
-	trace_on(workspace->tag_hess);
-	for(i=0;i<n;i++)
-		xad[i] <<= x[i];
-	Lad = Lagrangian_ad(xad, lambda, obj_factor, m, workspace);
-        Lad >>=L;
-	trace_off();
-	/* Entries in row-compressed format using sparse_hess: */
+        int nentries = 0;
+        int t, k;
 
-	unsigned int *hess_ir = NULL;
- 	unsigned int *hess_jc = NULL;
+        unsigned int** tape_ir = new unsigned int*[workspace->ntapes];
+        unsigned int** tape_jc = new unsigned int*[workspace->ntapes];
 
-//       sparse_hess(workspace->tag_hess, n,0,x,&nnz_hess,&workspace->hess_ir, &workspace->hess_jc,&hess_values);
+	/* Tracing of the Lagrangian phase by phase */
+	for(t=0;t<workspace->ntapes;t++)
+	{
+		double* hess_values = NULL;
+		tape_ir[t] = NULL;
+		tape_jc[t] = NULL;
+		workspace->hess_nnz_tape[t]   = 0;
+		workspace->hess_start_tape[t] = nentries;
 
-#ifdef ADOLC_VERSION_1
-	sparse_hess(workspace->tag_hess, n,0,x,&nnz_hess,&hess_ir, &hess_jc,&hess_values);
-#endif
+		if (t==workspace->problem->nphases && get_tape_ncons(t, workspace)==0) continue;
 
-#ifdef ADOLC_VERSION_2
-    int options[2];
-    options[0]=1; options[1]=0;
-    sparse_hess(workspace->tag_hess, n,0,x,&nnz_hess,&hess_ir, &hess_jc,&hess_values, options);
-#endif
+		trace_lagrangian_tape(t, x, lambda, obj_factor, workspace);
 
-       for (i=0; i< nnz_hess; i++) {
-		workspace->hess_ir[i] = hess_ir[i];
-		workspace->hess_jc[i] = hess_jc[i];
-       }
+		tape_sparse_hess(t, x, &workspace->hess_nnz_tape[t], &tape_ir[t], &tape_jc[t], &hess_values, workspace);
+
+		nentries += workspace->hess_nnz_tape[t];
+	}
+
+	/* The Hessian structure is the union of the tape structures. Entries are sorted
+	   and merged, and hess_map gives the position of each tape entry in it */
+
+	unsigned int* entries = new unsigned int[3*nentries+3];
+
+	for(t=0;t<workspace->ntapes;t++) {
+		for(k=0;k<workspace->hess_nnz_tape[t];k++) {
+			int pos = workspace->hess_start_tape[t]+k;
+			entries[3*pos]   = tape_ir[t][k];
+			entries[3*pos+1] = tape_jc[t][k];
+			entries[3*pos+2] = pos;
+		}
+	}
+
+	qsort(entries, nentries, 3*sizeof(unsigned int), compare_hessian_entries);
+
+	if (workspace->hess_map != NULL) delete[] workspace->hess_map;
+
+	workspace->hess_map = new int[nentries+1];
+
+	nnz_hess = 0;
+
+	for(k=0;k<nentries;k++) {
+		if ( k==0 || compare_hessian_entries(&entries[3*k], &entries[3*(k-1)])!=0 ) {
+			workspace->hess_ir[nnz_hess] = entries[3*k];
+			workspace->hess_jc[nnz_hess] = entries[3*k+1];
+			nnz_hess++;
+		}
+		workspace->hess_map[ entries[3*k+2] ] = nnz_hess-1;
+	}
+
+	delete[] entries;
+	delete[] tape_ir;
+	delete[] tape_jc;
 
        sprintf(workspace->text,"\nHessian sparsity detected using ADOLC:");
        psopt_print(workspace,workspace->text);
@@ -260,6 +453,8 @@ bool IPOPT_PSOPT::get_nlp_info(Index& n, Index& m, Index& nnz_jac_g,
 
        nnz_h_lag = nnz_hess;
 
+       workspace->solution->mesh_stats[ workspace->current_mesh_refinement_iteration-1 ].hessian_setup_time += ((double) (clock()-setup_start))/CLOCKS_PER_SEC;
+
   } // end if (autoderiv)
 
     nnz_jac_g = nnz;
@@ -267,7 +462,7 @@ bool IPOPT_PSOPT::get_nlp_info(Index& n, Index& m, Index& nnz_jac_g,
 
   // the hessian is in this case assumed to be a square dense matrix but we
   // only need the lower left corner (since it is symmetric)
-  if( !useAutomaticDifferentiation(*workspace->algorithm) || workspace->algorithm->hessian!="exact" )
+  if( !useAutomaticDifferentiation(*workspace->algorithm) || !workspace->exact_hessian )
         nnz_h_lag = (int) ((n*n)+n)/2;
 
 /*   *
@@ -510,32 +705,25 @@ bool IPOPT_PSOPT::eval_jac_g(Index n, const Number* x, bool new_x,
 
     if (useAutomaticDifferentiation(*workspace->algorithm)) {
 
-    	int nnz = nele_jac;
-    	unsigned int *jac_rind = NULL;
-    	unsigned int *jac_cind = NULL;
-
-
+    	int nnz = 0;
+    	int t;
 
 	for (i=0;i<n;i++) {
 		xpr[i] = x[i];
 	}
 
-        double* jac_values = NULL;
-
+	// The tapes were traced in get_nlp_info(), so their sparsity patterns are reused
+	for(t=0;t<workspace->ntapes;t++) {
 
-#ifdef ADOLC_VERSION_1
-	sparse_jac(workspace->tag_g, m, n, 0, xpr, &nnz, &jac_rind, &jac_cind, &jac_values);
-#endif
+		if (get_tape_ncons(t, workspace)==0) continue;
 
-#ifdef ADOLC_VERSION_2
-    int options[4];
-    options[0]=0; options[1]=0; options[2]=0; options[3]=0;
-	sparse_jac(workspace->tag_g, m, n, 0, xpr, &nnz, &jac_rind, &jac_cind, &jac_values, options);
-#endif
+		tape_sparse_jac(t, 1, xpr, workspace);
 
-	for(i=0;i<nnz;i++) {
+		for(i=0;i<workspace->jac_nnz_tape[t];i++) {
+			values[nnz+i] = workspace->jac_values_tape[t][i];
+		}
 
-                values[i] = jac_values[i];
+		nnz += workspace->jac_nnz_tape[t];
 	}
 
     }
@@ -588,7 +776,7 @@ bool IPOPT_PSOPT::eval_h(Index n, const Number* x, bool new_x,
 
   int i;
 
-  if (workspace->algorithm->hessian!="exact")
+  if (!workspace->exact_hessian)
     return false;
 
  if (!useAutomaticDifferentiation(*workspace->algorithm) ) return false;
@@ -611,48 +799,43 @@ bool IPOPT_PSOPT::eval_h(Index n, const Number* x, bool new_x,
     	double *xpr = workspace->Xsnopt->GetPr();
 
 
-// *******************************************************************
-	adouble *xad = workspace->xad;
-	adouble Lad;
 	double  obj_factor_d = obj_factor;
 	double*  lambda_d     = workspace->lambda_d;
-	double  L;
- //       int nnz_hess;
-	/* Tracing of Lagrangian function. It needs to be repeated because obj_factor and lambda change  */
-	trace_on(workspace->tag_hess);
-	for(i=0;i<n;i++)
-		xad[i] <<= x[i];
+	int t, k;
 
 	for(i=0;i<m;i++)
 		lambda_d[i] = lambda[i];
 
-	Lad = Lagrangian_ad(xad, lambda_d, obj_factor_d, m, workspace);
-        Lad >>=L;
-	trace_off();
-// *******************************************************************
-
 	for (i=0;i<n;i++) {
 		xpr[i] = x[i];
 	}
 
-        unsigned int* hess_ir = NULL;
-        unsigned int* hess_jc = NULL;
+        for(i=0;i<nele_hess;i++) {
+             values[i] = 0.0;
+        }
 
-        double* hess_values = NULL;
+	/* The tapes are traced again because obj_factor and lambda change, and the
+	   values of each tape are added at their positions in the Hessian structure */
+	for(t=0;t<workspace->ntapes;t++) {
 
-#ifdef ADOLC_VERSION_1
- 	sparse_hess(workspace->tag_hess, n, 0, xpr, &nele_hess, &hess_ir, &hess_jc, &hess_values);
-#endif
+		if (t==workspace->problem->nphases && get_tape_ncons(t, workspace)==0) continue;
 
-#ifdef ADOLC_VERSION_2
-    int options[2];
-    options[0]=1; options[1]=0;
-    sparse_hess(workspace->tag_hess, n, 0, xpr, &nele_hess, &hess_ir, &hess_jc, &hess_values, options);
-#endif
+		unsigned int* hess_ir = NULL;
+		unsigned int* hess_jc = NULL;
+		double* hess_values = NULL;
+		int nnz_t;
 
-        for(i=0;i<nele_hess;i++) {
-             values[i] = hess_values[i];
-        }
+		trace_lagrangian_tape(t, xpr, lambda_d, obj_factor_d, workspace);
+
+		tape_sparse_hess(t, xpr, &nnz_t, &hess_ir, &hess_jc, &hess_values, workspace);
+
+		if (nnz_t != workspace->hess_nnz_tape[t])
+			error_message("The Hessian sparsity pattern has changed since it was detected");
+
+		for(k=0;k<nnz_t;k++) {
+			values[ workspace->hess_map[ workspace->hess_start_tape[t]+k ] ] += hess_values[k];
+		}
+	}
 
 	if (workspace->enable_nlp_counters) {
 	    workspace->solution->mesh_stats[ workspace->current_mesh_refinement_iteration-1 ].n_hessian_evals++;
@@ -52,7 +52,7 @@ void  define_nlp_bounds(DMatrix& xlb, DMatrix& xub, Prob& problem, Alg& algorith
    	int ncontrols = problem.phase[i].ncontrols;
         int nparam    = problem.phase[i].nparameters;
    	int nstates   = problem.phase[i].nstates;
-   	int offset1   = ncontrols*(norder+1);
+   	int offset1;
         int offset2   = (ncontrols+nstates)*(norder+1);
 
 	DMatrix& control_scaling = problem.phase[i].scale.controls;
@@ -64,19 +64,19 @@ void  define_nlp_bounds(DMatrix& xlb, DMatrix& xub, Prob& problem, Alg& algorith
 
 
 	for (k=1; k<=norder+1; k++) {
+                int uk = x_phase_offset+get_control_offset(problem,i,k,workspace);
+                int xk = x_phase_offset+get_state_offset(problem,i,k,workspace);
                 if (ncontrols>0) {
-	              xlb(colon(x_phase_offset+(k-1)*ncontrols+1,x_phase_offset+ k*ncontrols) ) = elemProduct((problem.phase[i].bounds.lower.controls),control_scaling);
+	              xlb(colon(uk+1,uk+ncontrols) ) = elemProduct((problem.phase[i].bounds.lower.controls),control_scaling);
                 }
-		xlb(colon(x_phase_offset+(k-1)*nstates+1+offset1, x_phase_offset+k*nstates+offset1))=elemProduct((problem.phase[i].bounds.lower.states),state_scaling);
+		xlb(colon(xk+1, xk+nstates))=elemProduct((problem.phase[i].bounds.lower.states),state_scaling);
 
                 if (ncontrols>0) {
-		     xub(colon(x_phase_offset+(k-1)*ncontrols+1, x_phase_offset+k*ncontrols) ) = elemProduct((problem.phase[i].bounds.upper.controls),control_scaling);
+		     xub(colon(uk+1, uk+ncontrols) ) = elemProduct((problem.phase[i].bounds.upper.controls),control_scaling);
                 }
-		xub(colon(x_phase_offset+(k-1)*nstates+1+offset1, x_phase_offset+k*nstates+offset1))=elemProduct((problem.phase[i].bounds.upper.states),state_scaling);
+		xub(colon(xk+1, xk+nstates))=elemProduct((problem.phase[i].bounds.upper.states),state_scaling);
 	}
 
-        offset1 = (nstates+ncontrols)*(norder+1);
-
         if (nparam>=1) {
 
            xlb(colon(x_phase_offset+offset2+1, x_phase_offset+offset2+nparam)) = elemProduct((problem.phase[i].bounds.lower.parameters),param_scaling);
@@ -137,12 +137,15 @@ void get_constraint_bounds(double* g_l, double* g_u, Workspace* workspace)
 
         int ncons_phase_i = get_ncons_phase_i(*problem,i, workspace);
 	// lower and upper bounds on g(x)
-	for (k=0;k<nstates*(norder+1);k++) {
-		g_l[lam_phase_offset+k] = 0.0;
-		g_u[lam_phase_offset+k] = 0.0;
+	for (l=1;l<=(norder + 1);l++) {
+		offset = lam_phase_offset+get_defect_offset(*problem,i,l,workspace);
+		for (k=0;k<nstates;k++) {
+			g_l[offset+k] = 0.0;
+			g_u[offset+k] = 0.0;
+		}
 	}
 
-	offset = lam_phase_offset+nstates*(norder+1);
+	offset = lam_phase_offset+get_event_offset(*problem,i,workspace);
 
 	for (k=1;k<=nevents;k++) {
 		j = offset + k-1;
@@ -155,12 +158,10 @@ void get_constraint_bounds(double* g_l, double* g_u, Workspace* workspace)
 		g_u[j] = (problem->phase[i].bounds.upper.events)(k)*event_sc;
 	}
 
-	offset = offset + nevents;
-
 	for (k=1; k<=npath; k++)
 	{
 		for (l=1;l<=(norder + 1);l++) {
-		    j = offset + (l-1)*npath + k - 1;
+		    j = lam_phase_offset + get_path_offset(*problem,i,l,workspace) + k - 1;
 		    if( algorithm->scaling=="user" )
 		       path_sc = path_scaling(k);
 		    else
@@ -173,7 +174,7 @@ void get_constraint_bounds(double* g_l, double* g_u, Workspace* workspace)
 
 
         if ( need_midpoint_controls(*workspace->algorithm, workspace) ) {
-		offset = offset + npath*(norder+1);
+		offset = lam_phase_offset + nstates*(norder+1) + nevents + npath*(norder+1);
 
 		for (k=1; k<=npath; k++)
 		{
@@ -44,7 +44,10 @@ void gg_num( DMatrix& x, DMatrix* g, Workspace*  workspace )
 
    adouble* gad = workspace->gad;
 
-
+   if ( use_threaded_evaluation(*workspace->algorithm) ) {
+        gg_num_threaded( x, g, workspace );
+        return;
+   }
 
    for(j=0; j<workspace->nvars; j++)
    {
@@ -70,128 +73,219 @@ void gg_ad( adouble* xad, adouble* gad, Workspace* workspace )
 
     Prob* problem = workspace->problem;
 
-    Alg* algorithm = workspace->algorithm;
+    invalidate_spline_cache(workspace);
 
-    DMatrix& constraint_scaling = *workspace->constraint_scaling;
-
-    DMatrix& linkage_scaling = problem->scale.linkages;
-
-    adouble retval=0;
-    adouble *states;
-    adouble *resid;
-    adouble *derivatives;
-    adouble *controls;
-    adouble *parameters;
-    adouble *initial_states;
-    adouble *final_states;
-    adouble *events;
-    adouble *path;
-    adouble *linkages;
-    adouble time;
-    adouble t0;
-    adouble tf;
-    adouble sum;
-    adouble *states_traj;
-    adouble *derivs_traj;
+    int i;
 
+    int phase_offset  = 0;
 
-    int i, j, iph;
+    // Unscale the decision variables once, the user functions still receive xad.
 
-    int phase_offset  = 0;
+    adouble* xun = workspace->xunscaled;
 
-    linkages = workspace->linkages;
+    unscale_decision_variables(xad, xun, workspace);
 
     for(i=0;i< problem->nphases; i++)
     {
-        int iphase = i+1;
-	DMatrix& D               = workspace->D[i];
-	DMatrix& deriv_scaling   = problem->phase[i].scale.defects;
-	DMatrix& path_scaling    = problem->phase[i].scale.path;
-	DMatrix& event_scaling   = problem->phase[i].scale.events;
-        double   time_scaling    = problem->phase[i].scale.time;
-
-	if ( problem->multi_segment_flag || workspace->auto_linked_flag ) {
-	  iph = 1;
-	}
-	else {
-	  iph = iphase;
-	}
+        gg_ad_phase(xad, xun, gad, i, phase_offset, workspace);
+
+        phase_offset += get_ncons_phase_i(*problem,i, workspace);
+
+  }
+
+  // Now include the phase linkage constraints into the constraint vector
 
-	states        = workspace->states[i];
-	resid         = workspace->resid[i];
-	derivatives   = workspace->derivatives[i];
-        controls      = workspace->controls[i];
-        parameters    = workspace->parameters[iph-1];
-	initial_states= workspace->initial_states[i];
-	final_states  = workspace->final_states[i];
-	events        = workspace->events[i];
-	path          = workspace->path[i];
-        states_traj   = workspace->states_traj[i];
-        derivs_traj   = workspace->derivs_traj[i];
+  gg_ad_linkages(xad, gad, phase_offset, workspace);
 
-	int j, k,  l;
+  scale_constraints_ad(gad, 0, workspace->ncons-1, workspace);
 
-        int ncons_phase_i;
+  if (workspace->enable_nlp_counters) {
+         workspace->solution->mesh_stats[  workspace->current_mesh_refinement_iteration-1 ].n_con_evals++;
+  }
 
-	int norder    = problem->phase[i].current_number_of_intervals;
+}
 
-	int nstates   = problem->phase[i].nstates;
 
-	int nevents   = problem->phase[i].nevents;
+void gg_ad_phase( adouble* xad, adouble* xun, adouble* gad, int i, int phase_offset, Workspace* workspace )
+{
+    // All the constraints of phase i (zero based), before automatic scaling, written to
+    // gad[phase_offset] onwards. xun must hold the unscaled decision variables.
 
-	int npath     = problem->phase[i].npath;
+    Prob* problem = workspace->problem;
 
-	int offset;
+    int iphase = i+1;
 
-        ncons_phase_i = get_ncons_phase_i(*problem,i, workspace);
+    DMatrix& D    = workspace->D[i];
 
-        int path_offset = phase_offset+nstates*(norder+1)+nevents;
+    int norder    = problem->phase[i].current_number_of_intervals;
 
-        get_parameters(parameters, xad, iphase, workspace );
+    int nstates   = problem->phase[i].nstates;
 
-        get_times(&t0, &tf, xad, iphase, workspace);
+    adouble* derivs_traj = workspace->derivs_traj[i];
 
-	for(k=1; k<=norder+1; k++)
-        {
-             get_states(states, xad, iphase, k, workspace);
-             for(j=0;j<nstates;j++) {
-                 states_traj[(k-1)*nstates+j] = states[j];
-             }
-        }
+    adouble* states_traj = get_unscaled_states_ptr(xun, iphase, 1, workspace);
+
+    if ( workspace->differential_defects == "dct" && !workspace->exact_hessian ) {
+	  // The external function provides first order derivatives only, so
+	  // the matrix product is kept when the exact Hessian is required
+	  chebyshev_dct_derivative_ad(states_traj, get_state_stride(*problem,i,workspace), derivs_traj, nstates, norder,
+	                              workspace->dct_xin[i], workspace->dct_yout[i]);
+    }
+    else if ( !use_local_collocation(*workspace->algorithm) && workspace->D_even[i].GetNoRows() > 0 ) {
+	  even_odd_diff_product_ad(states_traj, get_state_stride(*problem,i,workspace), derivs_traj, nstates, norder, workspace->D_even[i], workspace->D_odd[i], 0, norder);
+    }
+    else if ( !use_local_collocation(*workspace->algorithm) ) {
+	  mtrx_mul_trans_strided(states_traj, get_state_stride(*problem,i,workspace), D.GetPr(), derivs_traj,nstates, norder+1,norder+1,norder+1);
+    }
+
+    int nrhs = gg_ad_nodes(xad, xun, gad, derivs_traj, i, 1, norder+1, phase_offset, workspace->eval_scratch, workspace);
+
+    if (workspace->enable_nlp_counters) {
+		workspace->solution->mesh_stats[  workspace->current_mesh_refinement_iteration-1 ].n_ode_rhs_evals += nrhs;
+    }
+
+    gg_ad_events(xad, xun, gad, i, phase_offset, workspace);
 
-        if ( workspace->differential_defects != "Hermite-Simpson" && workspace->differential_defects != "trapezoidal") {
-	  mtrx_mul_trans(states_traj,D.GetPr(), derivs_traj,nstates, norder+1,norder+1,norder+1);
+}
+
+
+void scale_constraints_ad( adouble* gad, int first, int last, Workspace* workspace )
+{
+  // Applies the automatic constraint scaling to gad[first] .. gad[last]
+
+  Alg* algorithm = workspace->algorithm;
+
+  DMatrix& constraint_scaling = *workspace->constraint_scaling;
+
+  int j;
+
+  if ( algorithm->scaling=="automatic" || algorithm->scaling!="user" )
+  {
+	// Scale the constraints using automatic scaling
+	if ( workspace->use_constraint_scaling )
+	{
+		for (j=first;j<=last;j++) {
+			gad[j] *= constraint_scaling(j+1);
+		}
 	}
+  }
 
-	for(k=1; k<=norder+1; k++)
-        {
+}
 
-            get_controls(controls, xad, iphase, k, workspace);
 
-            get_states(states, xad, iphase, k, workspace);
+static void lobatto_iiia_defects( adouble* xun, adouble* gad, adouble* node_derivs, int i, int k0, adouble& t0, adouble& tf,
+                                  int phase_offset, adouble* resid, Workspace* workspace )
+{
+    // Stage equations of the four stage Lobatto IIIA group of three intervals starting at
+    // node k0 of phase i (zero based), written to the defect rows of nodes k0..k0+2.
+    // node_derivs holds the DAE derivatives at nodes k0..k0+3, nstates elements apart.
 
-            if (k==1) {
-               for(j=0;j<nstates;j++)
-                    initial_states[j] = states[j];
-            }
+    Prob* problem = workspace->problem;
+
+    DMatrix& deriv_scaling = problem->phase[i].scale.defects;
+
+    int iphase  = i+1;
+    int nstates = problem->phase[i].nstates;
+    int j, l, m, s;
+
+    double A[16], c[4];
+
+    lobatto_iiia_tableau(A, c);
+
+    adouble* states   = get_unscaled_states_ptr(xun, iphase, k0, workspace);
+    adouble  time     = convert_to_original_time_ad( (workspace->snodes[i])(k0), t0, tf );
+    adouble  time_end = convert_to_original_time_ad( (workspace->snodes[i])(k0+3), t0, tf );
+    adouble  hk       = time_end-time;
 
-            if (k==(norder+1)) {
-               for(j=0;j<nstates;j++)
-                    final_states[j] = states[j];
+    for (m=1; m<=3; m++) {
+        adouble* states_m = get_unscaled_states_ptr(xun, iphase, k0+m, workspace);
+        int      offset_m = phase_offset+get_defect_offset(*problem,i,k0+m-1,workspace);
+        for (j=0; j<nstates; j++) {
+            adouble quad = A[4*m]*node_derivs[j];
+            for (s=1; s<=3; s++) {
+                quad += A[4*m+s]*node_derivs[s*nstates+j];
             }
+            resid[j] = states_m[j]-states[j]-hk*quad;
+            l = offset_m+j;
+            gad[l] = resid[j]*(tf-t0)/(2.0*hk);
+            if ( workspace->algorithm->scaling=="user" )
+                    gad[l] *=deriv_scaling(j+1);
+        }
+    }
+
+}
+
+
+int gg_ad_nodes( adouble* xad, adouble* xun, adouble* gad, adouble* derivs_traj, int i, int kfirst, int klast,
+                 int phase_offset, EvalScratch* scratch, Workspace* workspace )
+{
+    // Differential defects and path constraints of phase i (zero based) at nodes kfirst to klast.
+    // derivs_traj must hold the differentiated states at those nodes for the global methods, and
+    // it keeps the DAE derivatives at the nodes for the Lobatto IIIA method.
+    // Only the scratch arrays are written besides gad, so disjoint node blocks may be evaluated
+    // concurrently. Returns the number of calls made to the dae function.
+
+    Prob* problem = workspace->problem;
+
+    Alg* algorithm = workspace->algorithm;
+
+    DMatrix& constraint_scaling = *workspace->constraint_scaling;
+
+    adouble *states;
+    adouble *resid;
+    adouble *derivatives;
+    adouble *controls;
+    adouble *parameters;
+    adouble *path;
+    adouble time;
+    adouble t0;
+    adouble tf;
+
+    int iphase = i+1;
+    DMatrix& deriv_scaling   = problem->phase[i].scale.defects;
+    DMatrix& path_scaling    = problem->phase[i].scale.path;
+
+    resid         = scratch->resid;
+    derivatives   = scratch->derivatives;
+    path          = scratch->path;
+
+    int j, k,  l;
+
+    int nrhs = 0;
+
+    int norder    = problem->phase[i].current_number_of_intervals;
+
+    int nstates   = problem->phase[i].nstates;
+
+    int nevents   = problem->phase[i].nevents;
+
+    int npath     = problem->phase[i].npath;
+
+        // States, controls and parameters are passed to the user functions as pointers
+        // into the unscaled decision vector, so no copies are made per node.
+
+        parameters = get_unscaled_parameters_ptr(xun, iphase, workspace);
+
+        get_unscaled_times(&t0, &tf, xun, iphase, workspace);
+
+	for(k=kfirst; k<=klast; k++)
+        {
+            int defect_offset = phase_offset+get_defect_offset(*problem,i,k,workspace);
+
+            controls = get_unscaled_controls_ptr(xun, iphase, k, workspace);
+
+            states   = get_unscaled_states_ptr(xun, iphase, k, workspace);
 
             time = convert_to_original_time_ad( (workspace->snodes[i])(k), t0, tf );
             problem->dae(derivatives, path, states, controls, parameters, time, xad, iphase,workspace);
-	    if (workspace->enable_nlp_counters) {
-		workspace->solution->mesh_stats[  workspace->current_mesh_refinement_iteration-1 ].n_ode_rhs_evals++;
-	    }
+	    nrhs++;
 
-            if (workspace->differential_defects != "Hermite-Simpson" && workspace->differential_defects != "trapezoidal"  ) {
+            if ( !use_local_collocation(*algorithm) ) {
                 // Differentiation matrix based defects
 
                 for (j=0; j<nstates; j++) {
                      resid[j] = derivs_traj[(k-1)*nstates+j] - (tf-t0)/2.0*derivatives[j];
-	   	     l = phase_offset+(k-1)*nstates+j;
+	   	     l = defect_offset+j;
 		     gad[l] = resid[j];
 
 		     if ( algorithm->scaling=="user" )
@@ -202,21 +296,17 @@ void gg_ad( adouble* xad, adouble* gad, Workspace* workspace )
             else if (workspace->differential_defects == "trapezoidal") {
             // Trapezoidal method
                 if (k!=(norder+1)) {
-                    adouble* states_next      = workspace->states_next[i];
-                    adouble* controls_next    = workspace->controls_next[i];
-                    adouble* derivatives_next = workspace->derivatives_next[i];
-                    adouble* path_next        = workspace->path_next[i];
+                    adouble* states_next      = get_unscaled_states_ptr(xun, iphase, k+1, workspace);
+                    adouble* controls_next    = get_unscaled_controls_ptr(xun, iphase, k+1, workspace);
+                    adouble* derivatives_next = scratch->derivatives_next;
+                    adouble* path_next        = scratch->path_next;
                     adouble  time_next        = convert_to_original_time_ad( (workspace->snodes[i])(k+1), t0, tf );
                     adouble  hk               = time_next-time;
-                    get_states(states_next, xad, iphase, k+1, workspace);
-                    get_controls(controls_next, xad, iphase, k+1, workspace);
                     problem->dae(derivatives_next,path_next,states_next,controls_next,parameters,time_next,xad, iphase,workspace);
-		    if (workspace->enable_nlp_counters) {
-			workspace->solution->mesh_stats[  workspace->current_mesh_refinement_iteration-1 ].n_ode_rhs_evals++;
-		    }
+		    nrhs++;
                     for (j=0; j<nstates; j++) {
                           resid[j] = states_next[j]-states[j]-hk*(derivatives[j]+derivatives_next[j])/2.0;
-	   	          l = phase_offset+(k-1)*nstates+j;
+	   	          l = defect_offset+j;
 		          gad[l] = resid[j]*(tf-t0)/(2.0*hk);
 		          if ( algorithm->scaling=="user" )
 		   		  gad[l] *=deriv_scaling(j+1);
@@ -224,7 +314,7 @@ void gg_ad( adouble* xad, adouble* gad, Workspace* workspace )
                 }
                 else {
                     for (j=0; j<nstates; j++) {
-	   	        l = phase_offset+(k-1)*nstates+j;
+	   	        l = defect_offset+j;
 		        gad[l] = 0.0;
                     }
                 }
@@ -233,38 +323,31 @@ void gg_ad( adouble* xad, adouble* gad, Workspace* workspace )
             else if (workspace->differential_defects == "Hermite-Simpson") {
               // Hermite Simpson defects
               if (k!=(norder+1)) {
-                    adouble* states_next      = workspace->states_next[i];
-                    adouble* controls_next    = workspace->controls_next[i];
-                    adouble* derivatives_next = workspace->derivatives_next[i];
-                    adouble* path_next        = workspace->path_next[i];
-                    adouble* path_bar         = workspace->path_bar[i];
-                    adouble* states_bar       = workspace->states_bar[i];
-                    adouble* controls_bar     = workspace->controls_bar[i];
-                    adouble* derivatives_bar  = workspace->derivatives_bar[i];
+                    adouble* states_next      = get_unscaled_states_ptr(xun, iphase, k+1, workspace);
+                    adouble* controls_next    = get_unscaled_controls_ptr(xun, iphase, k+1, workspace);
+                    adouble* derivatives_next = scratch->derivatives_next;
+                    adouble* path_next        = scratch->path_next;
+                    adouble* path_bar         = scratch->path_bar;
+                    adouble* states_bar       = scratch->states_bar;
+                    adouble* controls_bar     = get_unscaled_controls_bar_ptr(xun, iphase, k, workspace);
+                    adouble* derivatives_bar  = scratch->derivatives_bar;
                     adouble  time_next        = convert_to_original_time_ad( (workspace->snodes[i])(k+1), t0, tf );
                     adouble  hk               = time_next-time;
                     adouble  time_bar         = time + 0.5*hk;
                     int path_bar_offset = phase_offset+nstates*(norder+1)+nevents+npath*(norder+1);
-                    get_controls_bar(controls_bar,xad,iphase,k, workspace);
-                    get_states(states_next, xad, iphase, k+1, workspace);
-                    get_controls(controls_next, xad, iphase, k+1, workspace);
                     problem->dae(derivatives_next,path_next,states_next,controls_next,parameters,time_next,xad, iphase,workspace);
-		    if (workspace->enable_nlp_counters) {
-			workspace->solution->mesh_stats[  workspace->current_mesh_refinement_iteration-1 ].n_ode_rhs_evals++;
-		    }
+		    nrhs++;
                     for (j=0;j<nstates;j++) {
                         states_bar[j] = 0.5*(states[j]+states_next[j])+hk*(derivatives[j]-derivatives_next[j])/8.0;
                     }
 
                     problem->dae(derivatives_bar,path_bar,states_bar,controls_bar,parameters,time_bar,xad,iphase,workspace);
-		    if (workspace->enable_nlp_counters) {
-			workspace->solution->mesh_stats[  workspace->current_mesh_refinement_iteration-1 ].n_ode_rhs_evals++;
-		    }
+		    nrhs++;
 
                     for (j=0; j<nstates; j++) {
                         resid[j] = states_next[j]-states[j]-hk*(derivatives[j]+4.0*derivatives_bar[j]+derivatives_next[j] )/6.0;
 
-	   	        l = phase_offset+(k-1)*nstates+j;
+	   	        l = defect_offset+j;
 		        gad[l] = resid[j]*(tf-t0)/(2.0*hk);
 
 		        if ( algorithm->scaling=="user" ) {
@@ -287,17 +370,47 @@ void gg_ad( adouble* xad, adouble* gad, Workspace* workspace )
                 }
                 else {
                     for (j=0; j<nstates; j++) {
-	   	        l = phase_offset+(k-1)*nstates+j;
+	   	        l = defect_offset+j;
 		        gad[l] = 0.0;
                     }
                 }
 
             }
+            else if (workspace->differential_defects == "Lobatto-IIIA") {
+              // Four stage Lobatto IIIA defects. Nodes k0..k0+3 of each group of three
+              // intervals are the stages. The derivatives at the nodes are kept, and the
+              // stage equations of a group are written once its last node k0+3 has been
+              // evaluated. The blocks of the threaded evaluation start at group starts, so
+              // only a block ending at k0+2 evaluates the DAE at the next node itself.
+              adouble* node_derivs = derivs_traj+(k-1)*nstates;
+
+              for (j=0; j<nstates; j++) node_derivs[j] = derivatives[j];
+
+              if ( (k-1)%3 == 0 && k-3 >= kfirst ) {
+                    lobatto_iiia_defects(xun, gad, derivs_traj+(k-4)*nstates, i, k-3, t0, tf, phase_offset, resid, workspace);
+              }
+              else if ( (k-1)%3 == 2 && k == klast ) {
+                    adouble* states_next   = get_unscaled_states_ptr(xun, iphase, k+1, workspace);
+                    adouble* controls_next = get_unscaled_controls_ptr(xun, iphase, k+1, workspace);
+                    adouble  time_next     = convert_to_original_time_ad( (workspace->snodes[i])(k+1), t0, tf );
+                    problem->dae(node_derivs+nstates,scratch->path_next,states_next,controls_next,parameters,time_next,xad, iphase,workspace);
+		    nrhs++;
+                    lobatto_iiia_defects(xun, gad, derivs_traj+(k-3)*nstates, i, k-2, t0, tf, phase_offset, resid, workspace);
+              }
+
+              if ( k==(norder+1) ) {
+                    for (j=0; j<nstates; j++) {
+	   	        l = defect_offset+j;
+		        gad[l] = 0.0;
+                    }
+              }
+
+            }
 
 
 	    for (j=0; j<npath; j++)
 	    {
-		l = path_offset + (k-1)*npath + j;
+		l = phase_offset + get_path_offset(*problem,i,k,workspace) + j;
 		gad[l] = path[j];
 		if ( algorithm->scaling=="user" ) {
   			     gad[l] *= path_scaling(j+1);
@@ -310,8 +423,50 @@ void gg_ad( adouble* xad, adouble* gad, Workspace* workspace )
 
         } // end for( k...)
 
+    return nrhs;
+
+}
+
+
+void gg_ad_events( adouble* xad, adouble* xun, adouble* gad, int i, int phase_offset, Workspace* workspace )
+{
+    // Event constraints and the tf >= t0 constraint of phase i (zero based)
+
+    Prob* problem = workspace->problem;
+
+    Alg* algorithm = workspace->algorithm;
+
+    DMatrix& constraint_scaling = *workspace->constraint_scaling;
+
+    DMatrix& event_scaling   = problem->phase[i].scale.events;
+    double   time_scaling    = problem->phase[i].scale.time;
+
+    adouble *parameters;
+    adouble *initial_states;
+    adouble *final_states;
+    adouble *events = workspace->events[i];
+    adouble t0;
+    adouble tf;
 
-	offset = phase_offset+nstates*(norder+1);
+    int iphase = i+1;
+    int j, k;
+    int offset;
+
+    int norder    = problem->phase[i].current_number_of_intervals;
+
+    int nevents   = problem->phase[i].nevents;
+
+    int ncons_phase_i = get_ncons_phase_i(*problem,i, workspace);
+
+        parameters     = get_unscaled_parameters_ptr(xun, iphase, workspace);
+
+        get_unscaled_times(&t0, &tf, xun, iphase, workspace);
+
+        initial_states = get_unscaled_states_ptr(xun, iphase, 1, workspace);
+
+        final_states   = get_unscaled_states_ptr(xun, iphase, norder+1, workspace);
+
+	offset = phase_offset+get_event_offset(*problem,i,workspace);
 
         problem->events(events, initial_states, final_states, parameters, t0, tf, xad, iphase,workspace);
 
@@ -336,11 +491,24 @@ void gg_ad( adouble* xad, adouble* gad, Workspace* workspace )
             constraint_scaling( phase_offset + ncons_phase_i )= time_scaling;
         }
 
-        phase_offset += ncons_phase_i;
+}
 
-  }
 
-  // Now include the phase linkage constraints into the constraint vector
+void gg_ad_linkages( adouble* xad, adouble* gad, int phase_offset, Workspace* workspace )
+{
+  // Phase linkage constraints, stored after the constraints of the last phase
+
+  Prob* problem = workspace->problem;
+
+  Alg* algorithm = workspace->algorithm;
+
+  DMatrix& constraint_scaling = *workspace->constraint_scaling;
+
+  DMatrix& linkage_scaling = problem->scale.linkages;
+
+  adouble* linkages = workspace->linkages;
+
+  int j;
 
   if (problem->nlinkages) {
 
@@ -364,21 +532,220 @@ void gg_ad( adouble* xad, adouble* gad, Workspace* workspace )
 
   }
 
-  if ( algorithm->scaling=="automatic" || algorithm->scaling!="user" )
-  {
+}
+
+
+void gg_num_threaded( DMatrix& x, DMatrix* g, Workspace* workspace )
+{
+   // Threaded version of gg_num(). Blocks of nodes, from the same or different phases, are
+   // shared out between algorithm.nlp_threads threads. Each thread holds its own copy of the
+   // decision vector and its own scratch arrays, as adoubles may not be shared between threads,
+   // and writes its results to disjoint slices of g. The event, tf >= t0 and linkage
+   // constraints are evaluated afterwards by the calling thread. The user functions must be
+   // safe to call concurrently.
+
+   Prob* problem = workspace->problem;
+
+   Alg* algorithm = workspace->algorithm;
+
+   DMatrix& constraint_scaling = *workspace->constraint_scaling;
+
+   int nthreads = algorithm->nlp_threads;
+   int nphases  = problem->nphases;
+   int nvars    = workspace->nvars;
+   int ncons    = workspace->ncons;
+   int i, j, b;
+   int nrhs = 0;
+
+   double* xval = x.GetPr();
+   double* gval = g->GetPr();
+
+   int* nitems       = new int[nphases];
+   int* phase_offset = new int[nphases+1];
+   int* block_phase  = new int[nphases+2*nthreads];
+   int* block_first  = new int[nphases+2*nthreads];
+   int* block_last   = new int[nphases+2*nthreads];
+
+   phase_offset[0] = 0;
+   for(i=0;i<nphases;i++) {
+        nitems[i] = problem->phase[i].current_number_of_intervals + 1;
+        phase_offset[i+1] = phase_offset[i] + get_ncons_phase_i(*problem,i, workspace);
+   }
+
+   // Lobatto IIIA groups of three intervals are evaluated by a single thread
+   int align = use_lobatto_collocation(*algorithm)? 3 : 1;
+
+   int nblocks = get_evaluation_blocks(*problem, nitems, nthreads, align, block_phase, block_first, block_last);
+
+   bool global_defects = !use_local_collocation(*algorithm);
+
+   // The transform gives the derivatives at all the nodes of a phase at once, so they
+   // are computed here for every phase and each block copies its own rows.
+   double** dct_derivs = NULL;
+
+   if (global_defects && workspace->differential_defects == "dct") {
+        double*  inv_scaling = workspace->inv_variable_scaling->GetPr();
+        adouble* xun         = workspace->xunscaled;
+
+        dct_derivs = new double*[nphases];
+
+        for(i=0;i<nphases;i++) {
+             int norder  = problem->phase[i].current_number_of_intervals;
+             int nstates = problem->phase[i].nstates;
+             int first   = get_unscaled_states_ptr(xun, i+1, 1, workspace) - xun;
+             int stride  = get_state_stride(*problem, i, workspace);
+             double* u   = new double[norder+1];
+             int l, m;
+
+             dct_derivs[i] = new double[nstates*(norder+1)];
+
+             for(j=0; j<nstates; j++) {
+                  for(l=0; l<=norder; l++) {
+                       m = first+l*stride+j;
+                       u[l] = xval[m]*inv_scaling[m];
+                  }
+                  chebyshev_dct_derivative(u, 1, dct_derivs[i]+j, nstates, norder);
+             }
+
+             delete[] u;
+        }
+   }
+
+#ifdef USE_OPENMP
+#pragma omp parallel ADOLC_OPENMP_NC num_threads(nthreads) private(i,j) reduction(+:nrhs)
+#endif
+   {
+        adouble* xad_t = new adouble[nvars];
+        adouble* xun_t = new adouble[nvars];
+        adouble* gad_t = new adouble[ncons];
+        EvalScratch scratch;
+
+        allocate_eval_scratch(&scratch, *problem, *algorithm);
+
+        for(j=0; j<nvars; j++) {
+             xad_t[j] = xval[j];
+        }
+
+        unscale_decision_variables(xad_t, xun_t, workspace);
+
+#ifdef USE_OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for(b=0; b<nblocks; b++) {
+             int ib      = block_phase[b];
+             int kfirst  = block_first[b];
+             int klast   = block_last[b];
+             int norder  = problem->phase[ib].current_number_of_intervals;
+             int nstates = problem->phase[ib].nstates;
+             int npath   = problem->phase[ib].npath;
+             int k, l;
+
+             if (dct_derivs != NULL) {
+                  for(l=(kfirst-1)*nstates; l<klast*nstates; l++) scratch.derivs_traj[l] = dct_derivs[ib][l];
+             }
+             else if (global_defects && workspace->D_even[ib].GetNoRows() > 0) {
+                  // Only the rows of the derivative for this block are needed
+                  adouble* states1 = get_unscaled_states_ptr(xun_t, ib+1, 1, workspace);
+                  int      stride  = get_state_stride(*problem, ib, workspace);
+                  double*  u       = scratch.u_nodes;
+                  double*  du      = scratch.du_nodes;
+                  for(j=0; j<nstates; j++) {
+                       for(l=0; l<=norder; l++) u[l] = states1[l*stride+j].value();
+                       even_odd_diff_product(u, 1, du, 1, norder, workspace->D_even[ib], workspace->D_odd[ib], kfirst-1, klast-1);
+                       for(k=kfirst; k<=klast; k++) scratch.derivs_traj[(k-1)*nstates+j] = du[k-1];
+                  }
+             }
+             else if (global_defects) {
+                  // Only the rows of the differentiation matrix for this block are needed
+                  double*  Dp      = workspace->D[ib].GetPr();
+                  adouble* states1 = get_unscaled_states_ptr(xun_t, ib+1, 1, workspace);
+                  int      stride  = get_state_stride(*problem, ib, workspace);
+                  for(k=kfirst; k<=klast; k++) {
+                       for(j=0; j<nstates; j++) {
+                            adouble sum = 0.0;
+                            for(l=0; l<=norder; l++) {
+                                 double dkl = Dp[l*(norder+1)+k-1];
+                                 if (dkl!=0.0) sum += dkl*states1[l*stride+j];
+                            }
+                            scratch.derivs_traj[(k-1)*nstates+j] = sum;
+                       }
+                  }
+             }
+
+             nrhs += gg_ad_nodes(xad_t, xun_t, gad_t, scratch.derivs_traj, ib, kfirst, klast, phase_offset[ib], &scratch, workspace);
+
+             // Copy back the entries written for this block
+             for(k=kfirst; k<=klast; k++) {
+                  int offset = phase_offset[ib]+get_defect_offset(*problem,ib,k,workspace);
+                  for(j=0; j<nstates; j++) gval[offset+j] = gad_t[offset+j].value();
+                  offset = phase_offset[ib]+get_path_offset(*problem,ib,k,workspace);
+                  for(j=0; j<npath; j++)   gval[offset+j] = gad_t[offset+j].value();
+                  if ( workspace->differential_defects == "Hermite-Simpson" && k<=norder ) {
+                       offset = phase_offset[ib]+nstates*(norder+1)+problem->phase[ib].nevents+npath*(norder+1)+(k-1)*npath;
+                       for(j=0; j<npath; j++) gval[offset+j] = gad_t[offset+j].value();
+                  }
+             }
+        }
+
+        free_eval_scratch(&scratch);
+        delete[] xad_t;
+        delete[] xun_t;
+        delete[] gad_t;
+   }
+
+   // Events, times and linkages
+
+   adouble* xad = workspace->xad;
+   adouble* gad = workspace->gad;
+   adouble* xun = workspace->xunscaled;
+
+   for(j=0; j<nvars; j++) {
+        xad[j] = xval[j];
+   }
+
+   invalidate_spline_cache(workspace);
+
+   unscale_decision_variables(xad, xun, workspace);
+
+   for(i=0;i<nphases;i++) {
+        int offset = phase_offset[i]+get_event_offset(*problem,i,workspace);
+        int ncons_phase_i = phase_offset[i+1]-phase_offset[i];
+        gg_ad_events(xad, xun, gad, i, phase_offset[i], workspace);
+        for(j=0; j<problem->phase[i].nevents; j++) gval[offset+j] = gad[offset+j].value();
+        gval[phase_offset[i]+ncons_phase_i-1] = gad[phase_offset[i]+ncons_phase_i-1].value();
+   }
+
+   gg_ad_linkages(xad, gad, phase_offset[nphases], workspace);
+
+   for(j=0;j<problem->nlinkages;j++) {
+        gval[phase_offset[nphases]+j] = gad[phase_offset[nphases]+j].value();
+   }
+
+   if ( algorithm->scaling=="automatic" || algorithm->scaling!="user" )
+   {
 	// Scale the constraints using automatic scaling
 	if ( workspace->use_constraint_scaling )
 	{
-		for (j=0;j<workspace->ncons;j++) {
-			gad[j] *= constraint_scaling(j+1);
+		for (j=0;j<ncons;j++) {
+			gval[j] *= constraint_scaling(j+1);
 		}
 	}
-  }
+   }
 
-  if (workspace->enable_nlp_counters) {
+   if (workspace->enable_nlp_counters) {
+         workspace->solution->mesh_stats[  workspace->current_mesh_refinement_iteration-1 ].n_ode_rhs_evals += nrhs;
          workspace->solution->mesh_stats[  workspace->current_mesh_refinement_iteration-1 ].n_con_evals++;
-  }
+   }
 
+   delete[] nitems;
+   delete[] phase_offset;
+   delete[] block_phase;
+   delete[] block_first;
+   delete[] block_last;
 
-}
+   if (dct_derivs != NULL) {
+        for(i=0;i<nphases;i++) delete[] dct_derivs[i];
+        delete[] dct_derivs;
+   }
 
+}
@@ -51,14 +51,12 @@ void  define_initial_nlp_guess(DMatrix& x0, DMatrix& lambda, Sol& solution, Prob
 	int ncontrols = problem.phase[i].ncontrols;
 	int nstates   = problem.phase[i].nstates;
         int nparam    = problem.phase[i].nparameters;
-	int offset1   = ncontrols*(norder+1);
         int offset2   = (ncontrols+nstates)*(norder+1);
 	int k;
 	double t00, tf0;
 
 	DMatrix umean, xmean;
 	DMatrix Xdot(nstates,norder+1);
-	DMatrix up, xp, un, xn;
 	DMatrix time_guess;
 	//   DMatrix w, P, D;
 
@@ -96,13 +94,8 @@ void  define_initial_nlp_guess(DMatrix& x0, DMatrix& lambda, Sol& solution, Prob
 
 	if ( !problem.phase[i].guess.controls.isEmpty() ) {
 
-		for (k=1;k<=ncontrols;k++) {
-			up = problem.phase[i].guess.controls(k,colon());
-//			lagrange_interpolation(un,solution.nodes[i],time_guess, up);
-			linear_interpolation(un,solution.nodes[i],time_guess, up, length(up) );
-
-			(solution.controls[i])(k,colon())  = un;
-		}
+		// All the rows are interpolated in a single sweep through the sorted nodes
+		linear_interpolation(solution.controls[i], solution.nodes[i], time_guess, problem.phase[i].guess.controls, length(time_guess));
 
 
 	}
@@ -116,12 +109,7 @@ void  define_initial_nlp_guess(DMatrix& x0, DMatrix& lambda, Sol& solution, Prob
 
 
 	if ( !problem.phase[i].guess.states.isEmpty() ) {
-		for (k=1;k<=nstates;k++) {
-			xp = problem.phase[i].guess.states(k,colon());
-//			lagrange_interpolation(xn,solution.nodes[i],time_guess, xp);
-            linear_interpolation(xn,solution.nodes[i],time_guess, xp, length(xp));
-			(solution.states[i])(k,colon())  = xn;
-		}
+		linear_interpolation(solution.states[i], solution.nodes[i], time_guess, problem.phase[i].guess.states, length(time_guess));
 
 	}
 
@@ -160,10 +148,12 @@ void  define_initial_nlp_guess(DMatrix& x0, DMatrix& lambda, Sol& solution, Prob
 
 
 	for (k=1; k<=norder+1; k++) {
+           int uk = x_phase_offset+get_control_offset(problem,i,k,workspace);
+           int xk = x_phase_offset+get_state_offset(problem,i,k,workspace);
            if (ncontrols>0) {
-	        x0(colon(x_phase_offset+(k-1)*ncontrols+1, x_phase_offset+k*ncontrols) ) = elemProduct((solution.controls[i])(colon(),k), control_scaling);
+	        x0(colon(uk+1, uk+ncontrols) ) = elemProduct((solution.controls[i])(colon(),k), control_scaling);
            }
-	   x0(colon(x_phase_offset+(k-1)*nstates+1+offset1,x_phase_offset+ k*nstates+offset1))=elemProduct((solution.states[i])(colon(),k), state_scaling);
+	   x0(colon(xk+1, xk+nstates))=elemProduct((solution.states[i])(colon(),k), state_scaling);
 	}
 
         if (nparam >= 1) {
@@ -183,6 +173,8 @@ void  define_initial_nlp_guess(DMatrix& x0, DMatrix& lambda, Sol& solution, Prob
 
   }
 
+  define_inverse_variable_scaling(problem, workspace);
+
   determine_objective_scaling(x0,solution,problem,algorithm, workspace);
 
   determine_constraint_scaling_factors(x0, solution, problem, algorithm, workspace);
@@ -233,13 +225,9 @@ void hot_start_nlp_guess(DMatrix& x0,DMatrix& lambda, Sol& solution,Prob& proble
 	int nstates   = problem.phase[i].nstates;
         int nparam    = problem.phase[i].nparameters;
 	int nevents   = problem.phase[i].nevents;
-	int offset1   = ncontrols*(norder+1);
         int offset2   = (ncontrols+nstates)*(norder+1);
 	int k;
 	int offset;
-	DMatrix xn, xp;
-	DMatrix un, up;
-	DMatrix pn, pp;
 
 	int nvars_phase_i = get_nvars_phase_i(problem,i, workspace);
 
@@ -253,61 +241,56 @@ void hot_start_nlp_guess(DMatrix& x0,DMatrix& lambda, Sol& solution,Prob& proble
 	}
 
 
-	// Interpolate states into new nodes
-	for (k=1;k<=nstates;k++) {
+	// With global collocation, the states and multipliers are interpolated with the Lagrange
+	// polynomials through the previous nodes, all the rows at once in barycentric form.
+	bool lagrange = !use_local_collocation(algorithm) && !use_hp_collocation(algorithm);
+	DMatrix wb;
+	if (lagrange) {
+		barycentric_weights(wb, prev_nodes[i]);
+	}
 
-		xp = (prev_states[i])(k,colon());
-		if (!use_local_collocation(algorithm) ) {
-		    lagrange_interpolation(xn,solution.nodes[i],prev_nodes[i], xp);
-		}
-		else {
-		    linear_interpolation(xn,solution.nodes[i],prev_nodes[i], xp, length(xp));
-		}
-		(solution.states[i])(k,colon())  = xn;
+	// Interpolate states into new nodes
+	if (lagrange) {
+		barycentric_interpolation(solution.states[i], solution.nodes[i], prev_nodes[i], prev_states[i], wb);
+	}
+	else {
+		linear_interpolation(solution.states[i], solution.nodes[i], prev_nodes[i], prev_states[i], length(prev_nodes[i]));
 	}
 
 	// Interpolate costates into new nodes
 	(workspace->dual_costates[i]).Resize(nstates,norder+1);
-	for (k=1;k<=nstates;k++) {
-		xp = (prev_costates[i])(k,colon());
-		if (!use_local_collocation(algorithm)) {
-		    lagrange_interpolation(xn,solution.nodes[i],prev_nodes[i], xp);
-		}
-		else {
-		    linear_interpolation(xn,solution.nodes[i],prev_nodes[i], xp, length(xp));
-		}
-		(workspace->dual_costates[i])(k,colon())  = xn;
+	if (lagrange) {
+		barycentric_interpolation(workspace->dual_costates[i], solution.nodes[i], prev_nodes[i], prev_costates[i], wb);
+	}
+	else {
+		linear_interpolation(workspace->dual_costates[i], solution.nodes[i], prev_nodes[i], prev_costates[i], length(prev_nodes[i]));
 	}
 
 	// Interpolate controls into new nodes
-	for (k=1;k<=ncontrols;k++) {
-		up = (prev_controls[i])(k,colon());
-		linear_interpolation(un,solution.nodes[i],prev_nodes[i], up, length(up) );
-		(solution.controls[i])(k,colon())  = un;
+	if (ncontrols) {
+		linear_interpolation(solution.controls[i], solution.nodes[i], prev_nodes[i], prev_controls[i], length(prev_nodes[i]));
 	}
 
 	// Interpolate path constraint multipliers into new nodes
 	if (npath) {
 		(workspace->dual_path[i]).Resize(npath,norder+1);
-		for (k=1;k<=npath;k++) {
-			pp = (prev_path[i])(k,colon());
-			if (!use_local_collocation(algorithm)) {
-			    lagrange_interpolation(pn,solution.nodes[i],prev_nodes[i], pp);
-			}
-			else {
-			    linear_interpolation(pn,solution.nodes[i],prev_nodes[i], pp, length(pp));
-			}
-			(workspace->dual_path[i])(k,colon())  = pn;
+		if (lagrange) {
+			barycentric_interpolation(workspace->dual_path[i], solution.nodes[i], prev_nodes[i], prev_path[i], wb);
+		}
+		else {
+			linear_interpolation(workspace->dual_path[i], solution.nodes[i], prev_nodes[i], prev_path[i], length(prev_nodes[i]));
 		}
 	}
 
 	// Now copy relevant variables into the decision vector
 
 	for (k=1; k<=norder+1; k++) {
+          int uk = x_phase_offset+get_control_offset(problem,i,k,workspace);
+          int xk = x_phase_offset+get_state_offset(problem,i,k,workspace);
           if(ncontrols>0) {
-	     x0(colon(x_phase_offset+(k-1)*ncontrols+1,x_phase_offset+k*ncontrols) ) = elemProduct( (solution.controls[i])(colon(),k), control_scaling);
+	     x0(colon(uk+1, uk+ncontrols) ) = elemProduct( (solution.controls[i])(colon(),k), control_scaling);
           }
-	  x0(colon(x_phase_offset+(k-1)*nstates+1+offset1, x_phase_offset+k*nstates+offset1))=elemProduct((solution.states[i])(colon(),k), state_scaling);
+	  x0(colon(xk+1, xk+nstates))=elemProduct((solution.states[i])(colon(),k), state_scaling);
 	}
 
         if (nparam>0) {
@@ -328,15 +311,20 @@ void hot_start_nlp_guess(DMatrix& x0,DMatrix& lambda, Sol& solution,Prob& proble
 
 
 	// And finally copy the lagrange multiplier variables into vector lambda
-	lambda(colon(lam_phase_offset+1,lam_phase_offset+nstates*(norder+1)) ) = (*workspace->dual_costates)(colon(1, nstates*(norder+1)));
-	offset = lam_phase_offset+nstates*(norder+1);
+	for (k=1; k<=norder+1; k++) {
+	  offset = lam_phase_offset+get_defect_offset(problem,i,k,workspace);
+	  lambda(colon(offset+1,offset+nstates) ) = (workspace->dual_costates[i])(colon(),k);
+	  if (npath>0) {
+	     offset = lam_phase_offset+get_path_offset(problem,i,k,workspace);
+	     lambda(colon(offset+1,offset+npath) ) = (workspace->dual_path[i])(colon(),k);
+	  }
+	}
 
 	if (nevents>0)
         {
+               offset = lam_phase_offset+get_event_offset(problem,i,workspace);
                lambda(colon(offset+1,offset+nevents)) = (workspace->dual_events[i]);
-	       offset = offset + nevents;
         }
-	if (npath>0) lambda(colon(offset+1, offset+npath*(norder+1))) = (workspace->dual_path[i])(colon(1, npath*(norder+1)));
 
         x_phase_offset += nvars_phase_i;
         lam_phase_offset += ncons_phase_i;
@@ -355,6 +343,8 @@ void hot_start_nlp_guess(DMatrix& x0,DMatrix& lambda, Sol& solution,Prob& proble
 
   // Recalculate the scaling factors for objective and constraints
 
+  define_inverse_variable_scaling(problem, workspace);
+
   determine_objective_scaling(x0,solution,problem,algorithm, workspace);
 
   determine_constraint_scaling_factors(x0, solution, problem, algorithm, workspace);
@@ -241,13 +241,13 @@ int NLP_interface(
   snprob.setIntParameter("Derivative option", derivative_option);
   snprob.setIntParameter("Verify level ", 3);
   snprob.setIntParameter("Major iterations limit",
-		  workspace->algorithm->nlp_iter_max);
+		  workspace->nlp_iter_max);
   snprob.setIntParameter("Minor iterations limit",
-		  workspace->algorithm->nlp_iter_max);   
+		  workspace->nlp_iter_max);   
   snprob.setIntParameter("Iterations limit",
-		  50 * workspace->algorithm->nlp_iter_max);
+		  50 * workspace->nlp_iter_max);
   snprob.setRealParameter("Major optimality tolerance",
-		  workspace->algorithm->nlp_tolerance);
+		  workspace->nlp_tolerance);
   if (!algorithm.print_level) {
     snprob.setIntParameter("Major print level", 0);
     snprob.setIntParameter("Minor print level", 0);
@@ -444,7 +444,7 @@ int NLP_interface(
 
 
 
-  IterOpt = workspace->algorithm->nlp_iter_max;
+  IterOpt = workspace->nlp_iter_max;
   iPrt   = 0;
   iSum   = 0;
   sprintf(strOpt,"%s","Major iterations limit");
@@ -551,14 +551,14 @@ int NLP_interface(
   SmartPtr<IpoptApplication> app = new IpoptApplication();
 
   // Change some options
-  app->Options()->SetNumericValue("tol", workspace->algorithm->nlp_tolerance );
+  app->Options()->SetNumericValue("tol", workspace->nlp_tolerance );
   app->Options()->SetStringValue("mu_strategy", "adaptive");
   app->Options()->SetStringValue("output_file", "ipopt.out");
   app->Options()->SetStringValue("nlp_scaling_method","gradient-based");
   app->Options()->SetNumericValue("max_cpu_time", workspace->algorithm->ipopt_max_cpu_time );
 
 
-  if ( useAutomaticDifferentiation(algorithm) && algorithm.hessian=="exact" ) {
+  if ( useAutomaticDifferentiation(algorithm) && workspace->exact_hessian ) {
      app->Options()->SetStringValue("hessian_approximation", "exact");
   }
   else {
@@ -572,7 +572,7 @@ int NLP_interface(
       app->Options()->SetIntegerValue("print_level", 5);
   }
 
-  app->Options()->SetIntegerValue("max_iter", workspace->algorithm->nlp_iter_max);
+  app->Options()->SetIntegerValue("max_iter", workspace->nlp_iter_max);
   if (hotflag) {
      app->Options()->SetStringValue("warm_start_init_point", "yes");
   }
@@ -594,6 +594,11 @@ int NLP_interface(
   if (status == Solve_Succeeded) {
     psopt_print(workspace,"\n\n*** The problem solved!\n");
   }
+  else if ( workspace->hessian_switch_requested ) {
+    // Stopped by the stall detector on purpose: psopt() restarts from this
+    // iterate with the exact Hessian, and the return code of that solve is kept.
+    return (int) status;
+  }
   else {
     psopt_print(workspace,"\n\n*** The problem FAILED!\n");
   }
@@ -37,73 +37,154 @@ adouble ff_ad(adouble* xad, Workspace* workspace)
     // This function implements the NLP cost function for automatic differentiation
 
     adouble retval=0;
-    adouble *states;
-    adouble *states_next;
-    adouble *controls;
+
+    invalidate_spline_cache(workspace);
+    adouble sum_cost;
+
+    Sol& solution = *workspace->solution;
+
+    int i;
+
+    Prob& problem = *workspace->problem;
+
+    sum_cost = 0.0;
+
+    // Unscale the decision variables once, the user functions still receive xad.
+
+    adouble* xun = workspace->xunscaled;
+
+    unscale_decision_variables(xad, xun, workspace);
+
+    for(i=0;i<problem.nphases;i++)
+    {
+        sum_cost += ff_ad_phase(xad, xun, i, workspace);
+    }
+
+    if (problem.scale.objective != -1)
+    {
+	retval = sum_cost*problem.scale.objective;
+    }
+    else {
+	retval = sum_cost;
+    }
+
+    if (workspace->enable_nlp_counters) {
+         solution.mesh_stats[  workspace->current_mesh_refinement_iteration-1 ].n_obj_evals++;
+    }
+
+    return (retval);
+}
+
+
+
+adouble ff_ad_phase(adouble* xad, adouble* xun, int i, Workspace* workspace)
+{
+    // Integrated plus endpoint cost of phase i (zero based), before objective scaling.
+    // xun must hold the unscaled decision variables.
+
     adouble *parameters;
     adouble *initial_states;
-    adouble time;
+    adouble *final_states;
     adouble t0;
     adouble tf;
     adouble sum_cost;
-    adouble tmp1;
-    adouble integrand_cost;
     adouble endpoint_cost;
     adouble phase_sum_cost;
 
     Sol& solution = *workspace->solution;
 
-    bool use_simpson_quadrature = false;
-
-
-    int i,k, iph;
-
     Prob& problem = *workspace->problem;
 
     Alg& algorithm = *workspace->algorithm;
 
     sum_cost = 0.0;
 
-    for(i=0;i<problem.nphases;i++)
-    {
         int iphase = i+1;
-	DMatrix& w = workspace->w[i];
 
         int norder    = problem.phase[i].current_number_of_intervals;
 
 
         phase_sum_cost = 0.0;
 
-	if ( problem.multi_segment_flag || workspace->auto_linked_flag ) {
-	  iph = 1;
-	}
-	else {
-	  iph = iphase;
-	}
+        // Node states, controls and parameters are pointers into the unscaled decision vector.
 
-	states        = workspace->states[i];
-	states_next   = workspace->states_next[i];
-        controls      = workspace->controls[i];
-        parameters    = workspace->parameters[iph-1];
-        initial_states= workspace->initial_states[i];
+        parameters    = get_unscaled_parameters_ptr(xun, iphase, workspace);
 
-        get_parameters(parameters, xad, iphase, workspace);
-
-        get_times(&t0, &tf, xad, iphase, workspace);
+        get_unscaled_times(&t0, &tf, xun, iphase, workspace);
 
 	if (problem.phase[i].zero_cost_integrand == true) {
 	     phase_sum_cost = 0.0;
 	}
+	else if ( !use_local_collocation(algorithm) || use_lobatto_collocation(algorithm) ) {
+	     phase_sum_cost = ff_ad_integrand(xad, xun, i, 1, norder+1, workspace->states_bar[i], workspace);
+	}
 	else {
+	     phase_sum_cost = ff_ad_integrand(xad, xun, i, 1, norder, workspace->states_bar[i], workspace);
+	}
+
+        sum_cost += phase_sum_cost;
+
+        solution.integrated_cost[i] = phase_sum_cost.value();
+
+        initial_states = get_unscaled_states_ptr(xun, iphase, 1, workspace);
+
+        final_states   = get_unscaled_states_ptr(xun, iphase, norder+1, workspace);
+
+        endpoint_cost = problem.endpoint_cost(initial_states,final_states,parameters,t0,tf,xad,iphase, workspace);
+
+        solution.endpoint_cost[i] = endpoint_cost.value();
 
-	      if ( !use_local_collocation(algorithm) ) {
+	sum_cost += endpoint_cost;
+
+    return (sum_cost);
+}
+
+
+
+adouble ff_ad_integrand(adouble* xad, adouble* xun, int i, int kfirst, int klast, adouble* states_bar, Workspace* workspace)
+{
+    // Contribution to the integrated cost of phase i (zero based) from nodes kfirst to klast
+    // for the global methods, or from intervals kfirst to klast for local collocation.
+    // Disjoint ranges may be evaluated concurrently, given separate states_bar arrays.
+
+    adouble *states;
+    adouble *states_next;
+    adouble *controls;
+    adouble *parameters;
+    adouble time;
+    adouble t0;
+    adouble tf;
+    adouble integrand_cost;
+    adouble phase_sum_cost;
 
-		for(k=1; k<=norder+1; k++)
+    Sol& solution = *workspace->solution;
+
+    Prob& problem = *workspace->problem;
+
+    Alg& algorithm = *workspace->algorithm;
+
+    int k;
+
+    int iphase = i+1;
+
+    DMatrix& w = workspace->w[i];
+
+    int norder    = problem.phase[i].current_number_of_intervals;
+
+    phase_sum_cost = 0.0;
+
+    parameters    = get_unscaled_parameters_ptr(xun, iphase, workspace);
+
+    get_unscaled_times(&t0, &tf, xun, iphase, workspace);
+
+	      if ( !use_local_collocation(algorithm) || use_lobatto_collocation(algorithm) ) {
+
+		for(k=kfirst; k<=klast; k++)
 		{
 
-		    get_controls(controls, xad, iphase, k, workspace);
+		    controls = get_unscaled_controls_ptr(xun, iphase, k, workspace);
 
-		    get_states(states, xad, iphase, k, workspace);
+		    states   = get_unscaled_states_ptr(xun, iphase, k, workspace);
 
 		    time = convert_to_original_time_ad( (workspace->snodes[i])(k), t0, tf );
 
@@ -127,17 +208,17 @@ adouble ff_ad(adouble* xad, Workspace* workspace)
 
 	    else {
 
-		  for (k=1; k<=norder;k++) {
+		  for (k=kfirst; k<=klast;k++) {
 		      // Uses trapezoidal integration to integrate the cost
-		      int j, l;
+		      int l;
 
 
 		      adouble interval_cost = 0.0;
 
 		      adouble integrand;
 
-		      get_controls(controls, xad, iphase, k, workspace);
-		      get_states(states, xad, iphase, k, workspace);
+		      controls = get_unscaled_controls_ptr(xun, iphase, k, workspace);
+		      states   = get_unscaled_states_ptr(xun, iphase, k, workspace);
 
 		      adouble tk = convert_to_original_time_ad( (workspace->snodes[i])(k),   t0, tf );
 		      adouble tk1= convert_to_original_time_ad( (workspace->snodes[i])(k+1), t0, tf );
@@ -149,8 +230,8 @@ adouble ff_ad(adouble* xad, Workspace* workspace)
 		      (solution.integrand_cost[i])(k) = interval_cost.value();
 
 
-		      get_controls(controls, xad, iphase,k+1, workspace );
-		      get_states(states_next, xad, iphase, k+1, workspace);
+		      controls    = get_unscaled_controls_ptr(xun, iphase, k+1, workspace);
+		      states_next = get_unscaled_states_ptr(xun, iphase, k+1, workspace);
 
 		      integrand = problem.integrand_cost(states_next,controls,parameters,tk1,xad,iphase,workspace);
 
@@ -164,17 +245,17 @@ adouble ff_ad(adouble* xad, Workspace* workspace)
 
 			  adouble tmiddle = (tk+tk1)/2.0;
 
-			  get_controls_bar(controls,xad,iphase,k, workspace);
+			  controls = get_unscaled_controls_bar_ptr(xun, iphase, k, workspace);
 
 			  for( l =0; l< problem.phase[i].nstates; l++ ) {
 
-			          states[l] = 0.5*(states[l]+states_next[l]);
+			          states_bar[l] = 0.5*(states[l]+states_next[l]);
 //				  get_interpolated_state(&states[l], l+1, iphase, tmiddle, xad)
 
 
 			  }
 
-			  interval_cost += 4.0*problem.integrand_cost(states,controls,parameters,tmiddle,xad,iphase,workspace);
+			  interval_cost += 4.0*problem.integrand_cost(states_bar,controls,parameters,tmiddle,xad,iphase,workspace);
 
 
 			  interval_cost *= h/6.0;
@@ -191,60 +272,162 @@ adouble ff_ad(adouble* xad, Workspace* workspace)
 
 	    }
 
-	} // End if-else (zero_cost_integrand)
-
-        sum_cost += phase_sum_cost;
+    return phase_sum_cost;
+}
 
-        solution.integrated_cost[i] = phase_sum_cost.value();
 
-        get_states(initial_states, xad, iphase, 1, workspace);
 
-        get_states(states, xad, iphase, norder+1, workspace);
+double ff_num(DMatrix& x, Workspace* workspace)
+{
+   // This function implements the NLP cost function for numerical differentiation
 
-        endpoint_cost = problem.endpoint_cost(initial_states,states,parameters,t0,tf,xad,iphase, workspace);
+   int j;
 
-        solution.endpoint_cost[i] = endpoint_cost.value();
+   adouble retval;
 
-	sum_cost += endpoint_cost;
+   adouble* xad = workspace->xad;
 
+   if ( use_threaded_evaluation(*workspace->algorithm) ) {
+        return ff_num_threaded( x, workspace );
+   }
 
-    }
+   for(j=0; j<workspace->nvars; j++)
+   {
+        xad[j] = x(j+1);
+   }
 
-    if (problem.scale.objective != -1)
-    {
-	retval = sum_cost*problem.scale.objective;
-    }
-    else {
-	retval = sum_cost;
-    }
+   retval = ff_ad( xad, workspace );
 
-    if (workspace->enable_nlp_counters) {
-         solution.mesh_stats[  workspace->current_mesh_refinement_iteration-1 ].n_obj_evals++;
-    }
+   return (retval.value());
 
-    return (retval);
 }
 
 
 
-double ff_num(DMatrix& x, Workspace* workspace)
+double ff_num_threaded(DMatrix& x, Workspace* workspace)
 {
-   // This function implements the NLP cost function for numerical differentiation
+   // Threaded version of ff_num(). The integrated cost is split into blocks of nodes (or of
+   // intervals for local collocation) that are shared out between algorithm.nlp_threads
+   // threads, as in gg_num_threaded(). The endpoint costs are evaluated by the calling thread.
+
+   Sol& solution = *workspace->solution;
+
+   Prob& problem = *workspace->problem;
+
+   Alg& algorithm = *workspace->algorithm;
+
+   int nthreads = algorithm.nlp_threads;
+   int nphases  = problem.nphases;
+   int nvars    = workspace->nvars;
+   int i, j, b;
+   double sum_cost = 0.0;
+   double retval;
+
+   double* xval = x.GetPr();
+
+   int* nitems      = new int[nphases];
+   int* block_phase = new int[nphases+2*nthreads];
+   int* block_first = new int[nphases+2*nthreads];
+   int* block_last  = new int[nphases+2*nthreads];
+   double* block_cost = new double[nphases+2*nthreads];
+
+   for(i=0;i<nphases;i++) {
+        int norder = problem.phase[i].current_number_of_intervals;
+        if (problem.phase[i].zero_cost_integrand == true)
+             nitems[i] = 0;
+        else if ( !use_local_collocation(algorithm) || use_lobatto_collocation(algorithm) )
+             nitems[i] = norder+1;
+        else
+             nitems[i] = norder;
+   }
 
-   int j;
+   int nblocks = get_evaluation_blocks(problem, nitems, nthreads, 1, block_phase, block_first, block_last);
 
-   adouble retval;
+#ifdef USE_OPENMP
+#pragma omp parallel ADOLC_OPENMP_NC num_threads(nthreads) private(j)
+#endif
+   {
+        adouble* xad_t = new adouble[nvars];
+        adouble* xun_t = new adouble[nvars];
+        EvalScratch scratch;
+
+        allocate_eval_scratch(&scratch, problem, algorithm);
+
+        for(j=0; j<nvars; j++) {
+             xad_t[j] = xval[j];
+        }
+
+        unscale_decision_variables(xad_t, xun_t, workspace);
+
+#ifdef USE_OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for(b=0; b<nblocks; b++) {
+             adouble cost = ff_ad_integrand(xad_t, xun_t, block_phase[b], block_first[b], block_last[b], scratch.states_bar, workspace);
+             block_cost[b] = cost.value();
+        }
+
+        free_eval_scratch(&scratch);
+        delete[] xad_t;
+        delete[] xun_t;
+   }
+
+   for(i=0;i<nphases;i++) {
+        solution.integrated_cost[i] = 0.0;
+   }
+
+   // Blocks are summed in a fixed order so that the result does not depend on the scheduling
+
+   for(b=0; b<nblocks; b++) {
+        solution.integrated_cost[block_phase[b]] += block_cost[b];
+   }
 
    adouble* xad = workspace->xad;
+   adouble* xun = workspace->xunscaled;
+
+   for(j=0; j<nvars; j++) {
+        xad[j] = xval[j];
+   }
 
+   invalidate_spline_cache(workspace);
 
-   for(j=0; j<workspace->nvars; j++)
+   unscale_decision_variables(xad, xun, workspace);
+
+   for(i=0;i<nphases;i++) {
+        int iphase = i+1;
+        int norder = problem.phase[i].current_number_of_intervals;
+        adouble t0, tf;
+
+        adouble* parameters     = get_unscaled_parameters_ptr(xun, iphase, workspace);
+        adouble* initial_states = get_unscaled_states_ptr(xun, iphase, 1, workspace);
+        adouble* final_states   = get_unscaled_states_ptr(xun, iphase, norder+1, workspace);
+
+        get_unscaled_times(&t0, &tf, xun, iphase, workspace);
+
+        adouble endpoint_cost = problem.endpoint_cost(initial_states,final_states,parameters,t0,tf,xad,iphase, workspace);
+
+        solution.endpoint_cost[i] = endpoint_cost.value();
+
+        sum_cost += solution.integrated_cost[i] + solution.endpoint_cost[i];
+   }
+
+   if (problem.scale.objective != -1)
    {
-        xad[j] = x(j+1);
+	retval = sum_cost*problem.scale.objective;
+   }
+   else {
+	retval = sum_cost;
    }
 
-   retval = ff_ad( xad, workspace );
+   if (workspace->enable_nlp_counters) {
+         solution.mesh_stats[  workspace->current_mesh_refinement_iteration-1 ].n_obj_evals++;
+   }
 
-   return (retval.value());
+   delete[] nitems;
+   delete[] block_phase;
+   delete[] block_first;
+   delete[] block_last;
+   delete[] block_cost;
 
+   return retval;
 }
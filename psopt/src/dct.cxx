@@ -0,0 +1,543 @@
+/*********************************************************************************************
+
+This file is part of the PSOPT library, a software tool for computational optimal control
+
+Copyright (C) 2009-2015 Victor M. Becerra
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA,
+or visit http://www.gnu.org/licenses/
+
+Author:    Professor Victor M. Becerra
+           University of Reading
+           School of Systems Engineering
+           P.O. Box 225, Reading RG6 6AY
+           United Kingdom
+           e-mail: vmbecerra99@gmail.com
+
+**********************************************************************************************/
+
+
+
+#include "psopt.h"
+
+#include <complex>
+#include <mutex>
+
+// f2c.h, included by dmatrix, declares a complex struct of its own
+typedef std::complex<double> fft_complex;
+
+
+// Differentiation of trajectories sampled at the Chebyshev-Gauss-Lobatto
+// nodes by means of the discrete cosine transform (DCT-I) and the Chebyshev
+// coefficient recurrence, in O(N log N) operations instead of the O(N^2) of
+// a product with the differentiation matrix.
+//
+// The DCT-I of length N+1 is computed from a complex FFT of length 2N of the
+// even extension of the data. Lengths that are not a power of two are handled
+// with Bluestein's algorithm, so that no external FFT library is needed.
+//
+// Reference
+//   L. N. Trefethen, "Spectral Methods in MATLAB", SIAM 2000, Chapter 8.
+//
+
+
+struct fft_plan_str {
+      int                n;          // transform length
+      int                L;          // power of two length used by the radix-2 kernel
+      fft_complex*   twiddle;    // exp(-2 pi i k/L), k=0..L/2-1
+      fft_complex*   chirp;      // exp(-pi i k^2/n), k=0..n-1 (Bluestein only)
+      fft_complex*   filter;     // FFT of the Bluestein convolution kernel
+      fft_plan_str*      next;
+};
+
+static fft_plan_str*  fft_plan_cache = NULL;
+
+static std::mutex     fft_plan_mutex;
+
+
+static void fft_radix2(fft_complex* a, int L, const fft_complex* twiddle)
+{
+  // In place forward FFT of length L, a power of two.
+  int i, j, k, len;
+
+  for (i=1, j=0; i<L; i++) {
+      int bit = L >> 1;
+      for ( ; j & bit; bit >>= 1) j ^= bit;
+      j ^= bit;
+      if (i < j) std::swap(a[i], a[j]);
+  }
+
+  for (len=2; len<=L; len <<= 1) {
+      int half = len/2;
+      int step = L/len;
+      for (i=0; i<L; i+=len) {
+          for (k=0; k<half; k++) {
+              fft_complex t = a[i+k+half]*twiddle[k*step];
+              a[i+k+half] = a[i+k]-t;
+              a[i+k]     += t;
+          }
+      }
+  }
+
+}
+
+
+static fft_plan_str* get_fft_plan(int n)
+{
+  std::lock_guard<std::mutex> lock(fft_plan_mutex);
+
+  fft_plan_str* plan;
+
+  for (plan = fft_plan_cache; plan != NULL; plan = plan->next) {
+      if (plan->n == n) return plan;
+  }
+
+  plan = new fft_plan_str;
+
+  plan->n      = n;
+  plan->chirp  = NULL;
+  plan->filter = NULL;
+
+  int L = 1;
+  while (L < n) L <<= 1;
+
+  if (L != n) {
+      // Bluestein: the length n transform becomes a circular convolution of
+      // length L >= 2n-1
+      L = 1;
+      while (L < 2*n-1) L <<= 1;
+  }
+
+  plan->L       = L;
+  plan->twiddle = new fft_complex[L/2+1];
+
+  int k;
+
+  for (k=0; k<L/2; k++) {
+      plan->twiddle[k] = std::polar(1.0, -2.0*pi*k/L);
+  }
+
+  if (L != n) {
+      plan->chirp  = new fft_complex[n];
+      plan->filter = new fft_complex[L];
+
+      for (k=0; k<n; k++) {
+          // k^2 mod 2n keeps the argument small for large n
+          long k2 = ( (long) k*k ) % (2*n);
+          plan->chirp[k] = std::polar(1.0, -pi*k2/n);
+      }
+
+      for (k=0; k<L; k++) plan->filter[k] = 0.0;
+
+      plan->filter[0] = std::conj(plan->chirp[0]);
+
+      for (k=1; k<n; k++) {
+          plan->filter[k]   = std::conj(plan->chirp[k]);
+          plan->filter[L-k] = std::conj(plan->chirp[k]);
+      }
+
+      fft_radix2(plan->filter, L, plan->twiddle);
+  }
+
+  plan->next     = fft_plan_cache;
+  fft_plan_cache = plan;
+
+  return plan;
+}
+
+
+static void fft(fft_complex* a, fft_complex* work, fft_plan_str* plan)
+{
+  // Forward FFT of length plan->n. work must hold plan->L elements.
+  int n = plan->n;
+  int L = plan->L;
+  int k;
+
+  if (L == n) {
+      fft_radix2(a, n, plan->twiddle);
+      return;
+  }
+
+  for (k=0; k<n; k++) work[k] = a[k]*plan->chirp[k];
+  for (k=n; k<L; k++) work[k] = 0.0;
+
+  fft_radix2(work, L, plan->twiddle);
+
+  // Inverse transform of the product, as conj(FFT(conj(.)))/L
+  for (k=0; k<L; k++) work[k] = std::conj( work[k]*plan->filter[k] );
+
+  fft_radix2(work, L, plan->twiddle);
+
+  for (k=0; k<n; k++) a[k] = std::conj(work[k])*plan->chirp[k]/((double) L);
+
+}
+
+
+static void dct1(double* z, double* y, int N, fft_complex* buf, fft_complex* work, fft_plan_str* plan)
+{
+  // y_j = sum_{k=0}^{N} z_k cos(pi j k/N), j=0..N, via the FFT of length 2N of
+  // the even extension of z. z and y may be the same array.
+  int k;
+
+  for (k=0; k<=N; k++)  buf[k] = z[k];
+  for (k=1; k<N; k++)   buf[2*N-k] = z[k];
+
+  fft(buf, work, plan);
+
+  double z0 = z[0];
+  double zN = z[N];
+
+  for (k=0; k<=N; k++) {
+      y[k] = 0.5*( buf[k].real() + z0 + ((k%2==0)? zN : -zN) );
+  }
+
+}
+
+
+struct dct_work_str {
+      int               N;
+      fft_plan_str*     plan;
+      double*           a;
+      double*           b;
+      double*           u;       // gathered direction, for the vector modes
+      double*           du;
+      fft_complex*  buf;
+      fft_complex*  work;
+      dct_work_str*     next;
+};
+
+
+static void allocate_dct_work(dct_work_str* dw, int N)
+{
+  dw->N    = N;
+  dw->plan = get_fft_plan(2*N);
+  dw->a    = new double[N+2];
+  dw->b    = new double[N+2];
+  dw->u    = new double[N+1];
+  dw->du   = new double[N+1];
+  dw->buf  = new fft_complex[2*N];
+  dw->work = new fft_complex[dw->plan->L];
+}
+
+
+static void free_dct_work(dct_work_str* dw)
+{
+  delete[] dw->a;
+  delete[] dw->b;
+  delete[] dw->u;
+  delete[] dw->du;
+  delete[] dw->buf;
+  delete[] dw->work;
+}
+
+
+struct dct_work_cache_str {
+      dct_work_str*     head;
+
+      dct_work_cache_str() : head(NULL) {}
+
+      ~dct_work_cache_str()
+      {
+          while (head != NULL) {
+              dct_work_str* dw = head;
+              head = dw->next;
+              free_dct_work(dw);
+              delete dw;
+          }
+      }
+};
+
+
+static dct_work_str* get_dct_work(int N)
+{
+  // Scratch arrays for transforms of order N, kept between calls as the
+  // ADOL-C callbacks run once per state trajectory in every sweep. Each
+  // thread has its own arrays, one set for each order (i.e. each phase).
+  static thread_local dct_work_cache_str cache;
+
+  dct_work_str* dw;
+
+  for (dw = cache.head; dw != NULL; dw = dw->next) {
+      if (dw->N == N) break;
+  }
+
+  if (dw == NULL) {
+      dw = new dct_work_str;
+      allocate_dct_work(dw, N);
+      dw->next   = cache.head;
+      cache.head = dw;
+  }
+
+  // The plan cache may have been cleared since the arrays were allocated
+  dw->plan = get_fft_plan(2*N);
+
+  return dw;
+}
+
+
+static void dct_derivative(const double* u, int ustride, double* du, int dustride, dct_work_str* dw)
+{
+  // Derivative at the ascending CGL nodes tau_j = -cos(pi j/N) of the
+  // interpolant of u. As tau = -x with x_j = cos(pi j/N), the samples are
+  // taken as values at x_j and the derivative with respect to x is negated.
+  int N = dw->N;
+  int k;
+  double* a = dw->a;
+  double* b = dw->b;
+
+  // Chebyshev coefficients a_k = 2/(N cbar_k) sum_j u_j/cbar_j cos(pi j k/N)
+  for (k=0; k<=N; k++) a[k] = u[k*ustride];
+  a[0] *= 0.5;
+  a[N] *= 0.5;
+
+  dct1(a, a, N, dw->buf, dw->work, dw->plan);
+
+  for (k=0; k<=N; k++) a[k] *= 2.0/N;
+  a[0] *= 0.5;
+  a[N] *= 0.5;
+
+  // Coefficients of the derivative: b_{k-1} = b_{k+1} + 2 k a_k, b_N = 0
+  b[N]   = 0.0;
+  b[N+1] = 0.0;
+
+  for (k=N; k>=1; k--) {
+      b[k-1] = b[k+1] + 2.0*k*a[k];
+  }
+
+  b[0] *= 0.5;
+
+  dct1(b, b, N, dw->buf, dw->work, dw->plan);
+
+  for (k=0; k<=N; k++) du[k*dustride] = -b[k];
+
+}
+
+
+static void dct_derivative_transpose(const double* v, int vstride, double* dv, int dvstride, dct_work_str* dw)
+{
+  // Product of the transpose of the operator in dct_derivative() with v,
+  // used for the reverse mode of automatic differentiation.
+  int N = dw->N;
+  int k;
+  double* a = dw->a;
+  double* b = dw->b;
+
+  for (k=0; k<=N; k++) b[k] = -v[k*vstride];
+
+  dct1(b, b, N, dw->buf, dw->work, dw->plan);
+
+  // Transpose of the recurrence: a_m = 2 m sum_{k<m, m-k odd} b_k/cbar_k
+  double sum_even = 0.0;
+  double sum_odd  = 0.0;
+
+  for (k=0; k<=N; k++) {
+      a[k] = 2.0*k*( (k%2==0)? sum_odd : sum_even );
+      double bk = (k==0)? 0.5*b[0] : b[k];
+      if (k%2==0) sum_even += bk;
+      else        sum_odd  += bk;
+  }
+
+  for (k=0; k<=N; k++) a[k] *= 2.0/N;
+  a[0] *= 0.5;
+  a[N] *= 0.5;
+
+  dct1(a, a, N, dw->buf, dw->work, dw->plan);
+
+  a[0] *= 0.5;
+  a[N] *= 0.5;
+
+  for (k=0; k<=N; k++) dv[k*dvstride] = a[k];
+
+}
+
+
+void chebyshev_dct_derivative(const double* u, int ustride, double* du, int dustride, int N)
+{
+  // du = D u, where D is the CGL differentiation matrix for the sorted nodes,
+  // with the entries of u and du ustride and dustride elements apart.
+  dct_derivative(u, ustride, du, dustride, get_dct_work(N));
+}
+
+
+void chebyshev_dct_derivative_transpose(const double* v, int vstride, double* dv, int dvstride, int N)
+{
+  // dv = D' v
+  dct_derivative_transpose(v, vstride, dv, dvstride, get_dct_work(N));
+}
+
+
+void chebyshev_differentiate(DMatrix& X, DMatrix& t, DMatrix& Xdot)
+{
+  // Time derivative of the rows of X sampled at the CGL nodes t of [t0,tf],
+  // as found in solution.states and solution.nodes for Chebyshev collocation.
+  int n = X.GetNoRows();
+  int N = X.GetNoCols()-1;
+  int i, k;
+
+  if ( length(t) != N+1 ) {
+      error_message("chebyshev_differentiate: the number of columns of X does not match the length of t");
+  }
+
+  Xdot.Resize(n,N+1);
+
+  if (N < 1) {
+      Xdot.FillWithZeros();
+      return;
+  }
+
+  double tscale = 2.0/( t(N+1)-t(1) );
+
+  dct_work_str dw;
+
+  allocate_dct_work(&dw, N);
+
+  // DMatrix is stored by columns, so the rows are n elements apart
+  for (i=0; i<n; i++) {
+      dct_derivative(X.GetPr()+i, n, Xdot.GetPr()+i, n, &dw);
+  }
+
+  free_dct_work(&dw);
+
+  for (k=1; k<=N+1; k++) {
+      for (i=1; i<=n; i++) {
+          Xdot(i,k) *= tscale;
+      }
+  }
+
+}
+
+
+// ADOL-C external function. The derivative operator is linear, so the
+// Jacobian directional products reuse the same kernel and its transpose.
+
+static int dct_ext_zos_forward(int n, double* x, int /* m */, double* y)
+{
+  chebyshev_dct_derivative(x, 1, y, 1, n-1);
+  return 0;
+}
+
+
+static int dct_ext_fos_forward(int n, double* x, double* X, int /* m */, double* y, double* Y)
+{
+  dct_work_str* dw = get_dct_work(n-1);
+
+  dct_derivative(x, 1, y, 1, dw);
+  dct_derivative(X, 1, Y, 1, dw);
+
+  return 0;
+}
+
+
+static int dct_ext_fov_forward(int n, double* x, int p, double** X, int m, double* y, double** Y)
+{
+  // The directions are stored as X[i][k], input i and direction k
+  dct_work_str* dw = get_dct_work(n-1);
+
+  double* u  = dw->u;
+  double* du = dw->du;
+  int i, k;
+
+  dct_derivative(x, 1, y, 1, dw);
+
+  for (k=0; k<p; k++) {
+      for (i=0; i<n; i++) u[i] = X[i][k];
+      dct_derivative(u, 1, du, 1, dw);
+      for (i=0; i<m; i++) Y[i][k] = du[i];
+  }
+
+  return 0;
+}
+
+
+static int dct_ext_fos_reverse(int /* m */, double* U, int n, double* Z, double* /* x */, double* /* y */)
+{
+  chebyshev_dct_derivative_transpose(U, 1, Z, 1, n-1);
+  return 0;
+}
+
+
+static int dct_ext_fov_reverse(int /* m */, int p, double** U, int n, double** Z, double* /* x */, double* /* y */)
+{
+  dct_work_str* dw = get_dct_work(n-1);
+
+  for (int k=0; k<p; k++) {
+      dct_derivative_transpose(U[k], 1, Z[k], 1, dw);
+  }
+
+  return 0;
+}
+
+
+static ext_diff_fct*  dct_ext_fct = NULL;
+
+
+void chebyshev_dct_derivative_ad(adouble* states, int stride, adouble* derivs, int nstates, int N, adouble* xin, adouble* yout)
+{
+  // As mtrx_mul_trans_strided() with the CGL differentiation matrix: state j
+  // at node l is read from states[l*stride+j] and its derivative is written
+  // to derivs[l*nstates+j]. Each state trajectory is recorded on the tape as
+  // a single external function call. xin and yout hold N+1 elements each in
+  // contiguous locations, see allocate_dct_buffers().
+  int j, l;
+
+  if (dct_ext_fct == NULL) {
+      dct_ext_fct = reg_ext_fct( dct_ext_zos_forward );
+      dct_ext_fct->zos_forward = dct_ext_zos_forward;
+      dct_ext_fct->fos_forward = dct_ext_fos_forward;
+      dct_ext_fct->fov_forward = dct_ext_fov_forward;
+      dct_ext_fct->fos_reverse = dct_ext_fos_reverse;
+      dct_ext_fct->fov_reverse = dct_ext_fov_reverse;
+      dct_ext_fct->dp_x_changes       = 0;
+      dct_ext_fct->dp_y_priorRequired = 0;
+  }
+
+  for (j=0; j<nstates; j++) {
+      for (l=0; l<=N; l++) {
+          xin[l] = states[l*stride+j];
+      }
+      call_ext_fct( dct_ext_fct, N+1, xin, N+1, yout );
+      for (l=0; l<=N; l++) {
+          derivs[l*nstates+j] = yout[l];
+      }
+  }
+
+}
+
+
+void allocate_dct_buffers(adouble** xin, adouble** yout, int N)
+{
+  // call_ext_fct() needs the inputs and outputs in contiguous locations, so
+  // they are reserved before the arrays are constructed.
+  ensureContiguousLocations( 2*(N+1) );
+
+  *xin  = new adouble[N+1];
+  *yout = new adouble[N+1];
+}
+
+
+void clear_fft_plan_cache()
+{
+  std::lock_guard<std::mutex> lock(fft_plan_mutex);
+
+  while (fft_plan_cache != NULL) {
+      fft_plan_str* plan = fft_plan_cache;
+      fft_plan_cache = plan->next;
+      delete[] plan->twiddle;
+      if (plan->chirp  != NULL) delete[] plan->chirp;
+      if (plan->filter != NULL) delete[] plan->filter;
+      delete plan;
+  }
+
+}
@@ -725,8 +725,17 @@ void compute_jacobian_of_constraints_with_respect_to_variables(DMatrix& Jc, DMat
        for(j=1;j<=ncons_phase_i;j++) {
            int nstates = problem.phases(iphase).nstates;
            int norder  = problem.phases(iphase).current_number_of_intervals;
+           int npath   = problem.phases(iphase).npath;
+           bool is_defect;
            i = lam_phase_offset + j;
-           if (j<= nstates*(norder+1)) {
+           if ( use_node_major_ordering(*workspace->algorithm) ) {
+              // Defects and path constraints are interleaved node by node
+              is_defect = ( j<= (nstates+npath)*(norder+1) && (j-1)%(nstates+npath) < nstates );
+           }
+           else {
+              is_defect = ( j<= nstates*(norder+1) );
+           }
+           if (is_defect) {
            // Copy rows corresponding to differential defect constraints.
               for (k=1;k<=nvars;k++) {
                     Jc(icount,k) = Jctmp(i,k);
@@ -33,23 +33,27 @@ Author:    Professor Victor M. Becerra
 
 
 
-void evaluate_differential_error_in_phase(DMatrix& state_error, int iphase, adouble time, adouble* xad, Workspace* workspace)
+void build_phase_interpolant(PhaseInterpolant& pint, int iphase, adouble* xad, Workspace* workspace)
 {
-     //   Computes  the differential error epsilon(t) = (xdot(t)-f(x,u,p,t)) within a phase
+// This function builds, in double precision, the interpolants of the states and controls of
+// a phase from the current NLP solution. The states use the same interpolation rule as
+// get_interpolated_state() (Lagrange for global collocation with less than 100 intervals,
+// natural cubic splines otherwise), but the Lagrange polynomial is evaluated in barycentric
+// form, and the spline second derivatives are computed only once per trajectory.
 
      Prob* problem = workspace->problem;
-     adouble dot_state_j;
-     adouble state_j;
-     adouble control_j;
-     adouble* states;
-     adouble* controls;
-     adouble* path;
-     adouble* parameters;
-     adouble* derivatives;
+     Alg*  algorithm = workspace->algorithm;
      int i = iphase-1;
+     int norder    = problem->phase[i].current_number_of_intervals;
+     int nnodes    = norder+1;
      int nstates   = problem->phase[i].nstates;
      int ncontrols = problem->phase[i].ncontrols;
-     int j, iph;
+     int nparam    = 0;
+     adouble* traj = workspace->single_trajectory_tmp;
+     adouble t0, tf;
+     DMatrix Yj(1,nnodes);
+     DMatrix d2Yj(1,nnodes);
+     int j, k, iph;
 
      if ( problem->multi_segment_flag || workspace->auto_linked_flag ) {
 	  iph = 1;
@@ -57,29 +61,208 @@ void evaluate_differential_error_in_phase(DMatrix& state_error, int iphase, adou
      else {
 	  iph = iphase;
      }
+     nparam = problem->phase[iph-1].nparameters;
+
+     pint.iphase    = iphase;
+     pint.nnodes    = nnodes;
+     pint.nstates   = nstates;
+     pint.ncontrols = ncontrols;
+     pint.nparameters = nparam;
+     pint.lagrange  = use_global_collocation(*algorithm) && !use_hp_collocation(*algorithm) && norder<100;
+
+     pint.time.Resize(1,nnodes);
+     pint.X.Resize(nstates,nnodes);
+     pint.U.Resize(MAX(ncontrols,1),nnodes);
+     pint.p.Resize(MAX(nparam,1),1);
+
+     get_times( &t0, &tf, xad, iphase, workspace);
+     for (k=1; k<=nnodes; k++) {
+	  pint.time(k) = convert_to_original_time_ad( (workspace->snodes[i])(k), t0, tf ).value();
+     }
+
+     for (j=1; j<=nstates; j++) {
+	  get_individual_state_trajectory(traj, j, iphase, xad, workspace);
+	  for (k=1; k<=nnodes; k++) pint.X(j,k) = traj[k-1].value();
+     }
+
+     for (j=1; j<=ncontrols; j++) {
+	  get_individual_control_trajectory(traj, j, iphase, xad, workspace);
+	  for (k=1; k<=nnodes; k++) pint.U(j,k) = traj[k-1].value();
+     }
+
+     if (nparam>0) {
+	  get_parameters(workspace->parameters[iph-1], xad, iphase, workspace );
+	  for (j=1; j<=nparam; j++) pint.p(j) = (workspace->parameters[iph-1])[j-1].value();
+     }
+
+     if (pint.lagrange) {
+	  pint.w = workspace->bary_weights[i];
+     }
+     else {
+	  pint.d2X.Resize(nstates,nnodes);
+	  for (j=1; j<=nstates; j++) {
+	       Yj = pint.X(j,colon());
+	       spline_second_derivative(pint.time, Yj, nnodes, d2Yj);
+	       pint.d2X(j,colon()) = d2Yj;
+	  }
+     }
+
+     pint.d2U.Resize(MAX(ncontrols,1),nnodes);
+     for (j=1; j<=ncontrols; j++) {
+	  Yj = pint.U(j,colon());
+	  spline_second_derivative(pint.time, Yj, nnodes, d2Yj);
+	  pint.d2U(j,colon()) = d2Yj;
+     }
+}
+
+
+static void evaluate_spline_rows(double* y, double* dy, double* Y, double* d2Y, int nrows, int kl, double A, double B, double h)
+{
+// Evaluates the natural cubic splines of nrows trajectories (stored column-wise, nrows x nnodes)
+// within the interval [kl,kl+1] (0-based), and optionally their first derivatives.
+
+     int j;
+     double* yl   = Y   + kl*nrows;
+     double* yr   = Y   + (kl+1)*nrows;
+     double* d2yl = d2Y + kl*nrows;
+     double* d2yr = d2Y + (kl+1)*nrows;
+     double C  = (A*A*A-A)*(h*h)/6.0;
+     double D  = (B*B*B-B)*(h*h)/6.0;
+     double dC = -(3.0*A*A-1.0)*h/6.0;
+     double dD =  (3.0*B*B-1.0)*h/6.0;
+
+     for (j=0; j<nrows; j++) {
+	  y[j] = A*yl[j] + B*yr[j] + C*d2yl[j] + D*d2yr[j];
+	  if (dy) dy[j] = (yr[j]-yl[j])/h + dC*d2yl[j] + dD*d2yr[j];
+     }
+}
+
+
+void evaluate_phase_interpolant(PhaseInterpolant& pint, double time, double* x, double* xdot, double* u, double* c)
+{
+// This function evaluates the interpolated states x, their time derivatives xdot and the
+// interpolated controls u at a given time. The interval search (spline case) or the barycentric
+// coefficients (Lagrange case, using the scratch array c of length nnodes) are computed once and
+// shared by all the trajectories of the phase.
+
+     int nnodes    = pint.nnodes;
+     int nstates   = pint.nstates;
+     int ncontrols = pint.ncontrols;
+     double* t     = pint.time.GetPr();
+     double* X     = pint.X.GetPr();
+     int kl, kr, k, j, knode;
+     double h, A, B;
+
+     kl = 0;
+     kr = nnodes-1;
+     while (kr-kl > 1) {
+	  k = (kr+kl)/2;
+	  if (t[k] > time) kr = k;
+	  else kl = k;
+     }
+     h = t[kr]-t[kl];
+     if (h == 0.0) error_message("Bad node times in evaluate_phase_interpolant()");
+     A = (t[kr]-time)/h;
+     B = (time-t[kl])/h;
+
+     if (ncontrols>0) {
+	  evaluate_spline_rows(u, NULL, pint.U.GetPr(), pint.d2U.GetPr(), ncontrols, kl, A, B, h);
+     }
+
+     if (!pint.lagrange) {
+	  evaluate_spline_rows(x, xdot, X, pint.d2X.GetPr(), nstates, kl, A, B, h);
+	  return;
+     }
+
+     // Barycentric Lagrange interpolation. If the time coincides with a node, the value is
+     // the nodal value and the derivative is given by the corresponding row of the
+     // differentiation matrix, expressed in terms of the barycentric weights.
+
+     double* w = pint.w.GetPr();
+
+     knode = -1;
+     if (time == t[kl]) knode = kl;
+     else if (time == t[kr]) knode = kr;
+
+     for (j=0; j<nstates; j++) { x[j] = 0.0; xdot[j] = 0.0; }
+
+     if (knode >= 0) {
+	  double* Xn = X + knode*nstates;
+	  for (j=0; j<nstates; j++) x[j] = Xn[j];
+	  for (k=0; k<nnodes; k++) {
+	       if (k == knode) continue;
+	       double dk = (w[k]/w[knode])/(t[knode]-t[k]);
+	       double* Xk = X + k*nstates;
+	       for (j=0; j<nstates; j++) xdot[j] += dk*(Xk[j]-Xn[j]);
+	  }
+	  return;
+     }
+
+     double S = 0.0;
+     for (k=0; k<nnodes; k++) {
+	  c[k] = w[k]/(time-t[k]);
+	  S   += c[k];
+     }
+     for (k=0; k<nnodes; k++) {
+	  double ck = c[k]/S;
+	  double* Xk = X + k*nstates;
+	  for (j=0; j<nstates; j++) x[j] += ck*Xk[j];
+     }
+     // p'(t) = sum_k l_k(t) (p(t)-y_k)/(t-t_k)
+     for (k=0; k<nnodes; k++) {
+	  double ck = c[k]/(S*(time-t[k]));
+	  double* Xk = X + k*nstates;
+	  for (j=0; j<nstates; j++) xdot[j] += ck*(x[j]-Xk[j]);
+     }
+}
 
-     states        = workspace->states[i];
-     controls      = workspace->controls[i];
-     parameters    = workspace->parameters[iph-1];
-     path          = workspace->path[i];
-     derivatives   = workspace->derivatives[i];
+
+void evaluate_differential_error_in_phase(DMatrix& state_error, PhaseInterpolant& pint, double time, adouble* xad, EvalScratch* scratch, Workspace* workspace)
+{
+     //   Computes  the differential error epsilon(t) = (xdot(t)-f(x,u,p,t)) within a phase.
+     //   Only the scratch arrays are written, so that different threads may evaluate the error
+     //   at the same time, each with its own scratch and copy of xad.
+
+     Prob* problem = workspace->problem;
+     adouble* states      = scratch->states;
+     adouble* controls    = scratch->controls;
+     adouble* parameters  = scratch->parameters;
+     adouble* path        = scratch->path;
+     adouble* derivatives = scratch->derivatives;
+     int iphase    = pint.iphase;
+     int nstates   = pint.nstates;
+     int ncontrols = pint.ncontrols;
+     int nparam    = pint.nparameters;
+     double* x     = scratch->interp;
+     double* xdot  = x + nstates;
+     double* u     = xdot + nstates;
+     double* c     = u + ncontrols;
+     int j;
+     adouble time_ad = time;
+
+     evaluate_phase_interpolant(pint, time, x, xdot, u, c);
 
      for (j=0;j<nstates;j++) {
-          get_interpolated_state(&state_j, j+1, iphase, time, xad, workspace);
-          states[j]       = state_j;
+          states[j]       = x[j];
      }
 
      for (j=0;j<ncontrols;j++) {
-          get_interpolated_control(&control_j, j+1, iphase, time, xad, workspace);
-          controls[j]       = control_j;
+          controls[j]     = u[j];
      }
 
-     get_parameters(parameters, xad, iphase, workspace );
-     problem->dae(derivatives, path, states, controls, parameters, time, xad, iphase, workspace);
+     for (j=0;j<nparam;j++) {
+          parameters[j]   = pint.p(j+1);
+     }
+
+     problem->dae(derivatives, path, states, controls, parameters, time_ad, xad, iphase, workspace);
+
+#ifdef USE_OPENMP
+#pragma omp atomic
+#endif
+     workspace->solution->mesh_stats[ workspace->current_mesh_refinement_iteration-1 ].n_error_rhs_evals++;
 
      for (j=0;j<nstates;j++) {
-          get_state_derivative(&dot_state_j,j+1,iphase,time,xad, workspace);
-          state_error(j+1) = dot_state_j.value() - derivatives[j].value();
+          state_error(j+1) = xdot[j] - derivatives[j].value();
      }
 
 }
@@ -87,107 +270,308 @@ void evaluate_differential_error_in_phase(DMatrix& state_error, int iphase, adou
 
 
 
-void evaluate_integral_of_differential_error(DMatrix& eta, int iphase, adouble t1, adouble t2, adouble* xad, int n, Workspace* workspace)
+void evaluate_integral_of_differential_error(DMatrix& eta, PhaseInterpolant& pint, double t1, double t2, int n, adouble* xad, EvalScratch* scratch, Workspace* workspace)
 {
 // This function evaluates integral[t1,t2]{ |xdot-f(x,u,p,t)| } dt
 // by using composite Simpson intergration with n steps.
+// The sums are accumulated element by element: the temporary objects used by DMatrix expressions
+// are only allocated in the main thread, and this function may be called from other threads.
 
-     	Prob* problem = workspace->problem;
-     	int nstates   = problem->phase[iphase-1].nstates;
-	double h = (t2.value()-t1.value())/n;
+     	int nstates   = pint.nstates;
+	double h = (t2-t1)/n;
 	int i, j;
 
-	DMatrix R1(nstates,1);
-	DMatrix state_error1(nstates,1);
-	DMatrix state_error2(nstates,1);
+	DMatrix state_error(nstates,1);
 
-        evaluate_differential_error_in_phase( state_error1, iphase, t1, xad, workspace );
-        evaluate_differential_error_in_phase( state_error2, iphase, t2, xad, workspace );
+	eta.Resize(nstates,1);
 
-	R1(colon(),1) = ( Abs(state_error1) + Abs(state_error2) );
+        evaluate_differential_error_in_phase( state_error, pint, t1, xad, scratch, workspace );
+	for (i=1; i<=nstates; i++) eta(i) = fabs( state_error(i) );
+
+        evaluate_differential_error_in_phase( state_error, pint, t2, xad, scratch, workspace );
+	for (i=1; i<=nstates; i++) eta(i) += fabs( state_error(i) );
 
         int nover2 = (int) n/2;
 
 	for (j=1; j<=nover2-1; j++) {
 
-			evaluate_differential_error_in_phase( state_error1, iphase, t1 +2*j*h, xad, workspace );
-			R1 += 2.0*Abs( state_error1 );
+			evaluate_differential_error_in_phase( state_error, pint, t1 +2*j*h, xad, scratch, workspace );
+			for (i=1; i<=nstates; i++) eta(i) += 2.0*fabs( state_error(i) );
 	}
 
 	for (j=1; j<=nover2; j++) {
 
-			evaluate_differential_error_in_phase( state_error1, iphase, t1 +(2*j-1)*h, xad, workspace );
-			R1 += 4.0*Abs( state_error1 );
+			evaluate_differential_error_in_phase( state_error, pint, t1 +(2*j-1)*h, xad, scratch, workspace );
+			for (i=1; i<=nstates; i++) eta(i) += 4.0*fabs( state_error(i) );
 	}
 
 
-	eta = (h/3.0)*R1;
+	for (i=1; i<=nstates; i++) eta(i) *= h/3.0;
 }
 
 
-void evaluate_integral_of_differential_error_L2(DMatrix& eta, int iphase, adouble t1, adouble t2, adouble* xad, int n, Workspace* workspace)
+void evaluate_integral_of_differential_error_L2(DMatrix& eta, PhaseInterpolant& pint, double t1, double t2, int n, adouble* xad, EvalScratch* scratch, Workspace* workspace)
 {
 // This function evaluates the L2 norm SQRT[ integral[t1,t2]{ |xdot-f(x,u,p,t)|^2 } dt ]
 // by using composite Simpson intergration with n steps.
 
-     	Prob* problem = workspace->problem;
-     	int nstates   = problem->phase[iphase-1].nstates;
+     	int nstates   = pint.nstates;
 
-	double h = (t2.value()-t1.value())/n;
+	double h = (t2-t1)/n;
 	int i, j;
 
-	DMatrix R1(nstates,1);
-	DMatrix state_error1(nstates,1);
-	DMatrix state_error2(nstates,1);
+	DMatrix state_error(nstates,1);
+
+	eta.Resize(nstates,1);
 
-        evaluate_differential_error_in_phase( state_error1, iphase, t1, xad, workspace );
-        evaluate_differential_error_in_phase( state_error2, iphase, t2, xad, workspace );
+        evaluate_differential_error_in_phase( state_error, pint, t1, xad, scratch, workspace );
+	for (i=1; i<=nstates; i++) eta(i) = state_error(i)*state_error(i);
 
-	R1(colon(),1) = ( (state_error1^2) + (state_error2^2) );
+        evaluate_differential_error_in_phase( state_error, pint, t2, xad, scratch, workspace );
+	for (i=1; i<=nstates; i++) eta(i) += state_error(i)*state_error(i);
 
         int nover2 = (int) n/2;
 
 	for (j=1; j<=nover2-1; j++) {
 
-			evaluate_differential_error_in_phase( state_error1, iphase, t1 +2*j*h, xad, workspace );
-			R1 += 2.0*( state_error1^2 );
+			evaluate_differential_error_in_phase( state_error, pint, t1 +2*j*h, xad, scratch, workspace );
+			for (i=1; i<=nstates; i++) eta(i) += 2.0*state_error(i)*state_error(i);
 	}
 
 	for (j=1; j<=nover2; j++) {
 
-			evaluate_differential_error_in_phase( state_error1, iphase, t1 +(2*j-1)*h, xad, workspace );
-			R1 += 4.0*( state_error1^2 );
+			evaluate_differential_error_in_phase( state_error, pint, t1 +(2*j-1)*h, xad, scratch, workspace );
+			for (i=1; i<=nstates; i++) eta(i) += 4.0*state_error(i)*state_error(i);
 	}
 
 
-	eta = Sqrt( (h/3.0)*R1 );
+	for (i=1; i<=nstates; i++) eta(i) = sqrt( (h/3.0)*eta(i) );
+}
+
+
+// Abscissae and weights of the 15-point Kronrod rule and of the embedded 7-point Gauss rule on [-1,1].
+// The Gauss abscissae are xgk[1], xgk[3], xgk[5] and xgk[7] = 0.
+// Reference: Piessens et al. (1983) "QUADPACK: A subroutine package for automatic integration". Springer.
+
+static const double xgk[8] = { 0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+                               0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+                               0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+                               0.207784955007898467600689403773245, 0.000000000000000000000000000000000 };
+
+static const double wgk[8] = { 0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+                               0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+                               0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+                               0.204432940075298892414161999234649, 0.209482141084727828012999174891714 };
+
+static const double wg[4]  = { 0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+                               0.381830050505118944950369775488975, 0.417959183673469387755102040816327 };
+
+#define GK_MAX_BISECTIONS 8
+
+
+void gauss_kronrod_integral_of_differential_error(DMatrix& eta, DMatrix& err, PhaseInterpolant& pint, double t1, double t2, adouble* xad, EvalScratch* scratch, Workspace* workspace)
+{
+// This function evaluates integral[t1,t2]{ |xdot-f(x,u,p,t)| } dt with the 15-point Kronrod rule, and
+// returns in err the difference with the embedded 7-point Gauss rule as an error estimate.
+
+     	int nstates   = pint.nstates;
+	double center = 0.5*(t1+t2);
+	double hlength = 0.5*(t2-t1);
+	int i, j, k;
+
+	DMatrix state_error(nstates,1);
+
+	eta.Resize(nstates,1);
+	err.Resize(nstates,1);
+
+	// Centre of the interval, which is a node of both rules. err holds the Gauss sum meanwhile.
+	evaluate_differential_error_in_phase( state_error, pint, center, xad, scratch, workspace );
+	for (i=1; i<=nstates; i++) {
+		eta(i) = wgk[7]*fabs( state_error(i) );
+		err(i) = wg[3]*fabs( state_error(i) );
+	}
+
+	for (k=0; k<7; k++) {
+		for (j=-1; j<=1; j+=2) {
+			evaluate_differential_error_in_phase( state_error, pint, center + j*hlength*xgk[k], xad, scratch, workspace );
+			for (i=1; i<=nstates; i++) {
+				double fi = fabs( state_error(i) );
+				eta(i) += wgk[k]*fi;
+				if (k%2 == 1) err(i) += wg[k/2]*fi;
+			}
+		}
+	}
+
+	for (i=1; i<=nstates; i++) {
+		eta(i) *= hlength;
+		err(i)  = fabs( eta(i) - hlength*err(i) );
+	}
+}
+
+
+void adaptive_integral_of_differential_error(DMatrix& eta, PhaseInterpolant& pint, double t1, double t2, DMatrix& tol, int depth, adouble* xad, EvalScratch* scratch, Workspace* workspace)
+{
+// This function evaluates integral[t1,t2]{ |xdot-f(x,u,p,t)| } dt by adaptive bisection of the interval,
+// using Gauss-Kronrod G7/K15 on each subinterval. A subinterval is accepted when, for every state,
+// the error estimate is below the absolute tolerance tol(i) or below a relative tolerance of the
+// integral. The tolerance is split between the two halves on bisection.
+
+     	int nstates   = pint.nstates;
+	int i;
+	bool accept = true;
+
+	DMatrix err;
+	DMatrix eta_half;
+	DMatrix tol_half(nstates,1);
+
+	gauss_kronrod_integral_of_differential_error(eta, err, pint, t1, t2, xad, scratch, workspace);
+
+	for (i=1; i<=nstates; i++) {
+		if ( err(i) > MAX( tol(i), 1.e-3*eta(i) ) ) accept = false;
+	}
+
+	if (accept || depth >= GK_MAX_BISECTIONS) return;
+
+	double tm = 0.5*(t1+t2);
+	for (i=1; i<=nstates; i++) tol_half(i) = 0.5*tol(i);
+
+	adaptive_integral_of_differential_error(eta, pint, t1, tm, tol_half, depth+1, xad, scratch, workspace);
+	adaptive_integral_of_differential_error(eta_half, pint, tm, t2, tol_half, depth+1, xad, scratch, workspace);
+	for (i=1; i<=nstates; i++) eta(i) += eta_half(i);
+}
+
+
+static void integrate_differential_error_in_interval(DMatrix& eta_k, PhaseInterpolant& pint, int k, DMatrix& tol, int n, adouble* xad, EvalScratch* scratch, Workspace* workspace)
+{
+// Integrated absolute differential error of each state over interval k of a phase, using the
+// error integration method selected in the algorithm options.
+
+	double t1 = pint.time(k);
+	double t2 = pint.time(k+1);
+
+	if (workspace->algorithm->error_integration == "gauss-kronrod")
+		adaptive_integral_of_differential_error(eta_k, pint, t1, t2, tol, 0, xad, scratch, workspace);
+	else
+		evaluate_integral_of_differential_error(eta_k, pint, t1, t2, n, xad, scratch, workspace);
+}
+
+
+static void error_integration_tolerance(DMatrix& tol, int iphase, Workspace* workspace)
+{
+// Absolute tolerance for the adaptive integration of the errors of each state in a phase: a fraction
+// of the ODE tolerance, relative to the error scaling weights.
+
+	Alg* algorithm = workspace->algorithm;
+
+	if (algorithm->error_integration == "gauss-kronrod") {
+		tol = (1.e-2*algorithm->ode_tolerance)*workspace->error_scaling_weights[iphase-1];
+	}
 }
 
 
 void evaluate_matrix_of_integrated_errors_in_phase(DMatrix& eta, int iphase, adouble* xad, int n, Workspace* workspace)
 {
 //	This function computes a matrix of integrated absolute differential errors, where element (i,j)
-//	corresponds to state i and interval j within the phase.
-	int k;
-	adouble t1, t2;
-	adouble t0, tf;
+//	corresponds to state i and interval j within the phase. The state and control interpolants
+//	are built once for the whole sweep. With the "gauss-kronrod" error integration option, each
+//	integral is computed adaptively to a fraction of the ODE tolerance, relative to the error
+//	scaling weights of the phase.
+	int i, k;
      	Prob* problem = workspace->problem;
         int norder    = problem->phase[iphase-1].current_number_of_intervals;
-        int nnodes    = norder + 1;
      	int nstates   = problem->phase[iphase-1].nstates;
 	DMatrix eta_k(nstates,1);
-        get_times(&t0, &tf, xad, iphase, workspace );
+	DMatrix tol;
+	PhaseInterpolant pint;
 
-	for (k=1;k< nnodes;k++){
-		t1 = convert_to_original_time_ad( (workspace->snodes[iphase-1])(k), t0, tf );
-		t2 = convert_to_original_time_ad( (workspace->snodes[iphase-1])(k+1), t0, tf );;
+	build_phase_interpolant(pint, iphase, xad, workspace);
 
-        	evaluate_integral_of_differential_error(eta_k,iphase,t1,t2,xad,n, workspace);
-		eta(colon(),k) = eta_k;
+	error_integration_tolerance(tol, iphase, workspace);
+
+	for (k=1;k<=norder;k++){
+		integrate_differential_error_in_interval(eta_k, pint, k, tol, n, xad, workspace->eval_scratch, workspace);
+		for (i=1;i<=nstates;i++) eta(i,k) = eta_k(i);
 	}
 }
 
 
+void evaluate_matrix_of_integrated_errors_threaded(DMatrix* eta, adouble* xad, int n, Workspace* workspace)
+{
+//	Threaded version of evaluate_matrix_of_integrated_errors_in_phase() for all the phases at once.
+//	The interpolants are built by the calling thread, and the intervals of all the phases are then
+//	shared out between algorithm.nlp_threads threads. Each thread has its own copy of the decision
+//	vector and its own scratch arrays, and writes to disjoint columns of eta. The user DAE
+//	function must be safe to call concurrently.
+
+	Prob* problem = workspace->problem;
+	Alg*  algorithm = workspace->algorithm;
+	int nphases  = problem->nphases;
+	int nvars    = workspace->nvars;
+	int i, j, m;
+	int nitems   = 0;
+
+	PhaseInterpolant* pint = new PhaseInterpolant[nphases];
+	DMatrix* tol = new DMatrix[nphases];
+
+	for (i=0; i<nphases; i++) {
+		build_phase_interpolant(pint[i], i+1, xad, workspace);
+		error_integration_tolerance(tol[i], i+1, workspace);
+		nitems += problem->phase[i].current_number_of_intervals;
+	}
+
+	int* item_phase    = new int[nitems];
+	int* item_interval = new int[nitems];
+	double* xval       = new double[nvars];
+
+	m = 0;
+	for (i=0; i<nphases; i++) {
+		for (j=1; j<=problem->phase[i].current_number_of_intervals; j++) {
+			item_phase[m]    = i;
+			item_interval[m] = j;
+			m++;
+		}
+	}
+
+	for (j=0; j<nvars; j++) {
+		xval[j] = xad[j].value();
+	}
+
+#ifdef USE_OPENMP
+#pragma omp parallel ADOLC_OPENMP_NC num_threads(algorithm->nlp_threads) private(i,j)
+#endif
+	{
+		adouble* xad_t = new adouble[nvars];
+		EvalScratch scratch;
+		DMatrix eta_k;
+
+		allocate_eval_scratch(&scratch, *problem, *algorithm);
+
+		for (j=0; j<nvars; j++) {
+			xad_t[j] = xval[j];
+		}
+
+#ifdef USE_OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+		for (m=0; m<nitems; m++) {
+			int ip = item_phase[m];
+			int k  = item_interval[m];
+			integrate_differential_error_in_interval(eta_k, pint[ip], k, tol[ip], n, xad_t, &scratch, workspace);
+			for (i=1; i<=pint[ip].nstates; i++) eta[ip](i,k) = eta_k(i);
+		}
+
+		free_eval_scratch(&scratch);
+		delete[] xad_t;
+	}
+
+	delete[] pint;
+	delete[] tol;
+	delete[] item_phase;
+	delete[] item_interval;
+	delete[] xval;
+}
+
+
 
 
 void evaluate_solution(Prob& problem,Alg& algorithm,Sol& solution, Workspace* workspace)
@@ -200,7 +584,7 @@ void evaluate_solution(Prob& problem,Alg& algorithm,Sol& solution, Workspace* wo
 	int iphase;
 	int n = algorithm.nsteps_error_integration;
 	adouble* xad = workspace->xad;
-	DMatrix eta;
+	DMatrix* eta = new DMatrix[nphases];
 	char msg[100];
 
 	DMatrix states;
@@ -211,6 +595,7 @@ void evaluate_solution(Prob& problem,Alg& algorithm,Sol& solution, Workspace* wo
 	DMatrix eta_i;
 	int i;
 	psopt_print(workspace,"\n>>> Evaluating the discretization (ODE) error...\n\n");
+	invalidate_spline_cache(workspace);
         for(iphase=1;iphase<=nphases;iphase++) {
 	        DMatrix& epsilon = solution.relative_errors[iphase-1];
 		// store previous relative errors before calculating the new ones
@@ -228,16 +613,35 @@ void evaluate_solution(Prob& problem,Alg& algorithm,Sol& solution, Workspace* wo
 				w(i) = MAX(  MaxAbs( states_i ), MaxAbs( Xdot_i ) ) + 1.0;
 			}
 		}
-		eta.Resize(nstates,norder);
-    		evaluate_matrix_of_integrated_errors_in_phase(eta,iphase,xad,n, workspace);
+		eta[iphase-1].Resize(nstates,norder);
+	}
+
+	// The intervals are independent given the solution, so they are shared out between
+	// threads when the numerical evaluations are threaded.
+
+	if (algorithm.nlp_threads > 1) {
+		evaluate_matrix_of_integrated_errors_threaded(eta, xad, n, workspace);
+	}
+	else {
+		for(iphase=1;iphase<=nphases;iphase++) {
+    			evaluate_matrix_of_integrated_errors_in_phase(eta[iphase-1],iphase,xad,n, workspace);
+		}
+	}
+
+        for(iphase=1;iphase<=nphases;iphase++) {
+	        DMatrix& epsilon = solution.relative_errors[iphase-1];
+		DMatrix& w = workspace->error_scaling_weights[iphase-1];
+		int norder = problem.phase[iphase-1].current_number_of_intervals;
 		for(i=1;i<=norder;i++) {
-			eta(colon(),i) = elemDivision( eta(colon(),i), w );
-			eta_i = eta(colon(),i);
+			eta[iphase-1](colon(),i) = elemDivision( eta[iphase-1](colon(),i), w );
+			eta_i = eta[iphase-1](colon(),i);
 			epsilon(1,i)   = Max( eta_i );
 		}
 
 	}
 
+	delete[] eta;
+
 	// Now print statistics to file
 
 	DMatrix mv(1,1);
@@ -261,6 +665,14 @@ void evaluate_solution(Prob& problem,Alg& algorithm,Sol& solution, Workspace* wo
              solution.mesh_stats[ workspace->current_mesh_refinement_iteration-1 ].method = "H-S";
         }
 
+        else if (use_local_collocation(algorithm)&& workspace->differential_defects == "Lobatto-IIIA") {
+             solution.mesh_stats[ workspace->current_mesh_refinement_iteration-1 ].method = "LOB";
+        }
+
+	else if (use_hp_collocation(algorithm)) {
+             solution.mesh_stats[ workspace->current_mesh_refinement_iteration-1 ].method = "LGL-HP";
+        }
+
 	else if (use_global_collocation(algorithm)&&algorithm.collocation_method == "Legendre") {
              solution.mesh_stats[ workspace->current_mesh_refinement_iteration-1 ].method = "LGL";
         }
@@ -276,6 +688,8 @@ void evaluate_solution(Prob& problem,Alg& algorithm,Sol& solution, Workspace* wo
 	        solution.mesh_stats[ workspace->current_mesh_refinement_iteration-1 ].method += "-RR";
 	    else if ( algorithm.diff_matrix == "central-differences")
 	        solution.mesh_stats[ workspace->current_mesh_refinement_iteration-1 ].method += "-CD";
+	    else if ( algorithm.diff_matrix == "dct")
+	        solution.mesh_stats[ workspace->current_mesh_refinement_iteration-1 ].method += "-DCT";
 
 	}
 
@@ -310,13 +724,13 @@ void evaluate_solution(Prob& problem,Alg& algorithm,Sol& solution, Workspace* wo
 		);
 	psopt_print(workspace,msg);
 
-	sprintf(msg,"\n\nN Jac Eval\tN Hes Eval\tN ODE RHS\tMax ODE Error\tNLP CPU (sec)");
+	sprintf(msg,"\n\nN Jac Eval\tN Hes Eval\tN ODE RHS\tN Err RHS\tMax ODE Error\tNLP CPU (sec)");
 	psopt_print(workspace,msg);
 
-	sprintf(msg,"\n%i\t\t%i\t\t%i\t\t%e\t%e",
+	sprintf(msg,"\n%i\t\t%i\t\t%i\t\t%i\t\t%e\t%e",
 		solution.mesh_stats[jj].n_jacobian_evals, solution.mesh_stats[jj].n_hessian_evals,
-		solution.mesh_stats[jj].n_ode_rhs_evals, solution.mesh_stats[jj].epsilon_max,
-		solution.mesh_stats[jj].CPU_time);
+		solution.mesh_stats[jj].n_ode_rhs_evals, solution.mesh_stats[jj].n_error_rhs_evals,
+		solution.mesh_stats[jj].epsilon_max, solution.mesh_stats[jj].CPU_time);
 	psopt_print(workspace,msg);
 
         psopt_print(workspace,"\n*******************************************************************************\n\n");
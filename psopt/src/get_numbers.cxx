@@ -250,6 +250,121 @@ int get_iphase_offset(Prob& problem, int iphase, Workspace* workspace)
 
 
 
+bool use_node_major_ordering(Alg& algorithm)
+{
+       return ( algorithm.nlp_variable_ordering == "node-major" );
+}
+
+// The functions below give the position of the node variables and constraints within
+// the block of phase i (zero based). With the standard ordering the phase variables are
+// [controls | states | parameters | midpoint controls | t0 tf] and the constraints are
+// [defects | events | path | midpoint path | tf>=t0]. With the node-major ordering the
+// first blocks are interleaved node by node as (u_k, x_k) and (defects_k, path_k), so
+// that local collocation gives a banded KKT matrix. The remaining blocks do not move.
+
+int get_control_offset(Prob& problem, int i, int k, Workspace* workspace)
+{
+	int ncontrols = problem.phase[i].ncontrols;
+	int nstates   = problem.phase[i].nstates;
+
+        if ( use_node_major_ordering(*workspace->algorithm) )
+            return (k-1)*(ncontrols+nstates);
+        else
+            return (k-1)*ncontrols;
+}
+
+int get_state_offset(Prob& problem, int i, int k, Workspace* workspace)
+{
+	int norder    = problem.phase[i].current_number_of_intervals;
+	int ncontrols = problem.phase[i].ncontrols;
+	int nstates   = problem.phase[i].nstates;
+
+        if ( use_node_major_ordering(*workspace->algorithm) )
+            return (k-1)*(ncontrols+nstates) + ncontrols;
+        else
+            return ncontrols*(norder+1) + (k-1)*nstates;
+}
+
+int get_state_stride(Prob& problem, int i, Workspace* workspace)
+{
+        // Distance between the states of consecutive nodes in the decision vector
+
+        if ( use_node_major_ordering(*workspace->algorithm) )
+            return problem.phase[i].ncontrols + problem.phase[i].nstates;
+        else
+            return problem.phase[i].nstates;
+}
+
+int get_defect_offset(Prob& problem, int i, int k, Workspace* workspace)
+{
+	int nstates   = problem.phase[i].nstates;
+        int npath     = problem.phase[i].npath;
+
+        if ( use_node_major_ordering(*workspace->algorithm) )
+            return (k-1)*(nstates+npath);
+        else
+            return (k-1)*nstates;
+}
+
+int get_path_offset(Prob& problem, int i, int k, Workspace* workspace)
+{
+	int norder    = problem.phase[i].current_number_of_intervals;
+	int nstates   = problem.phase[i].nstates;
+        int nevents   = problem.phase[i].nevents;
+        int npath     = problem.phase[i].npath;
+
+        if ( use_node_major_ordering(*workspace->algorithm) )
+            return (k-1)*(nstates+npath) + nstates;
+        else
+            return nstates*(norder+1) + nevents + (k-1)*npath;
+}
+
+int get_event_offset(Prob& problem, int i, Workspace* workspace)
+{
+	int norder    = problem.phase[i].current_number_of_intervals;
+	int nstates   = problem.phase[i].nstates;
+        int npath     = problem.phase[i].npath;
+
+        if ( use_node_major_ordering(*workspace->algorithm) )
+            return (nstates+npath)*(norder+1);
+        else
+            return nstates*(norder+1);
+}
+
+
+
+int get_evaluation_blocks(Prob& problem, int* nitems, int nthreads, int align, int* block_phase, int* block_first, int* block_last)
+{
+       // Splits items 1..nitems[i] of every phase into contiguous blocks for the threaded
+       // function evaluations. The block size gives about two blocks per thread, so short
+       // phases are not split while long phases are shared out between threads. The block
+       // size is a multiple of align, so every block starts at item 1+m*align. The block
+       // arrays must have room for nphases+2*nthreads entries. Returns the number of blocks.
+
+       int i, k;
+       int nblocks = 0;
+       int ntotal  = 0;
+
+       for(i=0;i<problem.nphases;i++) ntotal += nitems[i];
+
+       int block_size = MAX( 1, (ntotal + 2*nthreads - 1)/(2*nthreads) );
+
+       block_size = align*( (block_size + align - 1)/align );
+
+       for(i=0;i<problem.nphases;i++) {
+            for(k=1; k<=nitems[i]; k+=block_size) {
+                 block_phase[nblocks] = i;
+                 block_first[nblocks] = k;
+                 block_last[nblocks]  = MIN( k+block_size-1, nitems[i] );
+                 nblocks++;
+            }
+       }
+
+       return nblocks;
+}
+
+
+
 int get_number_of_controls(Prob& problem, int iphase)
 {
 
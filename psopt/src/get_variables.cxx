@@ -46,10 +46,10 @@ void get_controls(adouble* controls, adouble* xad, int iphase, int k, Workspace*
 
        int ncontrols = problem.phase[i].ncontrols;
 
-
+       int offset    = get_control_offset(problem, i, k, workspace);
 
         for(j=0;j<ncontrols;j++) {
-           controls[j] =  xad[iphase_offset+(k-1)*ncontrols+j]/control_scaling(j+1);
+           controls[j] =  xad[iphase_offset+offset+j]/control_scaling(j+1);
         }
 
 }
@@ -103,12 +103,10 @@ void get_states(adouble* states, adouble* xad, int iphase, int k, Workspace* wor
 
 
         int nstates = problem.phase[i].nstates;
-        int ncontrols=problem.phase[i].ncontrols;
-        int norder   =problem.phase[i].current_number_of_intervals;
-	int offset1   = ncontrols*(norder+1);
+	int offset1 = get_state_offset(problem, i, k, workspace);
         // get states
         for(j=0;j<nstates;j++) {
-           states[j] =  xad[iphase_offset+offset1+(k-1)*nstates+j]/state_scaling(j+1);
+           states[j] =  xad[iphase_offset+offset1+j]/state_scaling(j+1);
         }
 
 }
@@ -229,3 +227,137 @@ adouble get_final_time(adouble* xad, int iphase, Workspace* workspace)
 }
 
 
+
+
+
+void unscale_decision_variables(adouble* xad, adouble* xun, Workspace* workspace)
+{
+        // Applies the variable scaling once per evaluation, so that the transcription
+        // can read the unscaled variables from xun without further operations.
+
+        double* inv_scaling = workspace->inv_variable_scaling->GetPr();
+
+	int j;
+
+        for(j=0;j<workspace->nvars;j++) {
+           if (inv_scaling[j]==1.0)
+              xun[j] = xad[j];
+           else
+              xun[j] = xad[j]*inv_scaling[j];
+        }
+}
+
+void unscale_phase_variables(adouble* xad, adouble* xun, int i, Workspace* workspace)
+{
+        // As unscale_decision_variables(), restricted to the variables read by the
+        // transcription of phase i (zero based): the block of the phase and, for
+        // multi-segment or auto-linked problems, the parameters of the first phase,
+        // which are shared by all phases (see get_unscaled_parameters_ptr()).
+        // The other entries of xun are left untouched.
+
+        Prob& problem = *workspace->problem;
+
+        double* inv_scaling = workspace->inv_variable_scaling->GetPr();
+
+        int first = get_iphase_offset(problem, i+1, workspace);
+        int last  = first + get_nvars_phase_i(problem, i, workspace);
+
+	int j;
+
+        for(j=first;j<last;j++) {
+           if (inv_scaling[j]==1.0)
+              xun[j] = xad[j];
+           else
+              xun[j] = xad[j]*inv_scaling[j];
+        }
+
+        if ( i>0 && (problem.multi_segment_flag || workspace->auto_linked_flag) ) {
+           first = get_unscaled_parameters_ptr(xun, 1, workspace) - xun;
+           last  = first + problem.phase[0].nparameters;
+           for(j=first;j<last;j++) {
+              if (inv_scaling[j]==1.0)
+                 xun[j] = xad[j];
+              else
+                 xun[j] = xad[j]*inv_scaling[j];
+           }
+        }
+}
+
+adouble* get_unscaled_controls_ptr(adouble* xun, int iphase, int k, Workspace* workspace)
+{
+        // Returns a pointer to the unscaled controls at node k of phase iphase.
+        // The returned values are stored in xun and must not be modified.
+
+        Prob& problem = *workspace->problem;
+
+        int iphase_offset= get_iphase_offset(problem,iphase, workspace);
+
+        return &xun[iphase_offset+get_control_offset(problem, iphase-1, k, workspace)];
+}
+
+adouble* get_unscaled_controls_bar_ptr(adouble* xun, int iphase, int k, Workspace* workspace)
+{
+        int i = iphase-1;
+        Prob& problem = *workspace->problem;
+
+        int iphase_offset= get_iphase_offset(problem,iphase, workspace);
+
+	int norder    = problem.phase[i].current_number_of_intervals;
+	int ncontrols = problem.phase[i].ncontrols;
+	int nstates   = problem.phase[i].nstates;
+        int nparam    = problem.phase[i].nparameters;
+
+        int offset = (nstates+ncontrols)*(norder+1)+nparam;
+
+        return &xun[iphase_offset+offset+(k-1)*ncontrols];
+}
+
+adouble* get_unscaled_states_ptr(adouble* xun, int iphase, int k, Workspace* workspace)
+{
+        // Returns a pointer to the unscaled states at node k of phase iphase. The states
+        // of consecutive nodes are get_state_stride() elements apart, so the pointer for
+        // k=1 addresses the whole [nstates x norder+1] state trajectory with that stride.
+
+        Prob& problem = *workspace->problem;
+
+        int iphase_offset= get_iphase_offset(problem, iphase, workspace);
+
+        return &xun[iphase_offset+get_state_offset(problem, iphase-1, k, workspace)];
+}
+
+adouble* get_unscaled_parameters_ptr(adouble* xun, int iphase, Workspace* workspace)
+{
+        Prob& problem = *workspace->problem;
+
+	int iph;
+
+	if ( problem.multi_segment_flag || workspace->auto_linked_flag ) {
+	  iph = 1;
+	}
+	else {
+	  iph = iphase;
+	}
+
+        int i = iph-1;
+
+	int norder    = problem.phase[i].current_number_of_intervals;
+	int ncontrols = problem.phase[i].ncontrols;
+	int nstates   = problem.phase[i].nstates;
+        int offset2   = (ncontrols+nstates)*(norder+1);
+
+        int iphase_offset = get_iphase_offset(problem,iph, workspace);
+
+        return &xun[iphase_offset+offset2];
+}
+
+void get_unscaled_times(adouble *t0, adouble *tf, adouble* xun, int iphase, Workspace* workspace)
+{
+        Prob& problem = *workspace->problem;
+
+	int nvars_phase_i = get_nvars_phase_i(problem,iphase-1, workspace);
+
+        int iphase_offset = get_iphase_offset(problem, iphase, workspace);
+
+	*t0  = xun[iphase_offset + nvars_phase_i-2];
+	*tf  = xun[iphase_offset + nvars_phase_i-1];
+}
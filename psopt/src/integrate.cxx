@@ -66,7 +66,7 @@ adouble integrate( adouble (*integrand)(adouble*,adouble*,adouble*,adouble&,adou
 
         get_times(&t0, &tf, xad, iphase, workspace);
 
-	if ( !use_local_collocation(algorithm) ) {
+	if ( !use_local_collocation(algorithm) || use_lobatto_collocation(algorithm) ) {
 
 	      for(k=1; k<=norder+1; k++)
 	      {
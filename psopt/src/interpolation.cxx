@@ -41,33 +41,166 @@ void lagrange_interpolation(DMatrix& y, DMatrix& x, DMatrix& pointx, DMatrix& po
 //       lagrange_interpolation(Y, X,POINTX,POINTY) approximates the function defined by the points:
 //       P1=(POINTX(1),POINTY(1)), P2=(POINTX(2),POINTY(2)), ..., PN(POINTX(N),POINTY(N))
 //       and calculate it in each element of X
+//
+//       The polynomial is evaluated in barycentric form, see barycentric_interpolation().
 
+   DMatrix w;
 
-   int i,j;
+   barycentric_weights(w, pointx);
+
+   barycentric_interpolation(y, x, pointx, pointy, w);
+}
+
+
+void barycentric_weights(double* w, double* x, int n)
+{
+//
+//       This function computes the barycentric weights w[j] = 1/prod_{k!=j}(x[j]-x[k]) of the
+//       n distinct points in x[], for use with the barycentric form of Lagrange interpolation.
+//       The differences are scaled by 4/(xmax-xmin) to avoid overflow or underflow for large
+//       numbers of points; this rescales all the weights by the same factor, which cancels in
+//       the barycentric formula. For the same reason, the weights of any affine image of the
+//       points are equal to these.
+//
+//       Reference: Berrut and Trefethen (2004) "Barycentric Lagrange interpolation". SIAM Review.
 
-   long n = length(pointx);
+   int j,k;
 
-   DMatrix L(n, x.GetNoCols() );
+   double xmin = x[0], xmax = x[0];
 
-   for(i=1;i<=n;i++) {
-	for(j=1;j<=x.GetNoCols();j++) {
-            L(i,j) = 1.0;
+   for (j=1;j<n;j++) {
+	xmin = MIN(xmin, x[j]);
+	xmax = MAX(xmax, x[j]);
+   }
+
+   double scale = 4.0/( xmax - xmin );
+
+   for (j=0;j<n;j++) {
+	double prod = 1.0;
+	for (k=0;k<n;k++) {
+	    if (k != j) {
+		prod *= scale*( x[j]-x[k] );
+	    }
 	}
-    }
+	w[j] = 1.0/prod;
+   }
 
-   for (i=1;i<=n;i++) {
-      for (j=1;j<=n;j++) {
-           if (i != j) {
-                L(i,colon()) = ( L(i,colon())&(  x-pointx(j)*ones(1,length(x)) )  )/(pointx(i)-pointx(j));
-           }
-      }
+}
+
+
+void barycentric_weights(DMatrix& w, DMatrix& pointx)
+{
+//
+//       DMatrix version of barycentric_weights(). On output w has dimensions 1 x length(pointx).
+
+   int n = length(pointx);
+
+   w.Resize(1,n);
+
+   barycentric_weights(w.GetPr(), pointx.GetPr(), n);
+
+}
+
+
+void barycentric_interpolation(DMatrix& Y, DMatrix& X, DMatrix& pointx, DMatrix& Pointy, DMatrix& w)
+{
+//
+//       This function evaluates the Lagrange polynomials that interpolate each row of Pointy at the
+//       nodes pointx, at every point of X, using the second (true) barycentric formula
+//
+//            p(x) = sum_j w(j) y(j)/(x-pointx(j)) / sum_j w(j)/(x-pointx(j))
+//
+//       with the weights w computed by barycentric_weights(). Each evaluation costs O(N) operations
+//       per row, and the coefficients are shared by all the rows.
+//       Pointy has dimensions ny x N, X has M elements, and on output Y has dimensions ny x M.
+
+   int i, j, m;
+
+   int n  = length(pointx);
+   int ny = Pointy.GetNoRows();
+   int nx = length(X);
+
+   double* px = pointx.GetPr();
+   double* py = Pointy.GetPr();
+   double* pw = w.GetPr();
+   double* pX = X.GetPr();
+
+   Y.Resize(ny,nx);
+
+   double* pY = Y.GetPr();
+
+   for (m=0;m<nx;m++) {
+	double  xm = pX[m];
+	double* ym = pY + m*ny;
+	int knode  = -1;
+
+	for (j=0;j<n;j++) {
+	    if (xm == px[j]) { knode = j; break; }
+	}
+
+	if (knode >= 0) {
+	    for (i=0;i<ny;i++) ym[i] = py[knode*ny+i];
+	    continue;
+	}
+
+	double S = 0.0;
+	for (i=0;i<ny;i++) ym[i] = 0.0;
+
+	for (j=0;j<n;j++) {
+	    double c = pw[j]/(xm-px[j]);
+	    S += c;
+	    for (i=0;i<ny;i++) ym[i] += c*py[j*ny+i];
+	}
+
+	for (i=0;i<ny;i++) ym[i] /= S;
    }
 
-   y.Resize(1,length(x));
-   y.FillWithZeros();
-   for (i=1;i<=n;i++) {
-   	y = y+pointy(i)*L(i,colon());
+}
+
+
+void barycentric_interpolation_ad(adouble* y, adouble& x, adouble* pointx, adouble* pointy, double* w, int npoints)
+{
+//
+//       This function evaluates at x the Lagrange polynomial through (pointx[j],pointy[j]), j=0,...,npoints-1,
+//       using the second barycentric formula (version for automatic differentiation). The weights w
+//       are computed by barycentric_weights() for the points pointx, or for any set of points of which
+//       pointx is an affine image, such as the scaled nodes of a phase. In that case the weights do
+//       not depend on the start and end times of the phase, so they may be treated as constants.
+//
+//       If x coincides with a node, the value is the nodal value, written as a first order expansion
+//       about that node so that the derivatives with respect to x are still taped.
+
+   int j;
+
+   int knode = -1;
+
+   for (j=0;j<npoints;j++) {
+	if (x == pointx[j]) { knode = j; break; }
+   }
+
+   if (knode >= 0) {
+	adouble dp = 0.0;
+	for (j=0;j<npoints;j++) {
+	    if (j != knode) {
+		dp += (w[j]/w[knode])*(pointy[j]-pointy[knode])/(pointx[knode]-pointx[j]);
+	    }
+	}
+	*y = pointy[knode] + (x-pointx[knode])*dp;
+	return;
+   }
+
+   adouble num = 0.0;
+   adouble den = 0.0;
+   adouble c;
+
+   for (j=0;j<npoints;j++) {
+	c    = w[j]/(x-pointx[j]);
+	num += c*pointy[j];
+	den += c;
    }
+
+   *y = num/den;
+
 }
 
 
@@ -79,29 +212,21 @@ void lagrange_interpolation_ad(adouble* y, adouble& x, adouble* pointx, adouble*
 //       lagrange_interpolation(Y, X,POINTX,POINTY) approximates the function defined by the points:
 //       P1=(POINTX(1),POINTY(1)), P2=(POINTX(2),POINTY(2)), ..., PN(POINTX(N),POINTY(N))
 //       and calculate it at point x
+//
+//       The barycentric weights are computed here from the values of pointx; when the points are
+//       the nodes of a phase, it is cheaper to call barycentric_interpolation_ad() with the
+//       weights stored in workspace->bary_weights.
 
+   int j;
 
-   int i,j;
-
-   int n = npoints;
-
-   adouble* L = workspace->L_ad_tmp;
-
-   for(i=0;i<npoints;i++) L[i] = 1.0;
+   double* xval = workspace->bary_weights_tmp;
+   double* w    = xval + npoints;
 
-   for (i=0;i<n;i++) {
-      for (j=0;j<n;j++) {
-           if (i != j) {
-                L[i] = ( L[i]*(  x-pointx[j] )  )/(pointx[i]-pointx[j]);
-           }
-      }
-   }
+   for (j=0;j<npoints;j++) xval[j] = pointx[j].value();
 
-   *y = 0;
+   barycentric_weights(w, xval, npoints);
 
-   for (i=0;i<n;i++) {
-   	*y = (*y)+pointy[i]*L[i];
-   }
+   barycentric_interpolation_ad(y, x, pointx, pointy, w, npoints);
 
 }
 
@@ -141,121 +266,151 @@ void linear_interpolation(adouble* y, adouble& x, adouble* pointx, adouble* poin
 
 }
 
-void linear_interpolation(DMatrix& y, double x, DMatrix& pointx, DMatrix& pointy, int npoints)
+int locate_interval(double x, double* pointx, int npoints, int* cursor)
 {
-//    Linear interpolation from point values
+//   Given the increasing array pointx[i], i = 0,...,npoints-1, this function returns the (unit offset) index j
+//   of the interval [pointx(j), pointx(j+1)] that contains x, with j in 1,...,npoints-1. Values of x outside the
+//   range of pointx are assigned to the first or last interval, for extrapolation.
+//   If cursor is not NULL, the search starts from the interval stored in *cursor, which is updated on exit.
+//   The interval is then found by hunting outwards from the previous result, so that a sequence of sorted
+//   queries is located in a single sweep through pointx. A cursor with value 0 starts a new sequence.
+//
+//   Reference: Press et al (1992) "Numerical Recipes in C", Section 3.4.
 
-   int i,j;
-   bool jdone = false;
+   int jl, ju, jm, inc;
+   int c = (cursor==NULL) ? 0 : *cursor;
 
-   if( x < pointx(1) )
-   {
-      j = 1;
-      jdone = true;
+   if (npoints<3 || x < pointx[0]) {
+      jl = 1;
    }
-
-
-
-  if ( x > pointx(npoints) )
-   {
-      j=npoints-1;
-      jdone = true;
+   else if (x >= pointx[npoints-1]) {
+      jl = npoints-1;
+   }
+   else {
+      // Keep pointx(jl) <= x < pointx(ju)
+      if (c<1 || c>npoints-1) {
+         jl = 1;
+         ju = npoints;
+      }
+      else if (x >= pointx[c-1]) {
+         if (x < pointx[c]) {
+            *cursor = c;
+            return c;
+         }
+         // Hunt upwards
+         jl  = c+1;
+         inc = 1;
+         ju  = jl+inc;
+         while ( ju<npoints && x >= pointx[ju-1] ) {
+            jl   = ju;
+            inc *= 2;
+            ju   = jl+inc;
+         }
+         if (ju>npoints) ju = npoints;
+      }
+      else {
+         // Hunt downwards
+         ju  = c;
+         inc = 1;
+         jl  = ju-inc;
+         while ( jl>1 && x < pointx[jl-1] ) {
+            ju   = jl;
+            inc *= 2;
+            jl   = ju-inc;
+         }
+         if (jl<1) jl = 1;
+      }
+      // Bisection
+      while (ju-jl > 1) {
+         jm = (ju+jl)/2;
+         if (x >= pointx[jm-1]) jl = jm;
+         else                   ju = jm;
+      }
    }
 
-  if (!jdone) {
-     for(i=1;i<npoints;i++) {
-       if( x >= pointx(i) && x <=pointx(i+1) )
-       {
-         j=i;
-         break;
-       }
-     }
-  }
-
-  y = pointy(colon(),j) + (x-pointx(j))*(pointy(colon(),j+1)-pointy(colon(),j))/(pointx(j+1)-pointx(j));
+   if (cursor!=NULL) *cursor = jl;
 
+   return jl;
 }
 
-void linear_interpolation(adouble* y, adouble x, DMatrix& pointx, DMatrix& pointy, int npoints)
+
+void linear_interpolation(DMatrix& y, double x, DMatrix& pointx, DMatrix& pointy, int npoints, int* cursor)
 {
-//    Linear interpolation from point values
+//    Linear interpolation from point values. Each row of pointy is interpolated at x,
+//    and y is returned as a column vector. See locate_interval() for the use of cursor.
 
-   int i,j;
-   bool jdone = false;
+   int i;
+   int ny = pointy.GetNoRows();
+   double* px = pointx.GetPr();
+   double* py = pointy.GetPr();
 
-   if( x.value() < pointx(1) )
-   {
-      j = 1;
-      jdone = true;
-   }
+   int j = locate_interval(x, px, npoints, cursor);
 
+   double s = (x-px[j-1])/(px[j]-px[j-1]);
 
+   double* pyj  = py + (j-1)*ny;
+   double* pyj1 = py + j*ny;
 
-  if ( x.value() > pointx(npoints) )
-   {
-      j=npoints-1;
-      jdone = true;
-   }
+   y.Resize(ny,1);
 
-  if (!jdone) {
-     for(i=1;i<npoints;i++) {
-       if( x.value() >= pointx(i) && x <=pointx(i+1) )
-       {
-         j=i;
-         break;
-       }
-     }
-  }
+   double* yp = y.GetPr();
 
-  *y = pointy(j) + (x-pointx(j))*(pointy(j+1)-pointy(j))/(pointx(j+1)-pointx(j));
+   for(i=0;i<ny;i++) {
+      yp[i] = pyj[i] + s*(pyj1[i]-pyj[i]);
+   }
 
 }
 
+void linear_interpolation(DMatrix& y, double x, DMatrix& pointx, DMatrix& pointy, int npoints)
+{
+//    Linear interpolation from point values
+
+   linear_interpolation(y, x, pointx, pointy, npoints, NULL);
 
-void linear_interpolation(DMatrix& y, DMatrix& x, DMatrix& pointx, DMatrix& pointy, int npoints)
+}
+
+void linear_interpolation(adouble* y, adouble x, DMatrix& pointx, DMatrix& pointy, int npoints)
 {
 //    Linear interpolation from point values
 
-   int i,j=0, k;
-   DMatrix pyj( pointy.GetNoRows(),1);
-   DMatrix pyj1(pointy.GetNoRows(),1);
+   int j = locate_interval(x.value(), pointx.GetPr(), npoints, NULL);
 
-   for(k=1;k<=length(x);k++)  {
+  *y = pointy(j) + (x-pointx(j))*(pointy(j+1)-pointy(j))/(pointx(j+1)-pointx(j));
 
-	bool jdone = false;
+}
 
-	if( x(k) < pointx(1) )
-	{
-	   j = 1;
-	   jdone = true;
-	}
 
+void linear_interpolation(DMatrix& y, DMatrix& x, DMatrix& pointx, DMatrix& pointy, int npoints)
+{
+//    Linear interpolation from point values. Each row of pointy is interpolated at the values in x,
+//    so that on output y has dimensions rows(pointy) x length(x).
+//    The intervals are located with a cursor, so if x is sorted the cost is O(npoints+length(x)).
 
+   int i, k, j;
+   int cursor = 0;
+   int ny = pointy.GetNoRows();
+   int nx = length(x);
+   double* px = pointx.GetPr();
+   double* py = pointy.GetPr();
+   double* xp = x.GetPr();
 
-	if ( x(k) > pointx(npoints) )
-	{
-	    j=npoints-1;
-	    jdone = true;
-	}
+   y.Resize( ny, nx );
 
-	if (!jdone) {
-	   for(i=1;i<npoints;i++) {
-	     if( x(k) >= pointx(i) && x(k) <=pointx(i+1) )
-	     {
-		j=i;
-		break;
-	     }
-	   }
-	}
+   double* yp = y.GetPr();
+
+   for(k=0;k<nx;k++)  {
 
-//        DMatrix temp= pointy(colon(),j) + (x(k)-pointx(j))*(pointy(colon(), j+1)-pointy(colon(),j))/(pointx(j+1)-pointx(j));
+        j = locate_interval(xp[k], px, npoints, &cursor);
 
-        y.Resize( pointy.GetNoRows(), length(x) );
+        double s = (xp[k]-px[j-1])/(px[j]-px[j-1]);
 
-	pyj  = pointy(colon(),j);
-	pyj1 = pointy(colon(),j+1);
+        double* pyj  = py + (j-1)*ny;
+        double* pyj1 = py + j*ny;
+        double* yk   = yp + k*ny;
 
-	y(colon(),k) = pyj + (x(k)-pointx(j))*(pyj1-pyj)/(pointx(j+1)-pointx(j));
+        for(i=0;i<ny;i++) {
+           yk[i] = pyj[i] + s*(pyj1[i]-pyj[i]);
+        }
 
   }
 
@@ -409,6 +564,8 @@ void spline_2d_interpolation(adouble* z, adouble& x, adouble& y, DMatrix& X, DMa
 //    Each element Z(i,j) corresponds to the pair ( X(i), Y(j) )
 //    Method: Cubic spline 2D interpolation
 //    The function does not deal with sparse data.
+//    The splines are rebuilt at every call. When the same table is evaluated repeatedly, for instance
+//    within the DAE, build_interpolation_table() with method "spline" gives the same values at a fraction of the cost.
    int i,j, jx, jy;
    bool jxdone = false;
    bool jydone = false;
@@ -525,9 +682,7 @@ void bilinear_interpolation(adouble* z, adouble& x, adouble& y, DMatrix& X, DMat
 //    The function does not deal with sparse data.
 
 
-   int i,jx, jy;
-   bool jxdone = false;
-   bool jydone = false;
+   int jx, jy;
    int nxpoints = length(X);
    int nypoints = length(Y);
    int nrowsZ   = Z.GetNoRows();
@@ -542,70 +697,351 @@ void bilinear_interpolation(adouble* z, adouble& x, adouble& y, DMatrix& X, DMat
          error_message("Number of columns of matrix Z must be equal to the length of vector Y in call to bilinear_interpolation()");
    }
 
-   if( x.value() < X(1) )
-   {
-      jx = 1;
-      jxdone = true;
+   jx = locate_interval(x.value(), X.GetPr(), nxpoints, NULL);
+
+   jy = locate_interval(y.value(), Y.GetPr(), nypoints, NULL);
+
+  x1  = X(jx);        x2 = X(jx+1);
+  y1  = Y(jy);        y2 = Y(jy+1);
+  z11 = Z(jx,jy);    z12 = Z(jx,jy+1);
+  z21 = Z(jx+1,jy);  z22 = Z(jx+1,jy+1);
+
+  *z = z11*(x2-x)*(y2-y)/((x2-x1)*(y2-y1));
+  *z+= z21*(x-x1)*(y2-y)/((x2-x1)*(y2-y1));
+  *z+= z12*(x2-x)*(y-y1)/((x2-x1)*(y2-y1));
+  *z+= z22*(x-x1)*(y-y1)/((x2-x1)*(y2-y1));
+
+}
+
 
-//      error_message("Extrapolation not allowed in function bilinear_interpolation()");
+static void table_slopes(double* s, double* x, double* y, int n, bool monotone)
+// Given the increasing array x[] and the values y[], i=0,...,n-1, this function returns in s[] the
+// first derivatives at x[i] of either the natural cubic spline through the points (monotone==false)
+// or the shape preserving piecewise cubic Hermite interpolant (monotone==true).
+//
+// References: Burden and Faires (2005) "Numerical Analysis". Thompson.
+//             Fritsch and Carlson (1980) "Monotone piecewise cubic interpolation", SIAM J. Numer. Anal., 17.
+{
+   int i;
+   double h, h0, h1, d0, d1, w1, w2;
+
+   if (n<2) return;
+
+   if (!monotone) {
+      DMatrix Xdata(1,n), Ydata(1,n), D2Y(1,n);
+      for(i=0;i<n;i++) {
+         Xdata(i+1) = x[i];
+         Ydata(i+1) = y[i];
+      }
+      spline_second_derivative(Xdata, Ydata, n, D2Y);
+      double* d2y = D2Y.GetPr();
+      for(i=0;i<n-1;i++) {
+         h = x[i+1]-x[i];
+         s[i] = (y[i+1]-y[i])/h - h*(2.0*d2y[i]+d2y[i+1])/6.0;
+      }
+      h = x[n-1]-x[n-2];
+      s[n-1] = (y[n-1]-y[n-2])/h + h*(d2y[n-2]+2.0*d2y[n-1])/6.0;
+      return;
    }
 
+   if (n==2) {
+      s[0] = s[1] = (y[1]-y[0])/(x[1]-x[0]);
+      return;
+   }
 
-  if ( x.value() > X(nxpoints) )
-   {
-      jx=nxpoints-1;
-      jxdone = true;
+   // Interior points: weighted harmonic mean of the adjacent secants, or zero at local extrema
+   for(i=1;i<n-1;i++) {
+      h0 = x[i]-x[i-1];
+      h1 = x[i+1]-x[i];
+      d0 = (y[i]-y[i-1])/h0;
+      d1 = (y[i+1]-y[i])/h1;
+      if ( d0*d1 <= 0.0 ) {
+         s[i] = 0.0;
+      }
+      else {
+         w1 = 2.0*h1+h0;
+         w2 = h1+2.0*h0;
+         s[i] = (w1+w2)/(w1/d0+w2/d1);
+      }
+   }
+
+   // End points: non-centred three point formula, limited to preserve the shape of the data
+   for(i=0;i<2;i++) {
+      int k  = (i==0) ? 0 : n-1;
+      int k1 = (i==0) ? 1 : n-2;
+      int k2 = (i==0) ? 2 : n-3;
+      h0 = fabs(x[k1]-x[k]);
+      h1 = fabs(x[k2]-x[k1]);
+      d0 = (y[k1]-y[k])/(x[k1]-x[k]);
+      d1 = (y[k2]-y[k1])/(x[k2]-x[k1]);
+      double sk = ((2.0*h0+h1)*d0 - h0*d1)/(h0+h1);
+      if ( sk*d0 <= 0.0 ) {
+         sk = 0.0;
+      }
+      else if ( d0*d1 <= 0.0 && fabs(sk) > fabs(3.0*d0) ) {
+         sk = 3.0*d0;
+      }
+      s[k] = sk;
+   }
+}
 
-//      error_message("Extrapolation not allowed in function bilinear_interpolation()");
 
+void build_interpolation_table(InterpolationTable& table, int ndim, DMatrix* grids, DMatrix& values, const string& method)
+{
+//    Precomputes an interpolant of a function tabulated on a rectangular grid, so that it can be evaluated
+//    many times by table_interpolation() at a cost that does not depend on the size of the table.
+//    Inputs:
+//    ndim is the number of independent variables, between 1 and MAX_TABLE_DIMENSIONS.
+//    grids is an array of ndim vectors with the strictly increasing grid points along each dimension.
+//    values contains the tabulated function with the first dimension varying fastest, so that for ndim==2
+//    values is a matrix of dimensions length(grids[0]) x length(grids[1]).
+//    method is one of:
+//      "spline":   tensor product natural cubic spline, identical to spline_2d_interpolation() for ndim==2.
+//      "monotone": tensor product shape preserving cubic Hermite interpolation, which does not overshoot the data.
+//      "linear":   multilinear interpolation, identical to bilinear_interpolation() for ndim==2.
+//    The cubic methods store the values and all the mixed partial derivatives of the interpolant at each grid
+//    point, so that each evaluation only involves the 2^ndim corners of one grid cell. The cell is found in O(1)
+//    operations along uniformly spaced dimensions, and by bisection otherwise. Queries outside the grid are
+//    extrapolated with the polynomial of the nearest cell.
+   int d, i, m, k, line, node;
+   int stride[MAX_TABLE_DIMENSIONS];
+   int ntotal = 1;
+
+   if ( ndim < 1 || ndim > MAX_TABLE_DIMENSIONS ) {
+       error_message("Invalid number of dimensions in call to build_interpolation_table()");
    }
 
-  if (!jxdone) {
-     for(i=1;i<nxpoints;i++) {
-       if( x.value() >= X(i) && x <=X(i+1) )
-       {
-         jx=i;
-         break;
+   if ( method != "spline" && method != "monotone" && method != "linear" ) {
+       error_message("Invalid method in call to build_interpolation_table(). Use \"spline\", \"monotone\" or \"linear\"");
+   }
+
+   table.ndim   = ndim;
+   table.cubic  = (method != "linear");
+   table.nderiv = table.cubic ? (1<<ndim) : 1;
+
+   for(d=0;d<ndim;d++) {
+       int n = length(grids[d]);
+       if ( n < 2 ) {
+           error_message("Each grid vector must have at least two points in call to build_interpolation_table()");
        }
-     }
-  }
+       table.npoints[d] = n;
+       table.grid[d]    = grids[d];
+       table.grid[d].Resize(1,n);
+       double* g = table.grid[d].GetPr();
+       double h  = (g[n-1]-g[0])/(n-1);
+       table.spacing[d] = h;
+       for(i=1;i<n;i++) {
+           if ( g[i] <= g[i-1] ) {
+               error_message("Grid vectors must be strictly increasing in call to build_interpolation_table()");
+           }
+           if ( fabs( (g[i]-g[i-1]) - h ) > 1.e-12*fabs(g[n-1]-g[0]) ) {
+               table.spacing[d] = 0.0;
+           }
+       }
+       stride[d] = ntotal;
+       ntotal   *= n;
+   }
 
-  if( y.value() < Y(1) )
-   {
-      jy = 1;
-      jydone = true;
-//      error_message("Extrapolation not allowed in function bilinear_interpolation()");
+   if ( values.GetNoRows()*values.GetNoCols() != ntotal ) {
+       error_message("The number of tabulated values does not match the grid dimensions in call to build_interpolation_table()");
    }
 
+   table.coeffs.Resize(table.nderiv, ntotal);
 
+   double* c = table.coeffs.GetPr();
+   double* v = values.GetPr();
 
-  if ( x.value() > Y(nypoints) )
-   {
-      jy=nypoints-1;
-      jydone = true;
-//      error_message("Extrapolation not allowed in function bilinear_interpolation()");
+   for(node=0;node<ntotal;node++) {
+       c[node*table.nderiv] = v[node];
    }
 
-  if (!jydone) {
-     for(i=1;i<nypoints;i++) {
-       if( y.value() >= Y(i) && y <=Y(i+1) )
-       {
-         jy=i;
-         break;
+   // The partial derivative with respect to the variables in the bit mask m is obtained by
+   // differentiating the interpolant of a lower order derivative along each grid line.
+   int nmax = 0;
+   for(d=0;d<ndim;d++) nmax = MAX(nmax, table.npoints[d]);
+
+   DMatrix Line(1,nmax), Slope(1,nmax);
+   double* yl = Line.GetPr();
+   double* sl = Slope.GetPr();
+
+   for(m=1;m<table.nderiv;m++) {
+       for(d=0;!(m & (1<<d));d++);
+       int src = m & ~(1<<d);
+       int n   = table.npoints[d];
+       for(line=0;line<ntotal;line++) {
+           if ( (line/stride[d]) % n != 0 ) continue;
+           for(k=0;k<n;k++) yl[k] = c[(line+k*stride[d])*table.nderiv + src];
+           table_slopes(sl, table.grid[d].GetPr(), yl, n, method=="monotone");
+           for(k=0;k<n;k++) c[(line+k*stride[d])*table.nderiv + m] = sl[k];
        }
-     }
-  }
+   }
+}
 
-  x1  = X(jx);        x2 = X(jx+1);
-  y1  = Y(jy);        y2 = Y(jy+1);
-  z11 = Z(jx,jy);    z12 = Z(jx,jy+1);
-  z21 = Z(jx+1,jy);  z22 = Z(jx+1,jy+1);
+void build_interpolation_table(InterpolationTable& table, DMatrix& X, DMatrix& Z, const string& method)
+{
+//    One dimensional version of build_interpolation_table(): Z(i) corresponds to X(i).
+   build_interpolation_table(table, 1, &X, Z, method);
+}
 
-  *z = z11*(x2-x)*(y2-y)/((x2-x1)*(y2-y1));
-  *z+= z21*(x-x1)*(y2-y)/((x2-x1)*(y2-y1));
-  *z+= z12*(x2-x)*(y-y1)/((x2-x1)*(y2-y1));
-  *z+= z22*(x-x1)*(y-y1)/((x2-x1)*(y2-y1));
+void build_interpolation_table(InterpolationTable& table, DMatrix& X, DMatrix& Y, DMatrix& Z, const string& method)
+{
+//    Two dimensional version of build_interpolation_table(): Z is a matrix of dimensions
+//    length(X) x length(Y) and each element Z(i,j) corresponds to the pair ( X(i), Y(j) ).
+   DMatrix grids[2];
+
+   grids[0] = X;
+   grids[1] = Y;
+
+   if ( Z.GetNoRows() != length(X) ) {
+       error_message("Number of rows of matrix Z must be equal to the length of vector X in call to build_interpolation_table()");
+   }
+   if ( Z.GetNoCols() != length(Y) )  {
+       error_message("Number of columns of matrix Z must be equal to the length of vector Y in call to build_interpolation_table()");
+   }
+
+   build_interpolation_table(table, 2, grids, Z, method);
+}
+
+static int table_cell(InterpolationTable& table, int d, double x)
+{
+//    Returns the (unit offset) index j of the grid cell [grid(j), grid(j+1)] along dimension d that
+//    contains x, or the nearest cell if x is out of range.
+   int n = table.npoints[d];
+   double* g = table.grid[d].GetPr();
+
+   if ( table.spacing[d] > 0.0 ) {
+       double q = floor( (x-g[0])/table.spacing[d] );
+       if ( !(q >= 0.0) )  return 1;
+       if ( q > n-2 )      return n-1;
+       return (int) q + 1;
+   }
+
+   return locate_interval(x, g, n, NULL);
+}
+
+template <class T, int NDIM>
+static T evaluate_interpolation_table_nd(T* x, double* xval, InterpolationTable& table)
+{
+//    Evaluates the interpolant stored in table, which has NDIM dimensions, at x. xval holds the values
+//    of x as doubles, which are used to locate the grid cell. The Hermite basis functions along each
+//    dimension are computed first, and the 4^ndim (2^ndim for multilinear tables) coefficients of the
+//    cell are then contracted one dimension at a time, which keeps the number of active operations
+//    small when T is adouble. The arrays of T are sized for NDIM, as each adouble takes a tape location.
+   int d, k, r, q;
+   int ndim   = NDIM;
+   int ns     = table.cubic ? 4 : 2;
+   int nc     = ns/2;
+   int base   = 0;
+   int ncell  = 1;
+   int stride[NDIM];
+   T   basis[NDIM][4];
+   double c[1<<(2*NDIM)];
+
+   for(d=0;d<ndim;d++) {
+       stride[d] = (d==0) ? 1 : stride[d-1]*table.npoints[d-1];
+       int j     = table_cell(table, d, xval[d]);
+       double* g = table.grid[d].GetPr();
+       double h  = g[j]-g[j-1];
+       T t       = (x[d]-g[j-1])/h;
+       if (table.cubic) {
+           T t2 = t*t;
+           T t3 = t2*t;
+           basis[d][0] = 2.0*t3-3.0*t2+1.0;
+           basis[d][1] = (t3-2.0*t2+t)*h;
+           basis[d][2] = 3.0*t2-2.0*t3;
+           basis[d][3] = (t3-t2)*h;
+       }
+       else {
+           basis[d][0] = 1.0-t;
+           basis[d][1] = t;
+       }
+       base  += (j-1)*stride[d];
+       ncell *= ns;
+   }
+
+   // Gather the coefficients of the cell. Along each dimension, entry k refers to corner k/nc
+   // and, for cubic tables, to the value (k even) or the derivative (k odd) at that corner.
+   double* coeffs = table.coeffs.GetPr();
+   for(r=0;r<ncell;r++) {
+       int node = base;
+       int mask = 0;
+       for(d=0, q=r; d<ndim; d++, q/=ns) {
+           k = q % ns;
+           node += (k/nc)*stride[d];
+           if ( table.cubic && (k%2) ) mask |= (1<<d);
+       }
+       c[r] = coeffs[node*table.nderiv + mask];
+   }
+
+   // Contract the last dimension with the double coefficients, and then the remaining ones
+   int n = ncell/ns;
+   T w[1<<(2*(NDIM-1))];
+
+   d = ndim-1;
+   for(r=0;r<n;r++) {
+       w[r] = c[r]*basis[d][0];
+       for(k=1;k<ns;k++) w[r] += c[r+k*n]*basis[d][k];
+   }
+   for(d=ndim-2;d>=0;d--) {
+       n /= ns;
+       for(r=0;r<n;r++) {
+           w[r] *= basis[d][0];
+           for(k=1;k<ns;k++) w[r] += w[r+k*n]*basis[d][k];
+       }
+   }
+
+   return w[0];
+}
 
+template <class T>
+static T evaluate_interpolation_table(T* x, double* xval, InterpolationTable& table)
+{
+//    Evaluates the interpolant stored in table at x, see evaluate_interpolation_table_nd().
+   switch (table.ndim) {
+       case 1:  return evaluate_interpolation_table_nd<T,1>(x, xval, table);
+       case 2:  return evaluate_interpolation_table_nd<T,2>(x, xval, table);
+       case 3:  return evaluate_interpolation_table_nd<T,3>(x, xval, table);
+       default: return evaluate_interpolation_table_nd<T,MAX_TABLE_DIMENSIONS>(x, xval, table);
+   }
+}
+
+double table_interpolation(double* x, InterpolationTable& table)
+{
+//    Evaluates a table built by build_interpolation_table() at the point x[0],...,x[ndim-1].
+   return evaluate_interpolation_table<double>(x, x, table);
+}
+
+void table_interpolation(adouble* z, adouble* x, InterpolationTable& table)
+{
+//    Evaluates a table built by build_interpolation_table() at the point x[0],...,x[ndim-1] (version for automatic differentiation).
+   double xval[MAX_TABLE_DIMENSIONS];
+   int d;
+
+   for(d=0;d<table.ndim;d++) xval[d] = x[d].value();
+
+   *z = evaluate_interpolation_table<adouble>(x, xval, table);
+}
+
+void table_interpolation(adouble* z, adouble& x, InterpolationTable& table)
+{
+//    One dimensional version of table_interpolation().
+   if ( table.ndim != 1 ) error_message("The table is not one dimensional in call to table_interpolation()");
+
+   table_interpolation(z, &x, table);
+}
+
+void table_interpolation(adouble* z, adouble& x, adouble& y, InterpolationTable& table)
+{
+//    Two dimensional version of table_interpolation(), where x and y are the values of the variables
+//    associated with the rows and the columns of the table, respectively.
+   adouble xy[2];
+
+   if ( table.ndim != 2 ) error_message("The table is not two dimensional in call to table_interpolation()");
+
+   xy[0] = x;
+   xy[1] = y;
+
+   table_interpolation(z, xy, table);
 }
 
 
@@ -785,23 +1221,19 @@ void spline_interpolation(DMatrix& Y, DMatrix& X, DMatrix& Xdata, DMatrix& Ydata
 
    double *xdata = Xdata.GetPr();
    double *ydata = Ydata.GetPr();
-   int kleft,kright,k;
+   int kleft,kright;
    double h,A,B,C,D;
    DMatrix D2Y(1,n);
    double* d2y = D2Y.GetPr();
    int i;
+   int cursor = 0;
 
    spline_second_derivative(Xdata, Ydata, n, D2Y );
 
 
    for(i=1;i<= length(X); i++) {
-      kleft=1;
-      kright=n;
-      while (kright-kleft > 1) {
-	  k=(int) ( (kright+kleft)/2 );
-	  if (xdata[k-1] > X(i)) kright=k;
-	  else kleft=k;
-      }
+      kleft  = locate_interval(X(i), xdata, n, &cursor);
+      kright = kleft+1;
       h=xdata[kright-1]-xdata[kleft-1];
       if (h == 0.0) error_message("Bad xdata input to routine spline_interpolation()");
       A=(xdata[kright-1]-X(i))/h;
@@ -819,21 +1251,20 @@ void spline_interpolation(DMatrix& Y, DMatrix& X, DMatrix& Xdata, DMatrix& Ydata
 
 
 
-void spline_interpolation_with_second_derivative(adouble* y, adouble& x, adouble* xdata, adouble* ydata, adouble* y2d, int n, Workspace* workspace)
+void spline_interpolation_with_second_derivative(adouble* y, adouble& x, adouble* xdata, adouble* ydata, adouble* y2d, int n)
 //   Given the arrays xdata[i] and ydata[i], i = 0,...n-1, which tabulate a function, with xdata[i] < xdata[i+1],
-//   and given the array d2y[i], which is the output from function spline_second_derivative(),
-//   and given a value of x, this function returns the interpolated value y using (natural) cubic-spline interpolation
+//   and given the array y2d[i], which is the output from function spline_second_derivative(),
+//   and given a value of x, this function returns the interpolated value y using (natural) cubic-spline interpolation.
+//   Unlike spline_interpolation(), the second derivatives are not recomputed, so that they can be reused
+//   for many values of x.
 //
 //   Reference: Burden and Faires (2005) "Numerical Analysis". Thompson.
 {
 
    int kleft,kright,k;
    adouble h,A,B,C,D;
-   adouble *d2y = workspace->y2a_spline;
    kleft=1;
 
-   spline_second_derivative(xdata, ydata, n, d2y, workspace );
-
    kright=n;
    while (kright-kleft > 1) {
       k=(int) ( (kright+kleft)/2 );
@@ -841,13 +1272,13 @@ void spline_interpolation_with_second_derivative(adouble* y, adouble& x, adouble
       else kleft=k;
    }
    h=xdata[kright-1]-xdata[kleft-1];
-   if (h == 0.0) error_message("Bad xdata input to routine spline_interpolation()");
+   if (h == 0.0) error_message("Bad xdata input to routine spline_interpolation_with_second_derivative()");
    A=(xdata[kright-1]-x)/h;
    B=(x-xdata[kleft-1])/h;
    C=(pow(A,3)-A)*(h*h)/6.0;
    D=(pow(B,3)-B)*(h*h)/6.0;
    // Evaluate the cubic spline polynomial
-   *y=A*ydata[kleft-1]+B*ydata[kright-1]+C*d2y[kleft-1]+D*d2y[kright-1];
+   *y=A*ydata[kleft-1]+B*ydata[kright-1]+C*y2d[kleft-1]+D*y2d[kright-1];
 }
 
 
@@ -860,7 +1291,9 @@ void resample_trajectory(DMatrix& Y,  DMatrix& X, DMatrix& Ydata, DMatrix& Xdata
 //   X has dimension 1 x M
 //   On output, Y has dimensions ny x M
 //   Xdata and X should be monotonically increasing vectors.
-    int i;
+//   The spline second derivatives of all rows are computed once, and the intervals are located in a
+//   single sweep through Xdata, so that the cost is O(ny*(N+M)).
+    int i, k, j;
 
     int ny = Ydata.GetNoRows();
 
@@ -868,20 +1301,47 @@ void resample_trajectory(DMatrix& Y,  DMatrix& X, DMatrix& Ydata, DMatrix& Xdata
 
     int n = length(Xdata);
 
-    DMatrix Yi, Yidata;
+    int cursor = 0;
+
+    DMatrix Yidata, D2Yi, D2Y;
 
     if ( (X(1) < Xdata(1)) || X("end") > Xdata("end") ) {
          error_message("No extrapolation is allowed in function resample_trajectory()");
     }
 
     Y.Resize(ny,lx);
-    Yi.Resize(1,lx);
     Yidata.Resize(1,n);
+    D2Yi.Resize(1,n);
+    D2Y.Resize(ny,n);
 
     for(i=1;i<=ny;i++) {
         Yidata = Ydata(i,colon());
-      	spline_interpolation( Yi, X, Xdata, Yidata, n);
-        Y(i,colon()) = Yi;
+        spline_second_derivative(Xdata, Yidata, n, D2Yi);
+        D2Y(i,colon()) = D2Yi;
+    }
+
+    double* xdata = Xdata.GetPr();
+    double* x     = X.GetPr();
+    double* ydata = Ydata.GetPr();
+    double* d2y   = D2Y.GetPr();
+    double* y     = Y.GetPr();
+
+    for(k=0;k<lx;k++) {
+        j = locate_interval(x[k], xdata, n, &cursor);
+        double h = xdata[j]-xdata[j-1];
+        if (h == 0.0) error_message("Bad xdata input to routine resample_trajectory()");
+        double A = (xdata[j]-x[k])/h;
+        double B = (x[k]-xdata[j-1])/h;
+        double C = (A*A*A-A)*(h*h)/6.0;
+        double D = (B*B*B-B)*(h*h)/6.0;
+        double* yl  = ydata + (j-1)*ny;
+        double* yr  = ydata + j*ny;
+        double* d2l = d2y + (j-1)*ny;
+        double* d2r = d2y + j*ny;
+        double* yk  = y + k*ny;
+        for(i=0;i<ny;i++) {
+            yk[i] = A*yl[i]+B*yr[i]+C*d2l[i]+D*d2r[i];
+        }
     }
 }
 
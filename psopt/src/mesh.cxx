@@ -194,35 +194,48 @@ void estimate_order_reduction(Prob& problem,Alg& algorithm,Sol& solution, Worksp
   int r;
   int j;
   int I;
+  int M;
 
 
   if (workspace->differential_defects=="trapezoidal")
     p=2;
   else if (workspace->differential_defects=="Hermite-Simpson")
     p=4;
+  else if (workspace->differential_defects=="Lobatto-IIIA")
+    p=6;
 
   for(iphase=1;iphase<=nphases;iphase++) {
 
       DMatrix& order_reduction = workspace->order_reduction[iphase-1];
 
-      DMatrix& epsilon = solution.relative_errors[iphase-1];
+      DMatrix epsilon     = solution.relative_errors[iphase-1];
+
+      DMatrix old_epsilon = workspace->old_relative_errors[iphase-1];
 
-      DMatrix& old_epsilon = workspace->old_relative_errors[iphase-1];
+      DMatrix snodes      = workspace->snodes[iphase-1];
 
-      DMatrix& snodes = workspace->snodes[iphase-1];
+      DMatrix old_snodes  = workspace->old_snodes[iphase-1];
 
-      DMatrix& old_snodes = workspace->old_snodes[iphase-1];
+      if (use_lobatto_collocation(algorithm)) {
+          // The Lobatto IIIA mesh is refined by groups of three intervals
+          lobatto_group_view(workspace->snodes[iphase-1], solution.relative_errors[iphase-1], snodes, epsilon);
+          lobatto_group_view(workspace->old_snodes[iphase-1], workspace->old_relative_errors[iphase-1], old_snodes, old_epsilon);
+      }
+
+      M = length(snodes)-1;
 
       j = 1;
 
       int I = 1;
 
-      for (k=1;k<= problem.phase[iphase-1].current_number_of_intervals;k++) {
+      for (k=1;k<= M;k++) {
 
 	    eta   = epsilon(k);
 
 	    if ( snodes(k) > old_snodes(j) ) {
-	       j++; I=1;
+	       // more than one old node may be passed when the mesh was coarsened
+	       while ( j < length(old_epsilon) && snodes(k) > old_snodes(j) ) j++;
+	       I=1;
 	    }
 	    else {
 	       I++;
@@ -292,15 +305,26 @@ void construct_new_mesh(Prob& problem,Alg& algorithm,Sol& solution, Workspace* w
     p=2.0;
   else if (workspace->differential_defects=="Hermite-Simpson")
     p=4.0;
+  else if (workspace->differential_defects=="Lobatto-IIIA")
+    p=6.0;
 
   for(iphase=1;iphase<=nphases;iphase++) {
         Icount = 0;
-	M = problem.phase[iphase-1].current_number_of_intervals;
+        DMatrix& snodes = workspace->snodes[iphase-1];
+        DMatrix  mesh;
+        if (use_lobatto_collocation(algorithm)) {
+            // Points are added between the group boundaries of the Lobatto IIIA mesh
+            lobatto_group_view(snodes, solution.relative_errors[iphase-1], mesh, epsilon);
+        }
+        else {
+            mesh    = snodes;
+            epsilon = solution.relative_errors[iphase-1];
+        }
+	M = length(mesh)-1;
 	Mdash =  MIN( M1, kappa*M)+1;
 	I.Resize(1,M);
 	I.FillWithZeros();
 	terminate_flag = false;
-        epsilon = solution.relative_errors[iphase-1];
         DMatrix& r       = workspace->order_reduction[iphase-1];
 //	r.Print("order reduction");
 	while (!terminate_flag) {
@@ -326,27 +350,71 @@ void construct_new_mesh(Prob& problem,Alg& algorithm,Sol& solution, Workspace* w
 	      }
 	}
 
+	// Coarsening: the node between two adjacent intervals that receive no new points is
+	// removed when the error predicted for the merged interval, from the same order
+	// reduction estimate, is below mr_coarsening_factor*ode_tolerance. As this factor is
+	// well below the refinement threshold, merged intervals are not split again at the
+	// next iteration.
+
+	DMatrix remove = zeros(1,M+1);
+	int     nremoved = 0;
+
+	if ( algorithm.mr_coarsening_factor > 0.0 ) {
+	    i = 1;
+	    while ( i < M && (M-nremoved) > 2 ) {
+	        if ( I(i)==0 && I(i+1)==0 ) {
+	            double h1 = mesh(i+1)-mesh(i);
+	            double h2 = mesh(i+2)-mesh(i+1);
+	            double e1 = epsilon(i)*pow( (h1+h2)/h1, p-r(i)+1.0 );
+	            double e2 = epsilon(i+1)*pow( (h1+h2)/h2, p-r(i+1)+1.0 );
+	            if ( MAX(e1,e2) <= algorithm.mr_coarsening_factor*algorithm.ode_tolerance ) {
+	                remove(i+1) = 1;
+	                nremoved++;
+	                i += 2;
+	                continue;
+	            }
+	        }
+	        i++;
+	    }
+	}
+
 	// Now construct the new snodes array and sort it
 
 //	I.Print(">>> Added nodes per interval");
 
-	DMatrix& snodes = workspace->snodes[iphase-1];
+	DMatrix old_mesh = mesh;
+
+	mesh.Resize(1, M+1+ (int) sum(tra(I)).elem(1,1) - nremoved );
+
+	int nnew = 1;
 
+	mesh(nnew) = old_mesh(1);
 
 	for(i=1;i<= M; i++) {
 	    int Ii = (int) I(i);
-	    if ( Ii> 0 ) {
-	         double delta = snodes(i+1)-snodes(i);
-	         for(l=1;l<=Ii;l++) {
-		     snodes = (snodes || (snodes(i) + (l)*delta/(Ii+1))*ones(1,1) ) ;
-		 }
+	    double delta = old_mesh(i+1)-old_mesh(i);
+	    for(l=1;l<=Ii;l++) {
+		mesh(++nnew) = old_mesh(i) + (l)*delta/(Ii+1);
 	    }
+	    if ( remove(i+1)==0 ) {
+		mesh(++nnew) = old_mesh(i+1);
+	    }
+	}
+
+	sort(mesh);
 
+	if (use_lobatto_collocation(algorithm)) {
+	    lobatto_iiia_nodes(mesh, snodes);
+	}
+	else {
+	    snodes = mesh;
 	}
 
-	sort(snodes);
         problem.phase[iphase-1].current_number_of_intervals = length(snodes)-1;
 	fprintf(stderr,"\n >>> Local mesh refinement added %i new nodes in phase %i", (int) sum(tra(I)).elem(1,1), iphase );
+	if ( nremoved > 0 ) {
+	    fprintf(stderr,"\n >>> Local mesh coarsening removed %i nodes in phase %i", nremoved, iphase );
+	}
 
 
   }
@@ -356,3 +424,386 @@ void construct_new_mesh(Prob& problem,Alg& algorithm,Sol& solution, Workspace* w
 }
 
 
+
+
+double legendre_coefficient_decay_rate(DMatrix& u, int first, int p)
+{
+  // Exponential decay rate sigma, |a_j| ~ exp(-sigma*j), of the Legendre
+  // coefficients of the degree p polynomial through u(first) .. u(first+p),
+  // which are values at the LGL nodes of a segment. The rate is fitted by least
+  // squares over j=1..p. A smooth solution gives a large rate, while a corner or
+  // a jump inside the segment gives slowly decaying coefficients.
+  //
+  // Reference: Liu, Hager and Rao, "Adaptive mesh refinement method for optimal
+  // control using nonsmoothness detection and mesh size reduction", Journal of
+  // the Franklin Institute, 2015.
+  //
+  int r, j;
+  double sigma;
+
+  if (p < 2) return 1.e10;
+
+  DMatrix xs, PN;
+
+  lgl_nodes_golub_welsch(p, xs, PN);
+
+  double* a = new double[p+1];
+
+  for (j=0; j<=p; j++) a[j] = 0.0;
+
+  // Discrete Legendre transform with the LGL quadrature (xs is in descending order)
+  for (r=0; r<=p; r++) {
+      long   kr = p+1-r;
+      double xk = xs(kr);
+      double wk = 2.0/(p*(p+1)*PN(kr)*PN(kr));
+      double uk = u(first+r);
+      double p0 = 1.0, p1 = xk, p2;
+      a[0] += wk*uk*p0;
+      a[1] += wk*uk*p1;
+      for (j=2; j<=p; j++) {
+          p2 = ( (2*j-1)*xk*p1 - (j-1)*p0 )/j;
+          a[j] += wk*uk*p2;
+          p0 = p1;
+          p1 = p2;
+      }
+  }
+
+  for (j=0; j<p; j++) a[j] *= (2.0*j+1.0)/2.0;
+
+  a[p] *= p/2.0;
+
+  double amax = 0.0;
+
+  for (j=1; j<=p; j++) amax = MAX( amax, fabs(a[j]) );
+
+  if ( amax <= 1.e-12*( fabs(a[0]) + 1.0 ) ) {
+      // Constant over the segment
+      delete [] a;
+      return 1.e10;
+  }
+
+  // Fit the monotone envelope max_(i>=j) |a_i|, so that coefficients which
+  // vanish by symmetry do not hide the decay
+  for (j=p-1; j>=1; j--) a[j] = MAX( fabs(a[j]), fabs(a[j+1]) );
+
+  double jm = 0.0, ym = 0.0, sxy = 0.0, sxx = 0.0;
+
+  for (j=1; j<=p; j++) {
+      jm += j;
+      ym += log( fabs(a[j]) + 1.e-14*amax );
+  }
+  jm /= p;
+  ym /= p;
+
+  for (j=1; j<=p; j++) {
+      double y = log( fabs(a[j]) + 1.e-14*amax );
+      sxy += (j-jm)*(y-ym);
+      sxx += (j-jm)*(j-jm);
+  }
+
+  sigma = -sxy/sxx;
+
+  delete [] a;
+
+  return sigma;
+}
+
+
+void hp_refine_mesh(Prob& problem,Alg& algorithm,Sol& solution, Workspace* workspace)
+{
+  // hp-adaptive mesh refinement for "Legendre-hp" collocation. Each segment
+  // whose maximum relative ODE error e exceeds ode_tolerance is given the degree
+  // p + ceil( log(e/ode_tolerance)/log(p) ). When the Legendre coefficients of
+  // the states and controls in the segment decay quickly and the new degree
+  // does not exceed hp_max_degree, the degree of the segment is raised.
+  // Otherwise the segment is split into equal sub-segments of degree
+  // hp_segment_degree, which concentrates short segments around corners and
+  // switching times. Segments that already meet the tolerance are kept.
+  //
+  // Reference: Patterson, Hager and Rao, "A ph mesh refinement method for
+  // optimal control", Optimal Control Applications and Methods, 2015.
+  //
+  const double smooth_decay_rate = 1.0;
+
+  int nphases = problem.nphases;
+  int iphase, s, j, l;
+  int pmin = algorithm.hp_segment_degree;
+  int pmax = algorithm.hp_max_degree;
+  char msg[200];
+
+  for(iphase=1;iphase<=nphases;iphase++) {
+
+	DMatrix& breaks   = workspace->hp_breaks[iphase-1];
+	DMatrix& degrees  = workspace->hp_degrees[iphase-1];
+	DMatrix& epsilon  = solution.relative_errors[iphase-1];
+	DMatrix& states   = solution.get_states_in_phase(iphase);
+	DMatrix& controls = solution.get_controls_in_phase(iphase);
+
+	int nstates   = problem.phase[iphase-1].nstates;
+	int ncontrols = problem.phase[iphase-1].ncontrols;
+	int nseg      = length(degrees);
+	int nseg_new  = 0;
+	int nraised   = 0;
+	int nsplits   = 0;
+	int first     = 1;
+	int norder    = 0;
+
+	DMatrix new_degree(nseg,1);
+	DMatrix nsplit(nseg,1);
+	DMatrix u;
+
+	for(s=1;s<=nseg;s++) {
+
+	      int    p  = (int) degrees(s);
+	      double es = 0.0;
+
+	      for(l=first;l<first+p;l++) {
+		   es = MAX( es, epsilon(l) );
+	      }
+
+	      new_degree(s) = p;
+	      nsplit(s)     = 1;
+
+	      if ( es > algorithm.ode_tolerance ) {
+
+		   int pnew = p + MAX( 1, (int) ceil( log(es/algorithm.ode_tolerance)/log( (double) MAX(p,2) ) ) );
+
+		   double sigma = 1.e10;
+
+		   for(j=1;j<=nstates;j++) {
+			u = states(j,colon());
+			sigma = MIN( sigma, legendre_coefficient_decay_rate(u, first, p) );
+		   }
+
+		   for(j=1;j<=ncontrols;j++) {
+			u = controls(j,colon());
+			sigma = MIN( sigma, legendre_coefficient_decay_rate(u, first, p) );
+		   }
+
+		   if ( sigma >= smooth_decay_rate && pnew <= pmax ) {
+			new_degree(s) = pnew;
+			nraised++;
+		   }
+		   else {
+			nsplit(s)     = MAX( 2, (int) ceil( ((double) pnew)/pmin ) );
+			new_degree(s) = pmin;
+			nsplits++;
+		   }
+	      }
+
+	      nseg_new += (int) nsplit(s);
+	      first    += p;
+	}
+
+	// Construct the new segment layout
+
+	DMatrix new_breaks(nseg_new+1,1);
+	DMatrix new_degrees(nseg_new,1);
+
+	new_breaks(1) = breaks(1);
+
+	l = 1;
+
+	for(s=1;s<=nseg;s++) {
+	      int    ns = (int) nsplit(s);
+	      double h  = ( breaks(s+1)-breaks(s) )/ns;
+	      for(j=1;j<=ns;j++) {
+		   new_degrees(l)  = new_degree(s);
+		   new_breaks(l+1) = (j<ns)? breaks(s)+j*h : breaks(s+1);
+		   norder += (int) new_degree(s);
+		   l++;
+	      }
+	}
+
+	breaks  = new_breaks;
+	degrees = new_degrees;
+
+	problem.phase[iphase-1].current_number_of_intervals = norder;
+
+	sprintf(msg, "\n>>> hp mesh refinement in phase %i: %i segments raised in degree, %i segments split, %i segments in total", iphase, nraised, nsplits, nseg_new );
+	psopt_print(workspace,msg);
+
+  }
+
+}
+
+
+void set_nlp_tolerance_schedule(Prob& problem, Alg& algorithm, Sol& solution, int iter_nodes, int number_of_mesh_refinement_iterations, Workspace* workspace)
+{
+  // Chooses the NLP tolerance and iteration limit for the current mesh refinement
+  // iteration. The NLP solutions on early meshes are only used to start the next
+  // iteration, so with the "adaptive" schedule they are solved to a tolerance tied
+  // to the discretisation error of the previous mesh,
+  //
+  //     tol = max( nlp_tolerance, min( 0.1*tol_prev, mr_nlp_tolerance_factor*emax ) ),
+  //
+  // starting from sqrt(nlp_tolerance) on the first mesh. The last iteration, and the
+  // repeated solve on a mesh that met the ODE tolerance with a loose NLP tolerance,
+  // use the full nlp_tolerance and nlp_iter_max.
+
+  int i;
+  int iter = iter_nodes-1;
+
+  double tol    = algorithm.nlp_tolerance;
+  int    itmax  = algorithm.nlp_iter_max;
+
+  bool loose = ( algorithm.nlp_tolerance_schedule == "adaptive" && algorithm.mesh_refinement == "automatic"
+                 && iter_nodes < number_of_mesh_refinement_iterations && !workspace->polish_mesh );
+
+  if ( loose ) {
+      if ( iter_nodes == 1 ) {
+          tol = sqrt( algorithm.nlp_tolerance );
+      }
+      else {
+          double emax = 0.0;
+          for (i=0; i<problem.nphases; i++) {
+              emax = MAX( emax, (workspace->emax_history[i])(iter_nodes-1,2) );
+          }
+          tol = MIN( 0.1*solution.mesh_stats[iter-1].nlp_tolerance, algorithm.mr_nlp_tolerance_factor*emax );
+      }
+      tol   = MAX( tol, algorithm.nlp_tolerance );
+      if ( tol > algorithm.nlp_tolerance ) {
+          itmax = MIN( algorithm.mr_nlp_iter_max, algorithm.nlp_iter_max );
+      }
+  }
+
+  workspace->nlp_tolerance = tol;
+  workspace->nlp_iter_max  = itmax;
+
+  solution.mesh_stats[iter].nlp_tolerance = tol;
+  solution.mesh_stats[iter].nlp_iter_max  = itmax;
+
+}
+
+
+void set_hessian_schedule(Prob& problem, Alg& algorithm, Sol& solution, int iter_nodes, int number_of_mesh_refinement_iterations, Workspace* workspace)
+{
+  // Chooses between the limited-memory and the exact Hessian for the current mesh
+  // refinement iteration. With the "adaptive" option the exact Hessian, which is
+  // costly to set up on large meshes, is kept for the final refinements: the last
+  // iteration, the repeated solve of a converged mesh, and meshes whose predecessor
+  // was within a factor of ten of ode_tolerance. Other meshes start with the
+  // limited-memory approximation and change to the exact Hessian if the NLP stalls.
+
+  int i;
+  int iter = iter_nodes-1;
+
+  if ( algorithm.hessian == "adaptive" ) {
+
+      bool exact = ( iter_nodes == number_of_mesh_refinement_iterations && number_of_mesh_refinement_iterations > 1 )
+                   || workspace->polish_mesh;
+
+      if ( algorithm.mesh_refinement == "automatic" && iter_nodes > 1 ) {
+          double emax = 0.0;
+          for (i=0; i<problem.nphases; i++) {
+              emax = MAX( emax, (workspace->emax_history[i])(iter_nodes-1,2) );
+          }
+          if ( emax <= 10.0*algorithm.ode_tolerance ) exact = true;
+      }
+
+      workspace->exact_hessian = exact;
+  }
+  else {
+      workspace->exact_hessian = ( algorithm.hessian == "exact" );
+  }
+
+  workspace->hessian_switch_requested = false;
+
+  solution.mesh_stats[iter].hessian            = workspace->exact_hessian? "exact" : "limited-memory";
+  solution.mesh_stats[iter].hessian_setup_time = 0.0;
+
+}
+
+
+void lobatto_iiia_tableau(double* A, double* c)
+{
+  // Butcher tableau of the four stage Lobatto IIIA method (order 6). A is
+  // stored by rows, A[4*i+j] = a_(i+1)(j+1), and its last row holds the
+  // quadrature weights b.
+  //
+  // Reference: Hairer and Wanner, "Solving Ordinary Differential Equations II",
+  // Section IV.5. Springer-Verlag 1996
+  //
+  double s5 = sqrt(5.0);
+
+  c[0] = 0.0;
+  c[1] = (5.0-s5)/10.0;
+  c[2] = (5.0+s5)/10.0;
+  c[3] = 1.0;
+
+  A[0]  = 0.0;              A[1]  = 0.0;               A[2]  = 0.0;               A[3]  = 0.0;
+  A[4]  = (11.0+s5)/120.0;  A[5]  = (25.0-s5)/120.0;   A[6]  = (25.0-13.0*s5)/120.0; A[7]  = (-1.0+s5)/120.0;
+  A[8]  = (11.0-s5)/120.0;  A[9]  = (25.0+13.0*s5)/120.0; A[10] = (25.0+s5)/120.0;  A[11] = (-1.0-s5)/120.0;
+  A[12] = 1.0/12.0;         A[13] = 5.0/12.0;          A[14] = 5.0/12.0;          A[15] = 1.0/12.0;
+}
+
+
+void lobatto_iiia_nodes(DMatrix& breaks, DMatrix& snodes)
+{
+  // Builds the Lobatto IIIA mesh from the group boundaries in breaks: each
+  // group [breaks(g), breaks(g+1)] holds the four stage points of the method,
+  // so that the stage states and controls are ordinary node variables.
+  //
+  double A[16], c[4];
+  int g, m;
+  int G = length(breaks)-1;
+
+  lobatto_iiia_tableau(A, c);
+
+  snodes.Resize(1,3*G+1);
+
+  for(g=1;g<=G;g++) {
+      double h = breaks(g+1)-breaks(g);
+      for(m=0;m<3;m++) {
+          snodes(3*(g-1)+m+1) = breaks(g) + c[m]*h;
+      }
+  }
+
+  snodes(3*G+1) = breaks(G+1);
+
+}
+
+
+void lobatto_iiia_weights(DMatrix& snodes, DMatrix& w)
+{
+  // Composite Lobatto quadrature weights at the nodes of a Lobatto IIIA mesh
+  //
+  double A[16], c[4];
+  int g, m;
+  int N1 = length(snodes);
+  int G  = (N1-1)/3;
+
+  lobatto_iiia_tableau(A, c);
+
+  w.Resize(N1,1);
+  w.FillWithZeros();
+
+  for(g=1;g<=G;g++) {
+      int    k0 = 3*(g-1)+1;
+      double h  = snodes(k0+3)-snodes(k0);
+      for(m=0;m<4;m++) {
+          w(k0+m) += A[12+m]*h;
+      }
+  }
+
+}
+
+
+void lobatto_group_view(DMatrix& snodes, DMatrix& epsilon, DMatrix& breaks, DMatrix& epsilon_g)
+{
+  // Group boundaries and maximum relative error per group of a Lobatto IIIA mesh
+  //
+  int g;
+  int G = (length(snodes)-1)/3;
+
+  breaks.Resize(1,G+1);
+  epsilon_g.Resize(1,G);
+
+  for(g=1;g<=G;g++) {
+      breaks(g)    = snodes(3*(g-1)+1);
+      epsilon_g(g) = MAX( epsilon(3*(g-1)+1), MAX( epsilon(3*(g-1)+2), epsilon(3*(g-1)+3) ) );
+  }
+
+  breaks(G+1) = snodes(3*G+1);
+
+}
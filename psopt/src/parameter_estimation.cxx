@@ -236,6 +236,8 @@ void load_parameter_estimation_data(Prob& problem, int iphase, const char* filen
 void compute_residual_vector_in_phase(DMatrix& residual_vector, adouble* xad, int iphase, Workspace* workspace)
 {
 
+   invalidate_spline_cache(workspace);
+
 
    adouble time_k;
 
@@ -53,6 +53,7 @@ void print_iterations_summary(Prob& problem,Alg& algorithm,Sol& solution, Worksp
 	int sum_n_obj_evals        = 0;
 	int sum_n_con_evals        = 0;
 	int sum_n_ode_rhs_evals    = 0;
+	int sum_n_error_rhs_evals  = 0;
 	double sum_CPU_time        = 0.0;
 
 
@@ -60,14 +61,14 @@ void print_iterations_summary(Prob& problem,Alg& algorithm,Sol& solution, Worksp
         fprintf(outfile,"\n************************************* Mesh Refinement Statistics ************************************************");
 	fprintf(outfile,"\n*****************************************************************************************************************");
 
-	fprintf(outfile,"\n\nIter\tMethod\tNodes\tNV\tNC\tOEval\tCEval\tJEval\tHEval\tODE RHS\tODE Error\tNLP CPU(sec)");
+	fprintf(outfile,"\n\nIter\tMethod\tNodes\tNV\tNC\tOEval\tCEval\tJEval\tHEval\tODE RHS\tErr RHS\tODE Error\tNLP CPU(sec)");
 
 	for (jj=0;jj< workspace->current_mesh_refinement_iteration;jj++) {
 
-	  fprintf(outfile,"\n%i\t%s\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%e\t%e", jj+1, solution.mesh_stats[jj].method.c_str(), solution.mesh_stats[jj].nnodes, solution.mesh_stats[jj].nvars,
+	  fprintf(outfile,"\n%i\t%s\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%e\t%e", jj+1, solution.mesh_stats[jj].method.c_str(), solution.mesh_stats[jj].nnodes, solution.mesh_stats[jj].nvars,
 		solution.mesh_stats[jj].ncons, solution.mesh_stats[jj].n_obj_evals, solution.mesh_stats[jj].n_con_evals,
 		solution.mesh_stats[jj].n_jacobian_evals, solution.mesh_stats[jj].n_hessian_evals,
-		solution.mesh_stats[jj].n_ode_rhs_evals, solution.mesh_stats[jj].epsilon_max,
+		solution.mesh_stats[jj].n_ode_rhs_evals, solution.mesh_stats[jj].n_error_rhs_evals, solution.mesh_stats[jj].epsilon_max,
 		solution.mesh_stats[jj].CPU_time);
 
 		sum_n_jacobian_evals   += solution.mesh_stats[jj].n_jacobian_evals;
@@ -75,6 +76,7 @@ void print_iterations_summary(Prob& problem,Alg& algorithm,Sol& solution, Worksp
 	        sum_n_obj_evals        += solution.mesh_stats[jj].n_obj_evals;
 		sum_n_con_evals        += solution.mesh_stats[jj].n_con_evals;
 	        sum_n_ode_rhs_evals    += solution.mesh_stats[jj].n_ode_rhs_evals;
+	        sum_n_error_rhs_evals  += solution.mesh_stats[jj].n_error_rhs_evals;
 	        sum_CPU_time           += solution.mesh_stats[jj].CPU_time;
 	}
 
@@ -82,13 +84,13 @@ void print_iterations_summary(Prob& problem,Alg& algorithm,Sol& solution, Worksp
 
 	double diff_CPU_time = solution.cpu_time - sum_CPU_time;
 
-	        fprintf(outfile,"\nAdditional CPU time (sec)\t\t\t\t\t\t\t\t\t%e",
+	        fprintf(outfile,"\nAdditional CPU time (sec)\t\t\t\t\t\t\t\t\t\t%e",
 		diff_CPU_time);
 
-		fprintf(outfile,"\nTotals\t-\t-\t-\t-\t%i\t%i\t%i\t%i\t%i\t-\t\t%e",
+		fprintf(outfile,"\nTotals\t-\t-\t-\t-\t%i\t%i\t%i\t%i\t%i\t%i\t-\t\t%e",
 		sum_n_obj_evals, sum_n_con_evals,
 		sum_n_jacobian_evals, sum_n_hessian_evals,
-		sum_n_ode_rhs_evals,
+		sum_n_ode_rhs_evals, sum_n_error_rhs_evals,
 		solution.cpu_time);
 
         fprintf(outfile,"\n__________________________________________________________________________________________________________________\n\n");
@@ -101,14 +103,14 @@ void print_iterations_summary(Prob& problem,Alg& algorithm,Sol& solution, Worksp
         fprintf(outfile2,"\n************************************* Mesh Refinement Statistics ************************************************");
 	fprintf(outfile2,"\n*****************************************************************************************************************");
 
-	fprintf(outfile2,"\n\nIter\tMethod\tNodes\tNV\tNC\tOEval\tCEval\tJEval\tHEval\tODE RHS\tODE Error\tNLP CPU(sec)");
+	fprintf(outfile2,"\n\nIter\tMethod\tNodes\tNV\tNC\tOEval\tCEval\tJEval\tHEval\tODE RHS\tErr RHS\tODE Error\tNLP CPU(sec)");
 
 	for (jj=0;jj< workspace->current_mesh_refinement_iteration;jj++) {
 
-	  fprintf(outfile2,"\n%i\t%s\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%e\t%e", jj+1, solution.mesh_stats[jj].method.c_str(), solution.mesh_stats[jj].nnodes, solution.mesh_stats[jj].nvars,
+	  fprintf(outfile2,"\n%i\t%s\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%e\t%e", jj+1, solution.mesh_stats[jj].method.c_str(), solution.mesh_stats[jj].nnodes, solution.mesh_stats[jj].nvars,
 		solution.mesh_stats[jj].ncons, solution.mesh_stats[jj].n_obj_evals, solution.mesh_stats[jj].n_con_evals,
 		solution.mesh_stats[jj].n_jacobian_evals, solution.mesh_stats[jj].n_hessian_evals,
-		solution.mesh_stats[jj].n_ode_rhs_evals, solution.mesh_stats[jj].epsilon_max,
+		solution.mesh_stats[jj].n_ode_rhs_evals, solution.mesh_stats[jj].n_error_rhs_evals, solution.mesh_stats[jj].epsilon_max,
 		solution.mesh_stats[jj].CPU_time);
 
 
@@ -124,13 +126,13 @@ void print_iterations_summary(Prob& problem,Alg& algorithm,Sol& solution, Worksp
         fprintf(outfile2,"\n__________________________________________________________________________________________________________________\n\n");
 
 
-	        fprintf(outfile2,"\nAdditional CPU time (sec)\t\t\t\t\t\t\t\t\t%e",
+	        fprintf(outfile2,"\nAdditional CPU time (sec)\t\t\t\t\t\t\t\t\t\t%e",
 		diff_CPU_time);
 
-		fprintf(outfile2,"\nTotals\t-\t-\t-\t-\t%i\t%i\t%i\t%i\t%i\t-\t\t%e",
+		fprintf(outfile2,"\nTotals\t-\t-\t-\t-\t%i\t%i\t%i\t%i\t%i\t%i\t-\t\t%e",
 		sum_n_obj_evals, sum_n_con_evals,
 		sum_n_jacobian_evals, sum_n_hessian_evals,
-		sum_n_ode_rhs_evals,
+		sum_n_ode_rhs_evals, sum_n_error_rhs_evals,
 		solution.cpu_time);
 
         fprintf(outfile2,"\n__________________________________________________________________________________________________________________\n\n");
@@ -365,7 +367,14 @@ void print_algorithm_summary(Prob& problem, Alg& algorithm, Sol& solution, Works
     if (use_global_collocation(algorithm)) {
     fprintf(outfile,"\nDIFFERENTIATION MATRIX:         %s", algorithm.diff_matrix.c_str()   );
     }
+    if (use_hp_collocation(algorithm)) {
+    fprintf(outfile,"\nHP SEGMENT DEGREE:              %i", algorithm.hp_segment_degree   );
+    }
     fprintf(outfile,"\nNLP METHOD:                     %s", algorithm.nlp_method.c_str()   );
+    fprintf(outfile,"\nNLP VARIABLE ORDERING:          %s", algorithm.nlp_variable_ordering.c_str()   );
+    if (use_threaded_evaluation(algorithm)) {
+    fprintf(outfile,"\nNLP EVALUATION THREADS:         %i", algorithm.nlp_threads   );
+    }
     if (algorithm.nlp_method == "IPOPT") {
     fprintf(outfile,"\nHESSIAN OPTION:                 %s", algorithm.hessian.c_str()   );
     }
@@ -378,6 +387,9 @@ void print_algorithm_summary(Prob& problem, Alg& algorithm, Sol& solution, Works
     if (algorithm.mesh_refinement == "manual") {
         amrtype = "";
     }
+    else if (use_hp_collocation(algorithm) ) {
+        amrtype = " (hp-adaptive variant)";
+    }
     else if (use_global_collocation(algorithm) ) {
         amrtype = " (global variant)";
     }
@@ -392,14 +404,20 @@ void print_algorithm_summary(Prob& problem, Alg& algorithm, Sol& solution, Works
     fprintf(outfile,"\nMESH REF. ODE TOLERANCE:        %e", algorithm.ode_tolerance   );
     fprintf(outfile,"\nMESH REF. MAX ITERATIONS:       %i", algorithm.mr_max_iterations   );
     fprintf(outfile,"\nMESH REF. MAX INCREMENT FACTOR: %e", algorithm.mr_max_increment_factor   );
+    fprintf(outfile,"\nMESH REF. NLP TOL. SCHEDULE:    %s", algorithm.nlp_tolerance_schedule.c_str()   );
+    fprintf(outfile,"\nMESH REF. ERROR INTEGRATION:    %s", algorithm.error_integration.c_str()   );
       if (use_global_collocation(algorithm)) {
     fprintf(outfile,"\nMESH REF. INITIAL INCREMENT:    %i", algorithm.mr_initial_increment   );
     fprintf(outfile,"\nMESH REF. MIN EXTRAPOL. POINTS: %i", algorithm.mr_min_extrapolation_points   );
+        if (use_hp_collocation(algorithm)) {
+    fprintf(outfile,"\nMESH REF. HP MAX DEGREE:        %i", algorithm.hp_max_degree   );
+        }
       }
       else {
     fprintf(outfile,"\nMESH REF. KAPPA:                %e", algorithm.mr_kappa   );
     fprintf(outfile,"\nMESH REF. M1:                   %i", algorithm.mr_M1   );
     fprintf(outfile,"\nMESH REF. SWITCH ORDER AT ITER: %i", algorithm.switch_order   );
+    fprintf(outfile,"\nMESH REF. COARSENING FACTOR:    %e", algorithm.mr_coarsening_factor   );
       }
 
     }
@@ -679,11 +697,9 @@ void print_constraint_summary(Prob& problem, Sol& solution, Workspace* workspace
     for(i=0;i< problem.nphases; i++)
     {
 	int norder    = problem.phase[i].current_number_of_intervals;
-	int nstates   = problem.phase[i].nstates;
 	int nevents   = problem.phase[i].nevents;
 	int npath     = problem.phase[i].npath;
 	int offset;
-        int path_offset = phase_offset+nstates*(norder+1)+nevents;
 	int ncons_phase_i = get_ncons_phase_i(problem,i, workspace);
 
        fprintf(outfile,"\n******************************* PHASE %i SCALED DIFFERENTIAL DEFECT CONSTRAINTS **************************", i+1);
@@ -692,7 +708,7 @@ void print_constraint_summary(Prob& problem, Sol& solution, Workspace* workspace
        for(k=1; k<=norder+1; k++)
        {
                 for (j=0; j<problem.phase[i].nstates; j++) {
-	   	     l = phase_offset+(k-1)*nstates+j;
+	   	     l = phase_offset+get_defect_offset(problem,i,k,workspace)+j;
 		     fprintf(outfile,"\n%e\t%e\t%e\t%e\tDEFECT FOR STATE DERIV. %i NODE %i", g_l[l], G(l+1), g_u[l], cs(l+1), j+1, k);
 		     if ( g_l[l]-tol>G(l+1) || G(l+1)>g_u[l]+tol ) fprintf(outfile," **BOUND VIOLATED");
        		     if ( (g_l[l]-tol<G(l+1) && G(l+1)<g_l[l]+tol) || (g_u[l]-tol<G(l+1) && G(l+1)<g_u[l]+tol) ) fprintf(outfile," **AT BOUND");
@@ -705,14 +721,14 @@ void print_constraint_summary(Prob& problem, Sol& solution, Workspace* workspace
        {
 	        for (j=0; j<npath; j++)
 	        {
-		     l = path_offset + (k-1)*npath + j;
+		     l = phase_offset + get_path_offset(problem,i,k,workspace) + j;
 		     fprintf(outfile,"\n%e\t%e\t%e\t%e\tPATH CONSTRAINT %i NODE %i", g_l[l], G(l+1), g_u[l], cs(l+1),j+1,k);
 		     if ( g_l[l]-tol>G(l+1) || G(l+1)>g_u[l]+tol ) fprintf(outfile," **BOUND VIOLATED");
      		     if ( (g_l[l]-tol<G(l+1) && G(l+1)<g_l[l]+tol) || (g_u[l]-tol<G(l+1) && G(l+1)<g_u[l]+tol) ) fprintf(outfile," **AT BOUND");
 
                 }
        }
-       offset = phase_offset+nstates*(norder+1);
+       offset = phase_offset+get_event_offset(problem,i,workspace);
        fprintf(outfile,"\n************************************ PHASE %i SCALED EVENT CONSTRAINTS  ***********************************",i+1);
        fprintf(outfile,"\nLOWER\t\tG(X)\t\tUPPER\t\tSCALING\t\tDESCRIPTION");
 
@@ -774,14 +790,13 @@ void print_constraint_summary(Prob& problem, Sol& solution, Workspace* workspace
 	int offset;
         int iphase_offset = get_iphase_offset(problem,i+1, workspace);
 	int nvars_phase_i = get_nvars_phase_i(problem,i, workspace);
-        int offset1 = (norder+1)*ncontrols;
         int offset2 = (norder+1)*(ncontrols+nstates);
 
 
 	for (k=1; k<=norder+1; k++) {
 
                 for (ii=1;ii<=ncontrols;ii++) {
-                        j = iphase_offset+(k-1)*ncontrols+ii;
+                        j = iphase_offset+get_control_offset(problem,i,k,workspace)+ii;
 			fprintf(outfile,"\n%i\t%e\t%e\t%e\t%e\tCONTROL %i NODE %i PHASE %i", j, xlb(j)/control_scaling(ii),
 				  X(j)/control_scaling(ii), xub(j)/control_scaling(ii),  control_scaling(ii), ii, k, i+1);
 			if ( xlb(j)-tol>X(j) || X(j)>xub(j)+tol ) fprintf(outfile," **BOUND VIOLATED");
@@ -795,7 +810,7 @@ void print_constraint_summary(Prob& problem, Sol& solution, Workspace* workspace
 
 
                 for (ii=1;ii<=nstates;ii++) {
-                        j = iphase_offset+(k-1)*nstates+offset1+ii;
+                        j = iphase_offset+get_state_offset(problem,i,k,workspace)+ii;
 			fprintf(outfile,"\n%i\t%e\t%e\t%e\t%e\tSTATE %i NODE %i PHASE %i", j, xlb(j)/state_scaling(ii),
 				X(j)/state_scaling(ii), xub(j)/state_scaling(ii), state_scaling(ii), ii, k, i+1);
 			if ( xlb(j)-tol>X(j) || X(j)>xub(j)+tol ) fprintf(outfile," **BOUND VIOLATED");
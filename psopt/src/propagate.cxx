@@ -254,6 +254,10 @@ void rkf_propagate( void (*dae)(adouble* derivatives, adouble* path, adouble* st
 
 	int i, k;
 
+	// The control trajectory is sampled at increasing times, so the interpolation
+	// interval is tracked with a cursor rather than searched for at every stage
+	int cursor = 0;
+
 	for(i=1;i<=nparam;i++)  param[i-1] = parameters(i);
 
 	state_trajectory(colon(),1) = initial_state;
@@ -280,7 +284,7 @@ void rkf_propagate( void (*dae)(adouble* derivatives, adouble* path, adouble* st
 
 	     timep = time;
 
-	     if ( ncontrols>0 ) linear_interpolation(controlp, timep.value(), time_vector, control_trajectory, length(time_vector));
+	     if ( ncontrols>0 ) linear_interpolation(controlp, timep.value(), time_vector, control_trajectory, length(time_vector), &cursor);
 
 	     for(i=1;i<=ncontrols;i++)  controls[i-1] = controlp(i);
 
@@ -295,7 +299,7 @@ void rkf_propagate( void (*dae)(adouble* derivatives, adouble* path, adouble* st
 
 	     for(i=1;i<=nstates;i++)  states[i-1] = state_trajectory(i,k) + K1(i)/4.0;
 
-	     if ( ncontrols>0 ) linear_interpolation(controlp, timep.value(), time_vector, control_trajectory, length(time_vector));
+	     if ( ncontrols>0 ) linear_interpolation(controlp, timep.value(), time_vector, control_trajectory, length(time_vector), &cursor);
 
 
 	     for(i=1;i<=ncontrols;i++)  controls[i-1] = controlp(i);
@@ -311,7 +315,7 @@ void rkf_propagate( void (*dae)(adouble* derivatives, adouble* path, adouble* st
 
 	     for(i=1;i<=nstates;i++)  states[i-1] = state_trajectory(i,k) + (3.0/32.0)*K1(i) + (9.0/32.0)*K2(i);
 
-	     if ( ncontrols>0 ) linear_interpolation(controlp, timep.value(), time_vector, control_trajectory, length(time_vector));
+	     if ( ncontrols>0 ) linear_interpolation(controlp, timep.value(), time_vector, control_trajectory, length(time_vector), &cursor);
 
 	     for(i=1;i<=ncontrols;i++)  controls[i-1] = controlp(i);
 
@@ -326,7 +330,7 @@ void rkf_propagate( void (*dae)(adouble* derivatives, adouble* path, adouble* st
 
 	     for(i=1;i<=nstates;i++)  states[i-1] = state_trajectory(i,k) + (1932.0/2197.0)*K1(i) - (7200.0/2197.0)*K2(i) + (7296.0/2197.0)*K3(i);
 
-	     if ( ncontrols>0 ) linear_interpolation(controlp, timep.value(), time_vector, control_trajectory, length(time_vector));
+	     if ( ncontrols>0 ) linear_interpolation(controlp, timep.value(), time_vector, control_trajectory, length(time_vector), &cursor);
 
 	     for(i=1;i<=ncontrols;i++)  controls[i-1] = controlp(i);
 
@@ -342,7 +346,7 @@ void rkf_propagate( void (*dae)(adouble* derivatives, adouble* path, adouble* st
 
 	     for(i=1;i<=nstates;i++)  states[i-1] = state_trajectory(i,k) + (439.0/216.0)*K1(i) - (8.0)*K2(i) + (3680.0/513.0)*K3(i) - (845.0/4104.0)*K4(i);
 
-	     if ( ncontrols>0 ) linear_interpolation(controlp, timep.value(), time_vector, control_trajectory, length(time_vector));
+	     if ( ncontrols>0 ) linear_interpolation(controlp, timep.value(), time_vector, control_trajectory, length(time_vector), &cursor);
 
 	     for(i=1;i<=ncontrols;i++)  controls[i-1] = controlp(i);
 
@@ -357,7 +361,7 @@ void rkf_propagate( void (*dae)(adouble* derivatives, adouble* path, adouble* st
 
 	     for(i=1;i<=nstates;i++)  states[i-1] = state_trajectory(i,k) - (8.0/27.0)*K1(i) + (2.0)*K2(i) - (3544.0/2565.0)*K3(i) + (1859.0/4104.0)*K4(i) - (11.0/40.0)*K5(i);
 
-	     if ( ncontrols>0 ) linear_interpolation(controlp, timep.value(), time_vector, control_trajectory, length(time_vector));
+	     if ( ncontrols>0 ) linear_interpolation(controlp, timep.value(), time_vector, control_trajectory, length(time_vector), &cursor);
 
 	     for(i=1;i<=ncontrols;i++)  controls[i-1] = controlp(i);
 
@@ -385,7 +389,7 @@ void rkf_propagate( void (*dae)(adouble* derivatives, adouble* path, adouble* st
 		 new_time_vector(k+1) = time.value();
 		 timep = new_time_vector(k+1);
 		 if (ncontrols>0) {
-		    linear_interpolation(controlp, timep.value(), time_vector, control_trajectory, length(time_vector));
+		    linear_interpolation(controlp, timep.value(), time_vector, control_trajectory, length(time_vector), &cursor);
 		    new_control_trajectory( colon(), k+1) = controlp;
 		 }
 		 k= k+1;
@@ -436,3 +440,557 @@ void rkf_propagate( void (*dae)(adouble* derivatives, adouble* path, adouble* st
 }
 
 
+
+
+static void interpolate_controls(double* u, double t, double* tc, double* uc, int nc, int ncontrols, int* cursor)
+{
+// Linear interpolation of the control samples uc (ncontrols x nc, stored column-wise) at time t.
+// The interval is tracked with a cursor, as the stage times of consecutive steps are nearly sorted.
+
+	int i;
+
+	if (nc==1) {
+	    for(i=0;i<ncontrols;i++) u[i] = uc[i];
+	    return;
+	}
+
+	int j = locate_interval(t, tc, nc, cursor);
+
+	double s = (t-tc[j-1])/(tc[j]-tc[j-1]);
+
+	double* ul = uc + (j-1)*ncontrols;
+	double* ur = uc + j*ncontrols;
+
+	for(i=0;i<ncontrols;i++) u[i] = ul[i] + s*(ur[i]-ul[i]);
+}
+
+
+// Data needed to evaluate the right hand side of the ODE of a phase in double precision,
+// shared by the propagators that do not differentiate through the DAE.
+
+typedef struct {
+	void (*dae)(adouble* derivatives, adouble* path, adouble* states,
+	        adouble* controls, adouble* parameters, adouble& time,
+	        adouble* xad, int iphase, Workspace* workspace);
+	int       nstates;
+	int       ncontrols;
+	int       iphase;
+	adouble*  states;
+	adouble*  controls;
+	adouble*  derivatives;
+	adouble*  path;
+	adouble*  param;
+	double*   tc;          // Control sample times
+	double*   uc;          // Control samples, ncontrols x nc
+	int       nc;
+	int       cursor;      // Interpolation cursor into tc
+	double*   u;           // Interpolated controls
+	Workspace* workspace;
+} OdeRhs;
+
+static void ode_rhs(double* f, double t, double* x, OdeRhs& ode)
+{
+// Evaluates f = dx/dt at (t,x), with the controls interpolated at t.
+
+	int i;
+	adouble time = t;
+
+	if (ode.ncontrols>0) interpolate_controls(ode.u, t, ode.tc, ode.uc, ode.nc, ode.ncontrols, &ode.cursor);
+	for(i=0;i<ode.nstates;i++)   ode.states[i]   = x[i];
+	for(i=0;i<ode.ncontrols;i++) ode.controls[i] = ode.u[i];
+
+	ode.dae( ode.derivatives, ode.path, ode.states, ode.controls, ode.param, time, NULL, ode.iphase, ode.workspace);
+
+	for(i=0;i<ode.nstates;i++)   f[i] = ode.derivatives[i].value();
+}
+
+static void allocate_ode_rhs(OdeRhs& ode, void (*dae)(adouble* derivatives, adouble* path, adouble* states,
+         adouble* controls, adouble* parameters, adouble& time,
+        adouble* xad, int iphase, Workspace* workspace),
+        DMatrix& control_trajectory, DMatrix& time_vector, DMatrix& parameters, Prob& problem, int iphase, Workspace* workspace)
+{
+	int i;
+	int nparam = problem.phases(iphase).nparameters;
+
+	ode.dae         = dae;
+	ode.nstates     = problem.phases(iphase).nstates;
+	ode.ncontrols   = problem.phases(iphase).ncontrols;
+	ode.iphase      = iphase;
+	ode.states      = new adouble[ode.nstates];
+	ode.controls    = new adouble[ode.ncontrols];
+	ode.derivatives = new adouble[ode.nstates];
+	ode.path        = new adouble[problem.phases(iphase).npath];
+	ode.param       = new adouble[nparam];
+	ode.tc          = time_vector.GetPr();
+	ode.uc          = control_trajectory.GetPr();
+	ode.nc          = length(time_vector);
+	ode.cursor      = 0;
+	ode.u           = new double[ode.ncontrols+1];
+	ode.workspace   = workspace;
+
+	for(i=1;i<=nparam;i++)  ode.param[i-1] = parameters(i);
+}
+
+static void free_ode_rhs(OdeRhs& ode)
+{
+	delete[] ode.states;
+	delete[] ode.controls;
+	delete[] ode.derivatives;
+	delete[] ode.path;
+	delete[] ode.param;
+	delete[] ode.u;
+}
+
+static void check_output_times(DMatrix& output_times, DMatrix& time_vector, const char* caller)
+{
+	int k;
+	int nout  = length(output_times);
+	double* t = output_times.GetPr();
+	char msg[200];
+
+	if ( nout < 1 ) {
+	    sprintf(msg,"output_times is empty in call to %s()", caller);
+	    error_message(msg);
+	}
+	for (k=1;k<nout;k++) {
+	    if ( t[k] < t[k-1] ) {
+	        sprintf(msg,"output_times must be increasing in call to %s()", caller);
+	        error_message(msg);
+	    }
+	}
+	if ( t[0] < time_vector(1) ) {
+	    sprintf(msg,"output_times precede the initial time in call to %s()", caller);
+	    error_message(msg);
+	}
+}
+
+static double initial_step_size(double* y, double* f, int n, double tolerance, double hmin, double hmax)
+{
+// Initial step size from the scale of the solution and of its derivative, as in
+// Hairer, Norsett and Wanner (1993), Section II.4, without the second order estimate.
+
+	int i;
+	double sc, d0 = 0.0, d1 = 0.0, h;
+
+	for(i=0;i<n;i++) {
+	    sc  = tolerance*(1.0+fabs(y[i]));
+	    d0 += (y[i]/sc)*(y[i]/sc);
+	    d1 += (f[i]/sc)*(f[i]/sc);
+	}
+	d0 = sqrt(d0/n);
+	d1 = sqrt(d1/n);
+	h  = ( d0 < 1.e-5 || d1 < 1.e-5 ) ? 1.e-6 : 0.01*d0/d1;
+
+	return MIN( MAX(h,hmin), hmax );
+}
+
+void dopri_propagate( void (*dae)(adouble* derivatives, adouble* path, adouble* states,
+         adouble* controls, adouble* parameters, adouble& time,
+        adouble* xad, int iphase, Workspace* workspace),
+        DMatrix& control_trajectory,
+        DMatrix& time_vector,
+        DMatrix& initial_state,
+	DMatrix& parameters,
+        double tolerance,
+        double hmin,
+	double hmax,
+        Prob & problem,
+        int iphase,
+        DMatrix& output_times,
+        DMatrix& state_trajectory,
+	DMatrix& output_controls, Workspace* workspace)
+{
+// Dormand-Prince 5(4) method with proportional-integral step size control and dense output.
+// The initial state corresponds to time_vector(1), and the controls are linearly interpolated
+// from their samples at time_vector. The states are returned at the increasing times in
+// output_times, which are reached by evaluating the continuous extension of the accepted steps,
+// so that the step size is not restricted by the output rate. The local error estimate of each
+// component is kept below tolerance*(1+|x|).
+// The DAE is evaluated outside any ADOL-C trace, and all the other calculations are in double precision.
+// Reference: Hairer, Norsett and Wanner (1993) "Solving Ordinary Differential Equations I", Section II.5-6.
+
+	const double c2=1.0/5.0, c3=3.0/10.0, c4=4.0/5.0, c5=8.0/9.0;
+	const double a21=1.0/5.0;
+	const double a31=3.0/40.0, a32=9.0/40.0;
+	const double a41=44.0/45.0, a42=-56.0/15.0, a43=32.0/9.0;
+	const double a51=19372.0/6561.0, a52=-25360.0/2187.0, a53=64448.0/6561.0, a54=-212.0/729.0;
+	const double a61=9017.0/3168.0, a62=-355.0/33.0, a63=46732.0/5247.0, a64=49.0/176.0, a65=-5103.0/18656.0;
+	const double a71=35.0/384.0, a73=500.0/1113.0, a74=125.0/192.0, a75=-2187.0/6784.0, a76=11.0/84.0;
+	const double e1=71.0/57600.0, e3=-71.0/16695.0, e4=71.0/1920.0, e5=-17253.0/339200.0, e6=22.0/525.0, e7=-1.0/40.0;
+	const double d1=-12715105075.0/11282082432.0, d3=87487479700.0/32700410799.0, d4=-10690763975.0/1880347072.0;
+	const double d5=701980252875.0/199316789632.0, d6=-1453857185.0/822651844.0, d7=69997945.0/29380423.0;
+	const double beta = 0.04, alpha = 0.2-0.75*beta, safety = 0.9, facmin = 0.2, facmax = 10.0;
+
+	OdeRhs ode;
+
+	allocate_ode_rhs(ode, dae, control_trajectory, time_vector, parameters, problem, iphase, workspace);
+
+	int nstates   = ode.nstates;
+	int ncontrols = ode.ncontrols;
+	int nout      = length(output_times);
+
+	// Columns: y, ynew, k1,...,k7, stage argument, dense output coefficients r1..r5
+	DMatrix Work(nstates, 15);
+	double* y    = &Work(1,1);
+	double* ynew = &Work(1,2);
+	double* k1   = &Work(1,3);
+	double* k2   = &Work(1,4);
+	double* k3   = &Work(1,5);
+	double* k4   = &Work(1,6);
+	double* k5   = &Work(1,7);
+	double* k6   = &Work(1,8);
+	double* k7   = &Work(1,9);
+	double* ys   = &Work(1,10);
+	double* r1   = &Work(1,11);
+	double* r2   = &Work(1,12);
+	double* r3   = &Work(1,13);
+	double* r4   = &Work(1,14);
+	double* r5   = &Work(1,15);
+
+	double* tout = output_times.GetPr();
+	double* xout;
+	double* uout;
+	int i, kout;
+	bool reject = false;
+	double t, h, err, sc, fac, errold = 1.e-4, tend;
+
+	check_output_times(output_times, time_vector, "dopri_propagate");
+
+	state_trajectory.Resize(nstates,nout);
+	output_controls.Resize(MAX(ncontrols,1),nout);
+	xout = state_trajectory.GetPr();
+	uout = output_controls.GetPr();
+
+	t    = ode.tc[0];
+	tend = tout[nout-1];
+	for(i=0;i<nstates;i++) y[i] = initial_state(i+1);
+
+	ode_rhs( k1, t, y, ode );
+
+	// Outputs at the initial time
+	for (kout=0; kout<nout && tout[kout]<=t; kout++) {
+	    for(i=0;i<nstates;i++) xout[kout*nstates+i] = y[i];
+	    if (ncontrols>0) interpolate_controls(uout+kout*ncontrols, tout[kout], ode.tc, ode.uc, ode.nc, ncontrols, &ode.cursor);
+	}
+
+	h = initial_step_size(y, k1, nstates, tolerance, hmin, hmax);
+
+	while ( kout < nout ) {
+
+	     bool last = ( t + h >= tend );
+	     if (last) h = tend - t;
+	     double tnew = last ? tend : t + h;
+
+	     for(i=0;i<nstates;i++) ys[i] = y[i] + h*a21*k1[i];
+	     ode_rhs( k2, t+c2*h, ys, ode );
+	     for(i=0;i<nstates;i++) ys[i] = y[i] + h*(a31*k1[i]+a32*k2[i]);
+	     ode_rhs( k3, t+c3*h, ys, ode );
+	     for(i=0;i<nstates;i++) ys[i] = y[i] + h*(a41*k1[i]+a42*k2[i]+a43*k3[i]);
+	     ode_rhs( k4, t+c4*h, ys, ode );
+	     for(i=0;i<nstates;i++) ys[i] = y[i] + h*(a51*k1[i]+a52*k2[i]+a53*k3[i]+a54*k4[i]);
+	     ode_rhs( k5, t+c5*h, ys, ode );
+	     for(i=0;i<nstates;i++) ys[i] = y[i] + h*(a61*k1[i]+a62*k2[i]+a63*k3[i]+a64*k4[i]+a65*k5[i]);
+	     ode_rhs( k6, tnew, ys, ode );
+	     for(i=0;i<nstates;i++) ynew[i] = y[i] + h*(a71*k1[i]+a73*k3[i]+a74*k4[i]+a75*k5[i]+a76*k6[i]);
+	     ode_rhs( k7, tnew, ynew, ode );
+
+	     // Scaled RMS norm of the embedded error estimate
+	     err = 0.0;
+	     for(i=0;i<nstates;i++) {
+	         sc   = tolerance*( 1.0 + MAX( fabs(y[i]), fabs(ynew[i]) ) );
+	         double ei = h*(e1*k1[i]+e3*k3[i]+e4*k4[i]+e5*k5[i]+e6*k6[i]+e7*k7[i])/sc;
+	         err += ei*ei;
+	     }
+	     err = sqrt(err/nstates);
+
+	     if ( err <= 1.0 ) {
+	         // Step accepted: dense output for all the output times within the step
+	         for(i=0;i<nstates;i++) {
+	             r1[i] = y[i];
+	             r2[i] = ynew[i]-y[i];
+	             r3[i] = h*k1[i] - r2[i];
+	             r4[i] = r2[i] - h*k7[i] - r3[i];
+	             r5[i] = h*(d1*k1[i]+d3*k3[i]+d4*k4[i]+d5*k5[i]+d6*k6[i]+d7*k7[i]);
+	         }
+	         for ( ; kout<nout && tout[kout]<=tnew; kout++) {
+	             double theta  = (tout[kout]-t)/h;
+	             double theta1 = 1.0-theta;
+	             double* xk    = xout + kout*nstates;
+	             for(i=0;i<nstates;i++) {
+	                 xk[i] = r1[i] + theta*( r2[i] + theta1*( r3[i] + theta*( r4[i] + theta1*r5[i] ) ) );
+	             }
+	             if (ncontrols>0) interpolate_controls(uout+kout*ncontrols, tout[kout], ode.tc, ode.uc, ode.nc, ncontrols, &ode.cursor);
+	         }
+
+	         // First same as last: k7 is the derivative at the start of the next step
+	         for(i=0;i<nstates;i++) {
+	             y[i]  = ynew[i];
+	             k1[i] = k7[i];
+	         }
+	         t = tnew;
+
+	         fac = ( err > 0.0 ) ? safety*pow(err,-alpha)*pow(errold,beta) : facmax;
+	         fac = MAX( facmin, MIN( reject ? 1.0 : facmax, fac ) );
+	         errold = MAX( err, 1.e-4 );
+	         reject = false;
+	     }
+	     else {
+	         fac = MAX( facmin, safety*pow(err,-alpha) );
+	         reject = true;
+	     }
+
+	     h = MIN( h*fac, hmax );
+
+	     if ( kout < nout && h < hmin && t + h < tend ) {
+	         fprintf(stderr,"\nh=%e, hmin=%e", h, hmin);
+	         error_message("\n Warning: minimum step size exceeded in dopri_propagate( )");
+	     }
+	}
+
+	free_ode_rhs(ode);
+}
+
+
+static void ode_jacobian(DMatrix& J, double* T, double t, double* x, double* f, double* work, OdeRhs& ode, bool automatic, int tag)
+{
+// Computes the Jacobian J = df/dx and the time derivative T = df/dt of the right hand side
+// at (t,x), where f = f(t,x) is given. With automatic==true the DAE is recorded on the tape
+// tag and J is obtained by ADOL-C; otherwise J is approximated by forward differences.
+// The tape is recorded at every call, so that DAEs with branches are differentiated correctly.
+// T is always approximated by a forward difference.
+
+	int i, j;
+	int n = ode.nstates;
+	double sqreps = sqrt( DMatrix::GetEPS() );
+	double delta;
+
+	J.Resize(n,n);
+
+	if (automatic) {
+	    double** Jrows = new double*[n];
+	    DMatrix JT(n,n);
+	    adouble time = t;
+	    for(i=0;i<n;i++) Jrows[i] = &JT(1,i+1);
+
+	    if (ode.ncontrols>0) interpolate_controls(ode.u, t, ode.tc, ode.uc, ode.nc, ode.ncontrols, &ode.cursor);
+	    trace_on(tag);
+	    for(i=0;i<n;i++)              ode.states[i] <<= x[i];
+	    for(i=0;i<ode.ncontrols;i++)  ode.controls[i] = ode.u[i];
+	    ode.dae( ode.derivatives, ode.path, ode.states, ode.controls, ode.param, time, NULL, ode.iphase, ode.workspace);
+	    for(i=0;i<n;i++)              ode.derivatives[i] >>= work[i];
+	    trace_off();
+
+	    jacobian(tag, n, n, x, Jrows);
+
+	    for(i=1;i<=n;i++) {
+	        for(j=1;j<=n;j++) J(i,j) = JT(j,i);
+	    }
+	    delete[] Jrows;
+	}
+	else {
+	    for(j=0;j<n;j++) {
+	        double xj = x[j];
+	        delta = sqreps*(1.0+fabs(xj));
+	        x[j]  = xj + delta;
+	        delta = x[j] - xj;
+	        ode_rhs(work, t, x, ode);
+	        x[j]  = xj;
+	        for(i=0;i<n;i++) J(i+1,j+1) = (work[i]-f[i])/delta;
+	    }
+	}
+
+	delta = sqreps*(1.0+fabs(t));
+	ode_rhs(work, t+delta, x, ode);
+	for(i=0;i<n;i++) T[i] = (work[i]-f[i])/delta;
+}
+
+
+void rosenbrock_propagate( void (*dae)(adouble* derivatives, adouble* path, adouble* states,
+         adouble* controls, adouble* parameters, adouble& time,
+        adouble* xad, int iphase, Workspace* workspace),
+        DMatrix& control_trajectory,
+        DMatrix& time_vector,
+        DMatrix& initial_state,
+	DMatrix& parameters,
+        double tolerance,
+        double hmin,
+	double hmax,
+        Prob & problem,
+        int iphase,
+        DMatrix& output_times,
+        DMatrix& state_trajectory,
+	DMatrix& output_controls,
+	const string& jacobian_method, Workspace* workspace)
+{
+// Linearly implicit Rosenbrock 2(3) method for stiff problems, with dense output. The arguments
+// are as in dopri_propagate(). jacobian_method is "automatic" to obtain the Jacobian of the ODE
+// with ADOL-C, or "numerical" to approximate it by finite differences.
+// The second order solution is a W-method: it keeps its order when the Jacobian is not exact,
+// so that the Jacobian and the LU factors of W = I - h*d*J are kept across steps. The step size
+// is left unchanged when the controller would increase it by less than 20%, and both are then
+// reused. The Jacobian is updated when the step size changes, or after a rejected step.
+// Reference: Shampine and Reichelt (1997) "The MATLAB ODE Suite", SIAM J. Sci. Comput., 18.
+
+	const double d   = 1.0/(2.0+sqrt(2.0));
+	const double e32 = 6.0+sqrt(2.0);
+	const double safety = 0.9, facmin = 0.2, facmax = 5.0;
+
+	OdeRhs ode;
+
+	if ( jacobian_method != "automatic" && jacobian_method != "numerical" ) {
+	    error_message("Incorrect jacobian_method in call to rosenbrock_propagate(). Valid options are \"automatic\" and \"numerical\" ");
+	}
+
+	allocate_ode_rhs(ode, dae, control_trajectory, time_vector, parameters, problem, iphase, workspace);
+
+	int nstates   = ode.nstates;
+	int ncontrols = ode.ncontrols;
+	int nout      = length(output_times);
+	int tag       = (workspace!=NULL) ? workspace->tag_ode : 6;
+	bool automatic = (jacobian_method == "automatic");
+
+	// Columns: y, ynew, F0, F1, F2, k1, k2, k3, T, work
+	DMatrix Work(nstates, 10);
+	double* y    = &Work(1,1);
+	double* ynew = &Work(1,2);
+	double* F0   = &Work(1,3);
+	double* F1   = &Work(1,4);
+	double* F2   = &Work(1,5);
+	double* k1   = &Work(1,6);
+	double* k2   = &Work(1,7);
+	double* k3   = &Work(1,8);
+	double* T    = &Work(1,9);
+	double* work = &Work(1,10);
+
+	DMatrix J, W, WLU, rhs(nstates,1), sol(nstates,1);
+
+	double* tout = output_times.GetPr();
+	double* xout;
+	double* uout;
+	int i, j, kout;
+	bool reject = false, jac_current = false, factorised = false;
+	double t, h, hlu = 0.0, err, sc, fac, tend;
+
+	check_output_times(output_times, time_vector, "rosenbrock_propagate");
+
+	state_trajectory.Resize(nstates,nout);
+	output_controls.Resize(MAX(ncontrols,1),nout);
+	xout = state_trajectory.GetPr();
+	uout = output_controls.GetPr();
+
+	t    = ode.tc[0];
+	tend = tout[nout-1];
+	for(i=0;i<nstates;i++) y[i] = initial_state(i+1);
+
+	ode_rhs( F0, t, y, ode );
+
+	// Outputs at the initial time
+	for (kout=0; kout<nout && tout[kout]<=t; kout++) {
+	    for(i=0;i<nstates;i++) xout[kout*nstates+i] = y[i];
+	    if (ncontrols>0) interpolate_controls(uout+kout*ncontrols, tout[kout], ode.tc, ode.uc, ode.nc, ncontrols, &ode.cursor);
+	}
+
+	h = initial_step_size(y, F0, nstates, tolerance, hmin, hmax);
+
+	ode_jacobian(J, T, t, y, F0, work, ode, automatic, tag);
+	jac_current = true;
+
+#define SOLVE_W( x, b )                                   \
+	{                                                 \
+	    for(i=0;i<nstates;i++) rhs(i+1) = (b);        \
+	    sol = LUFSolve( WLU, rhs );                   \
+	    for(i=0;i<nstates;i++) (x)[i] = sol(i+1);     \
+	}
+
+	while ( kout < nout ) {
+
+	     bool last = ( t + h >= tend );
+	     if (last) h = tend - t;
+	     double tnew = last ? tend : t + h;
+
+	     if ( !factorised || h != hlu ) {
+	         W = -(h*d)*J;
+	         for(j=1;j<=nstates;j++) W(j,j) += 1.0;
+	         WLU = LU(W);
+	         hlu = h;
+	         factorised = true;
+	     }
+
+	     SOLVE_W( k1, F0[i] + h*d*T[i] );
+	     for(i=0;i<nstates;i++) work[i] = y[i] + 0.5*h*k1[i];
+	     ode_rhs( F1, t+0.5*h, work, ode );
+	     SOLVE_W( k2, F1[i] - k1[i] );
+	     for(i=0;i<nstates;i++) {
+	         k2[i]  += k1[i];
+	         ynew[i] = y[i] + h*k2[i];
+	     }
+	     ode_rhs( F2, tnew, ynew, ode );
+	     SOLVE_W( k3, F2[i] - e32*(k2[i]-F1[i]) - 2.0*(k1[i]-F0[i]) + h*d*T[i] );
+
+	     // Scaled RMS norm of the error estimate of the second order solution
+	     err = 0.0;
+	     for(i=0;i<nstates;i++) {
+	         sc   = tolerance*( 1.0 + MAX( fabs(y[i]), fabs(ynew[i]) ) );
+	         double ei = (h/6.0)*(k1[i]-2.0*k2[i]+k3[i])/sc;
+	         err += ei*ei;
+	     }
+	     err = sqrt(err/nstates);
+
+	     if ( err <= 1.0 ) {
+	         // Step accepted: dense output for all the output times within the step
+	         for ( ; kout<nout && tout[kout]<=tnew; kout++) {
+	             double s   = (tout[kout]-t)/h;
+	             double b1  = s*(1.0-s)/(1.0-2.0*d);
+	             double b2  = s*(s-2.0*d)/(1.0-2.0*d);
+	             double* xk = xout + kout*nstates;
+	             for(i=0;i<nstates;i++) xk[i] = y[i] + h*( b1*k1[i] + b2*k2[i] );
+	             if (ncontrols>0) interpolate_controls(uout+kout*ncontrols, tout[kout], ode.tc, ode.uc, ode.nc, ncontrols, &ode.cursor);
+	         }
+
+	         for(i=0;i<nstates;i++) {
+	             y[i]  = ynew[i];
+	             F0[i] = F2[i];
+	         }
+	         t = tnew;
+	         jac_current = false;
+
+	         fac = ( err > 0.0 ) ? safety*pow(err,-1.0/3.0) : facmax;
+	         fac = MAX( facmin, MIN( reject ? 1.0 : facmax, fac ) );
+	         if ( fac >= 1.0 && fac <= 1.2 ) fac = 1.0;
+	         reject = false;
+
+	         // W has to be factorised again if the step size changes, and the Jacobian
+	         // is then updated as well, so that it does not degrade the error estimate
+	         if ( fac != 1.0 ) {
+	             ode_jacobian(J, T, t, y, F0, work, ode, automatic, tag);
+	             jac_current = true;
+	             factorised  = false;
+	         }
+	     }
+	     else {
+	         // With an outdated Jacobian the error estimate is unreliable, so the
+	         // Jacobian is updated before the step size is reduced much
+	         if ( !jac_current ) {
+	             ode_jacobian(J, T, t, y, F0, work, ode, automatic, tag);
+	             jac_current = true;
+	             factorised  = false;
+	             fac = MAX( 0.5, MIN( 1.0, safety*pow(err,-1.0/3.0) ) );
+	         }
+	         else {
+	             fac = MAX( facmin, safety*pow(err,-1.0/3.0) );
+	         }
+	         reject = true;
+	     }
+
+	     h = MIN( h*fac, hmax );
+
+	     if ( kout < nout && h < hmin && t + h < tend ) {
+	         fprintf(stderr,"\nh=%e, hmin=%e", h, hmin);
+	         error_message("\n Warning: minimum step size exceeded in rosenbrock_propagate( )");
+	     }
+	}
+
+#undef SOLVE_W
+
+	free_ode_rhs(ode);
+}
@@ -31,6 +31,8 @@ Author:    Professor Victor M. Becerra
 
 #include "psopt.h"
 
+#include <mutex>
+
 
 double delta(long l, long N)
 {
@@ -42,6 +44,12 @@ double delta(long l, long N)
       return delta_l;
 }
 
+inline double parity_sign(long n)
+{
+      // (-1)^n without calling pow()
+      return (n%2==0)? 1.0 : -1.0;
+}
+
 void diffmat_central_differences(DMatrix& D, DMatrix & x )
 {
 
@@ -156,6 +164,190 @@ D(N+1,N+1)=-1/h;
 
 }
 
+void symmetric_tridiagonal_eigenvalues(int n, double* d, double* e)
+{
+// Eigenvalues of a symmetric tridiagonal matrix by the implicit QL method.
+// On entry d holds the diagonal and e(0..n-2) the subdiagonal, on exit d holds
+// the eigenvalues in no particular order and e is destroyed. O(n^2) operations.
+//
+// Reference:
+//   W. H. Press et al, "Numerical Recipes in C," Section 11.3. Cambridge
+//   University Press 1992
+//
+  int m, l, iter, i;
+  double s, r, p, g, f, dd, c, b;
+
+  if (n<=1) return;
+
+  e[n-1] = 0.0;
+
+  for (l=0; l<n; l++) {
+      iter = 0;
+      do {
+          for (m=l; m<n-1; m++) {
+              dd = fabs(d[m]) + fabs(d[m+1]);
+              if ( fabs(e[m]) <= DMatrix::GetEPS()*dd ) break;
+          }
+          if (m != l) {
+              if (iter++ == 60) {
+                  error_message("symmetric_tridiagonal_eigenvalues: too many iterations");
+              }
+              g = (d[l+1]-d[l])/(2.0*e[l]);
+              r = hypot(g, 1.0);
+              g = d[m]-d[l] + e[l]/(g + (g>=0.0 ? fabs(r) : -fabs(r)));
+              s = c = 1.0;
+              p = 0.0;
+              for (i=m-1; i>=l; i--) {
+                  f = s*e[i];
+                  b = c*e[i];
+                  e[i+1] = (r = hypot(f,g));
+                  if (r == 0.0) {
+                      d[i+1] -= p;
+                      e[m] = 0.0;
+                      break;
+                  }
+                  s = f/r;
+                  c = g/r;
+                  g = d[i+1]-p;
+                  r = (d[i]-g)*s + 2.0*c*b;
+                  d[i+1] = g + (p = s*r);
+                  g = c*r - b;
+              }
+              if (r == 0.0 && i >= l) continue;
+              d[l] -= p;
+              e[l]  = g;
+              e[m]  = 0.0;
+          }
+      } while (m != l);
+  }
+
+}
+
+static int compare_descending(const void* a, const void* b)
+{
+  double da = *((const double*) a);
+  double db = *((const double*) b);
+
+  if (da > db) return -1;
+  if (da < db) return  1;
+  return 0;
+}
+
+void lgl_nodes_golub_welsch(int N, DMatrix& x, DMatrix& PN)
+{
+// Computes the Legendre-Gauss-Lobatto nodes in descending order together with
+// P_N at the nodes. The interior nodes are the zeros of P'_N, which are the
+// eigenvalues of the Jacobi matrix of the Gegenbauer polynomials C^(3/2).
+// The eigenvalues are refined with Newton-Raphson on P_(N-1)-x*P_N and
+// symmetrised, so the nodes stay accurate for thousands of points.
+//
+  long N1 = N+1;
+  long k, j, iter;
+  int  n  = N-1;
+
+  x.Resize(N1,1);
+  PN.Resize(N1,1);
+
+  x(1)  =  1.0;
+  x(N1) = -1.0;
+
+  if (n>0) {
+
+      double* d = new double[n];
+      double* e = new double[n];
+
+      for (k=0; k<n; k++) {
+          double kd = (double) (k+1);
+          d[k] = 0.0;
+          e[k] = sqrt( kd*(kd+2.0)/((2.0*kd+1.0)*(2.0*kd+3.0)) );
+      }
+
+      symmetric_tridiagonal_eigenvalues(n, d, e);
+
+      qsort(d, n, sizeof(double), compare_descending);
+
+      for (k=0; k<n; k++) {
+          x(k+2) = d[k];
+      }
+
+      delete [] d;
+      delete [] e;
+  }
+
+  for (k=2; k<=N; k++) {
+
+      double xk = x(k);
+      double p0, p1, p2;
+
+      for (iter=0; iter<10; iter++) {
+          p0 = 1.0;
+          p1 = xk;
+          for (j=2; j<=N; j++) {
+              double jd = (double) j;
+              p2 = ( (2*jd-1)*xk*p1 - (jd-1)*p0 )/jd;
+              p0 = p1;
+              p1 = p2;
+          }
+          // p1 = P_N(xk), p0 = P_(N-1)(xk), d/dx (P_(N-1)-x*P_N) = -(N+1)*P_N
+          double dx = (p0 - xk*p1)/((double) N1*p1);
+          xk += dx;
+          if ( fabs(dx) <= DMatrix::GetEPS() ) break;
+      }
+      x(k) = xk;
+  }
+
+  // Enforce the symmetry of the node distribution
+  for (k=1; k<=N1/2; k++) {
+      double xs = 0.5*( x(k) - x(N1-k+1) );
+      x(k)      =  xs;
+      x(N1-k+1) = -xs;
+  }
+  if (N1%2 == 1) x(N/2+1) = 0.0;
+
+  for (k=1; k<=N1; k++) {
+      double xk = x(k);
+      double p0 = 1.0, p1 = xk, p2;
+      for (j=2; j<=N; j++) {
+          double jd = (double) j;
+          p2 = ( (2*jd-1)*xk*p1 - (jd-1)*p0 )/jd;
+          p0 = p1;
+          p1 = p2;
+      }
+      PN(k) = (N==0)? 1.0 : p1;
+  }
+
+}
+
+void barycentric_diffmat(DMatrix& D, DMatrix& x, DMatrix& lambda)
+{
+// Differentiation matrix of the polynomial interpolant through the nodes x,
+// given its barycentric weights lambda:
+//     D(i,j) = (lambda(j)/lambda(i))/(x(i)-x(j)),  i != j
+//     D(i,i) = - sum_(j!=i) D(i,j)
+// The negative sum trick makes D annihilate constants to machine precision.
+//
+// Reference:
+//   J.-P. Berrut, L. N. Trefethen, "Barycentric Lagrange Interpolation,"
+//   SIAM Review 46(3), 2004
+//
+  long N1 = length(x);
+  long i, j;
+
+  D.Resize(N1,N1);
+
+  for (i=1; i<=N1; i++) {
+      double sum = 0.0;
+      for (j=1; j<=N1; j++) {
+          if (i != j) {
+              D(i,j) = (lambda(j)/lambda(i))/(x(i)-x(j));
+              sum   += D(i,j);
+          }
+      }
+      D(i,i) = -sum;
+  }
+
+}
+
 void legendre_points(int N, DMatrix& x, DMatrix& w)
 {
 // Finds the roots of the Legendre polynomials in (-1,1), also known as the Legendre points,
@@ -205,94 +397,40 @@ void lglnodes(int N, DMatrix& x, DMatrix& w, DMatrix& P, DMatrix& D, Workspace*
   long k;
   long l,i,j;
 
-  DMatrix xold, X, Xdiff, L;
-//  Use the Chebyshev-Gauss-Lobatto nodes as the first guess
-  x = cos(pi*colon(0,N)/N);
-//  The Legendre Vandermonde Matrix
-//  P = zeros(N1,N1);
-//  w = zeros(N1,1);
-  P.Resize(N1,N1);
-  w.Resize(N1,N1);
-  P.FillWithZeros();
-  w.FillWithZeros();
-// Compute P_(N) using the recursion relation
-// Compute its first and second derivatives and
-// update x using the Newton-Raphson method.
-  xold = 2*ones(N1,1);
-  while ( Max( Abs( x-xold ) ) > DMatrix::GetEPS() )
-  {
-
-
-       xold = x;
-       P(colon(),1)=ones(N1,1); P(colon(),2)=x;
-
-       for ( k = 2; k<=N; k++ )
-       {
-	   double kd = (double) k;
-           P(colon(),k+1) = ( elemProduct((2*kd-1)*x,P(colon(),k)) - (kd-1)*P(colon(),k-1) )/kd;
+  DMatrix PN(N1,1);
 
-       }
+//  Nodes in descending order, x(1)=1 and x(N1)=-1, interior nodes from the
+//  Golub-Welsch eigenvalue problem polished with Newton-Raphson
+  lgl_nodes_golub_welsch(N, x, PN);
 
-       double N1d = (double) N1;
-       x = xold-elemDivision(  elemProduct(x,P(colon(),N1))-P(colon(),N) , N1d*P(colon(),N1) );
+//  The Legendre Vandermonde Matrix P(k,j) = P_(j-1)(x_k)
+  P.Resize(N1,N1);
+  w.Resize(N1,1);
 
+  for( k=1; k<=N1; k++)
+  {
+     double xk = x(k);
+     P(k,1) = 1.0;
+     if (N1>1) P(k,2) = xk;
+     for( j=2; j<=N; j++ )
+     {
+         double jd = (double) j;
+         P(k,j+1) = ( (2*jd-1)*xk*P(k,j) - (jd-1)*P(k,j-1) )/jd;
+     }
   }
 
   for( k=1; k<=N1; k++)
   {
-     w(k) = 2/((N*N1)*P(k,N1)*P(k,N1) );
+     w(k) = 2/((N*N1)*PN(k)*PN(k) );
   }
 
   if ( workspace->differential_defects == "standard") {
 
-	// Compute now the differentiation matrix D using the standard formula
-//	X = zeros(N1,N1);
-        X.Resize(N1,N1);
-        X.FillWithZeros();
-	for(k=1;k<=N1;k++)
-	{
-	X(colon(),k) = x;
-	}
-
-//	Xdiff= X-tra(X)+eye(N1);
-        Xdiff.Resize(N1,N1);
-
-        for(i=1;i<=N1;i++) {
-                for(j=1;j<=N1;j++) {
-                         double identity;
-                         if (i==j) identity = 1.0; else identity=0.0;
-                         Xdiff(i,j) = X(i,j)-X(j,i) + identity;
-                }
-        }
-
-//	L = zeros(N1,N1);
-        L.Resize(N1,N1);
-        L.FillWithZeros();
-	for(k=1;k<=N1;k++)
-	{
-	L(colon(),k) =  P(colon(),N1);
-	}
-
-	for (k=1;k<=N1*N1;k=k+N1+1)
-	{
-	L(k)=1;
-	}
-
-	D = elemDivision(L, elemProduct(Xdiff, tra(L) ) );
-        for(i=1;i<=N1;i++) {
-                for(j=1;j<=N1;j++) {
-//                     D(i,j) = L(i,j)/(Xdiff(i,j)*L(j,i));
-                }
-        }
-
-	for (k=1; k<=N1*N1; k=k+N1+1)
-	{
-	D(k) = 0.0;
-	}
+	// Compute the differentiation matrix D from the barycentric weights
+	// 1/P_N(x_k), with the diagonal given by the negative sum trick.
+	DMatrix lambda = elemDivision( ones(N1,1), PN );
 
-	D(1) = ((double) N1*N)/4.0;
-
-	D(N1*N1)=-((double) N1*N)/4.0;
+	barycentric_diffmat( D, x, lambda );
 
 //	D=-D;
         for(i=1;i<=N1;i++) {
@@ -309,14 +447,14 @@ void lglnodes(int N, DMatrix& x, DMatrix& w, DMatrix& P, DMatrix& D, Workspace*
 	for(j=0;j<=N;j++) {
 		for(l=0;l<=N;l++)  {
 		if(j!=l) {
-			D(j+1,l+1) = delta(l,N)*pow(-1.0,(double) (j+l))/(delta(j,N)*(x(j+1)-x(l+1)));
+			D(j+1,l+1) = delta(l,N)*parity_sign(j+l)/(delta(j,N)*(x(j+1)-x(l+1)));
 		}
 		else {
 			double sum=0.0;
 			long i;
 			for(i=0;i<=N;i++) {
 				if (i != j) {
-					sum += delta(i,N)*pow(-1.0,(double) (i+j))/(delta(j,N)*(x(j+1)-x(i+1)));
+					sum += delta(i,N)*parity_sign(i+j)/(delta(j,N)*(x(j+1)-x(i+1)));
 				}
 			}
 			D(j+1,l+1) = -sum;
@@ -387,8 +525,14 @@ void cglnodes(int N, DMatrix& x, DMatrix& w,  DMatrix& D, Workspace* workspace)
   long k;
   long i,j,l;
 
-//  compute the Chebyshev-Gauss-Lobatto nodes
-  x = cos(pi*colon(0,N)/N);
+//  compute the Chebyshev-Gauss-Lobatto nodes, x_j = cos(j*pi/N) written as
+//  sin(pi*(N-2j)/(2N)) so that the computed nodes are exactly symmetric
+  x.Resize(N1,1);
+
+  for( k=0; k<=N; k++)
+  {
+     x(k+1) = sin( pi*((double) (N-2*k))/(2.0*N) );
+  }
 
   w = zeros(N1,1);
 
@@ -404,19 +548,22 @@ void cglnodes(int N, DMatrix& x, DMatrix& w,  DMatrix& D, Workspace* workspace)
 
   // Compute now the differentiation matrix D
 
-  if ( workspace->differential_defects == "standard" ) {
+  if ( workspace->differential_defects == "standard" || workspace->differential_defects == "dct" ) {
 
+	// The matrix is also formed for the "dct" option, which falls back on it
+	// when the exact Hessian is used.
+	// Off-diagonal entries use the barycentric weights (-1)^j/cbar(j) with
+	// the node differences written in trigonometric form to avoid
+	// cancellation, and the diagonal follows from the negative sum trick.
 	for(j=0;j<=N;j++) {
+		double sum = 0.0;
 		for(l=0;l<=N;l++)  {
-		if(j!=l)
-			D(j+1,l+1)= -cbar(j,N)/(2*cbar(l,N))*pow(-1.0,(int) (j+l))/( sin((j+l)*pi/(2*N))*sin((j-l)*pi/(2*N)));
-			else if ( j==l && 1<=j && l <= N-1)
-			D(j+1,l+1) =  -x(j+1)/(2*pow( sin(j*pi/N), 2));
-			else if ( j==0 && l==0 )
-			D(j+1,l+1)=(2*pow(N,2.0)+1.0)/6.0;
-			else if ( j==N && l==N)
-				D(j+1,l+1)=-(2*pow(N,2.0)+1.0)/6.0;
+		if(j!=l) {
+			D(j+1,l+1)= -cbar(j,N)/(2*cbar(l,N))*parity_sign(j+l)/( sin((j+l)*pi/(2*N))*sin((j-l)*pi/(2*N)));
+			sum += D(j+1,l+1);
 		}
+		}
+		D(j+1,j+1) = -sum;
 	}
 
 //	D=-D;
@@ -434,14 +581,14 @@ void cglnodes(int N, DMatrix& x, DMatrix& w,  DMatrix& D, Workspace* workspace)
 	for(j=0;j<=N;j++) {
 		for(l=0;l<=N;l++)  {
 		if(j!=l) {
-			D(j+1,l+1) = delta(l,N)*pow(-1.0,(int) (j+l))/(delta(j,N)*(x(j+1)-x(l+1)));
+			D(j+1,l+1) = delta(l,N)*parity_sign(j+l)/(delta(j,N)*(x(j+1)-x(l+1)));
 		}
 		else {
 			double sum=0.0;
 			long i;
 			for(i=0;i<=N;i++) {
 				if (i != j) {
-					sum += delta(i,N)*pow(-1.0,(int) (i+j))/(delta(j,N)*(x(j+1)-x(i+1)));
+					sum += delta(i,N)*parity_sign(i+j)/(delta(j,N)*(x(j+1)-x(i+1)));
 				}
 			}
 			D(j+1,l+1) = -sum;
@@ -472,3 +619,390 @@ void cglnodes(int N, DMatrix& x, DMatrix& w,  DMatrix& D, Workspace* workspace)
   return;
 
 }
+
+
+void hp_uniform_mesh(int N, int degree, DMatrix& breaks, DMatrix& degrees)
+{
+// Splits [-1,1] into segments of about the given polynomial degree so that the
+// degrees add up to N. Segment widths are proportional to their degree.
+//
+  int s, p;
+
+  int nseg = (int) floor( ((double) N)/degree + 0.5 );
+
+  if (nseg < 1) nseg = 1;
+
+  breaks.Resize(nseg+1,1);
+  degrees.Resize(nseg,1);
+
+  breaks(1) = -1.0;
+
+  for (s=0; s<nseg; s++) {
+      p = N/nseg + ( (s < N%nseg)? 1 : 0 );
+      degrees(s+1)  = p;
+      breaks(s+2)   = breaks(s+1) + 2.0*p/N;
+  }
+
+  breaks(nseg+1) = 1.0;
+
+}
+
+
+void hp_lgl_mesh_nodes(DMatrix& breaks, DMatrix& degrees, DMatrix& x, DMatrix& w, DMatrix& D)
+{
+// Nodes, weights and differentiation matrix for multi-interval Legendre
+// collocation on the segments [breaks(s), breaks(s+1)] of degree degrees(s).
+// Each segment carries its own LGL nodes. Neighbouring segments share their
+// boundary node, which enforces state continuity, and the rows of the shared
+// nodes combine both segments weighted by their quadrature weights as in
+// spectral element assembly. D is therefore block diagonal with overlapping
+// corners, and the nodes are returned in ascending order.
+//
+  long k, r, c;
+  int  s, p;
+
+  int  nseg = length(degrees);
+  long N    = 0;
+
+  for (s=1; s<=nseg; s++) N += (long) degrees(s);
+
+  long N1 = N+1;
+
+  x.Resize(N1,1);
+  w.Resize(N1,1);
+  w.FillWithZeros();
+  D.Resize(N1,N1);
+  D.FillWithZeros();
+
+  DMatrix xs, PN, lambda, Ds;
+
+  long first = 1;
+
+  for (s=1; s<=nseg; s++) {
+
+      p = (int) degrees(s);
+
+      double a = breaks(s);
+      double h = breaks(s+1) - breaks(s);
+
+      lgl_nodes_golub_welsch(p, xs, PN);
+
+      lambda = elemDivision( ones(p+1,1), PN );
+
+      barycentric_diffmat( Ds, xs, lambda );
+
+      // xs is in descending order: local node r (ascending) is xs(p+1-r)
+      for (r=0; r<=p; r++) {
+          long   kr = p+1-r;
+          double wr = h/(p*(p+1)*PN(kr)*PN(kr));
+          k = first + r;
+          x(k) = a + 0.5*h*( xs(kr) + 1.0 );
+          for (c=0; c<=p; c++) {
+              D(k,first+c) += wr*(2.0/h)*Ds(kr,p+1-c);
+          }
+          w(k) += wr;
+      }
+
+      first += p;
+  }
+
+  x(1)  = breaks(1);
+  x(N1) = breaks(nseg+1);
+
+  for (k=1; k<=N1; k++) {
+      for (c=1; c<=N1; c++) {
+          if ( D(k,c) != 0.0 ) D(k,c) /= w(k);
+      }
+  }
+
+}
+
+
+void hp_lgl_nodes(int N, int degree, DMatrix& x, DMatrix& w, DMatrix& D)
+{
+// Multi-interval Legendre collocation tables on a uniform segment layout
+
+  DMatrix breaks, degrees;
+
+  hp_uniform_mesh(N, degree, breaks, degrees);
+
+  hp_lgl_mesh_nodes(breaks, degrees, x, w, D);
+
+}
+
+
+void get_hp_nodes(int N, DMatrix& breaks, DMatrix& degrees, DMatrix& snodes, DMatrix& sindex, DMatrix& w, DMatrix& P, DMatrix& D, DMatrix& De, DMatrix& Do, Workspace* workspace)
+{
+// Tables for Legendre-hp collocation. A segment layout left in breaks and
+// degrees by the hp-adaptive mesh refinement is used when its degrees add up
+// to N, otherwise the phase is split uniformly and the cached tables are used.
+
+  int  s;
+  long ndeg = 0;
+
+  for (s=1; s<=degrees.GetNoRows()*degrees.GetNoCols(); s++) ndeg += (long) degrees(s);
+
+  if ( ndeg == N && N > 0 ) {
+      hp_lgl_mesh_nodes( breaks, degrees, snodes, w, D );
+      sindex = colon(1, N+1);
+      De.Resize(0,0);
+      Do.Resize(0,0);
+  }
+  else {
+      hp_uniform_mesh( N, workspace->algorithm->hp_segment_degree, breaks, degrees );
+      get_ps_nodes( N, snodes, sindex, w, P, D, De, Do, workspace );
+  }
+
+}
+
+
+bool even_odd_split_diffmat(DMatrix& D, DMatrix& De, DMatrix& Do)
+{
+// The LGL and CGL node sets are symmetric about zero and their
+// differentiation matrices are centro-antisymmetric, D(N-i,N-j) = -D(i,j)
+// (zero based). Writing u as the sum of its even part e_j = (u_j+u_{N-j})/2
+// and odd part o_j = (u_j-u_{N-j})/2, the product D*u follows from two
+// products of half size:
+//
+//   a = E*e,  b = O*o,   (D*u)_i = a_i + b_i,  (D*u)_{N-i} = b_i - a_i
+//
+// with E(i,j) = D(i,j)+D(i,N-j) and O(i,j) = D(i,j)-D(i,N-j) for i,j < h,
+// h = N/2+1. When N is even the middle column of E is D(i,N/2) and that of
+// O is zero. The half matrices are returned transposed, so that column i of
+// De and Do holds row i of E and O.
+//
+// D is made exactly centro-antisymmetric, so that the full and the split
+// products agree. Returns false, with De and Do empty, when D does not have
+// the symmetry.
+
+  int n = D.GetNoRows();
+  int N = n-1;
+  int h = N/2+1;
+  int i, j;
+
+  De.Resize(0,0);
+  Do.Resize(0,0);
+
+  if ( n < 2 || D.GetNoCols() != n )
+      return false;
+
+  double dmax = 0.0;
+  double emax = 0.0;
+
+  for (i=1; i<=n; i++) {
+      for (j=1; j<=n; j++) {
+          dmax = MAX( dmax, fabs(D(i,j)) );
+          emax = MAX( emax, fabs(D(i,j)+D(n+1-i,n+1-j)) );
+      }
+  }
+
+  if ( emax > 1.e-8*dmax )
+      return false;
+
+  for (i=1; i<=h; i++) {
+      for (j=1; j<=n; j++) {
+          double dij = 0.5*( D(i,j)-D(n+1-i,n+1-j) );
+          D(i,j)         =  dij;
+          D(n+1-i,n+1-j) = -dij;
+      }
+  }
+
+  De.Resize(h,h);
+  Do.Resize(h,h);
+
+  for (i=0; i<h; i++) {
+      for (j=0; j<h; j++) {
+          if ( j == N-j ) {
+              De(j+1,i+1) = D(i+1,j+1);
+              Do(j+1,i+1) = 0.0;
+          }
+          else {
+              De(j+1,i+1) = D(i+1,j+1)+D(i+1,N-j+1);
+              Do(j+1,i+1) = D(i+1,j+1)-D(i+1,N-j+1);
+          }
+      }
+  }
+
+  return true;
+
+}
+
+
+template <class T>
+static void even_odd_rows(const T* u, int ustride, T* du, int dustride, int N, DMatrix& De, DMatrix& Do, int first, int last, T* e, T* o)
+{
+  // Rows first to last (zero based) of D*u from the split of D. e and o are
+  // work arrays of N/2+1 elements.
+  int h = N/2+1;
+  int i, j, r;
+  const double* pe = De.GetPr();
+  const double* po = Do.GetPr();
+
+  for (j=0; j<h; j++) {
+      e[j] = 0.5*( u[j*ustride] + u[(N-j)*ustride] );
+      o[j] = 0.5*( u[j*ustride] - u[(N-j)*ustride] );
+  }
+
+  for (r=first; r<=last; r++) {
+      i = (r<h)? r : N-r;
+      const double* ei = pe + i*h;
+      const double* oi = po + i*h;
+      T a = 0.0;
+      T b = 0.0;
+      for (j=0; j<h; j++) {
+          if (ei[j]!=0.0) a += ei[j]*e[j];
+          if (oi[j]!=0.0) b += oi[j]*o[j];
+      }
+      if (r<h) du[r*dustride] = a+b;
+      else     du[r*dustride] = b-a;
+  }
+
+}
+
+
+void even_odd_diff_product(const double* u, int ustride, double* du, int dustride, int N, DMatrix& De, DMatrix& Do, int first, int last)
+{
+  // Rows first to last (zero based) of D*u, with the entries of u and du
+  // ustride and dustride elements apart.
+  double* e = new double[N/2+1];
+  double* o = new double[N/2+1];
+
+  even_odd_rows(u, ustride, du, dustride, N, De, Do, first, last, e, o);
+
+  delete[] e;
+  delete[] o;
+}
+
+
+void even_odd_diff_product_ad(adouble* states, int stride, adouble* derivs, int nstates, int N, DMatrix& De, DMatrix& Do, int first, int last)
+{
+  // As mtrx_mul_trans_strided() with the differentiation matrix, for rows
+  // first to last: state j at node l is read from states[l*stride+j] and its
+  // derivative is written to derivs[l*nstates+j].
+  adouble* e = new adouble[N/2+1];
+  adouble* o = new adouble[N/2+1];
+  int j;
+
+  for (j=0; j<nstates; j++) {
+      even_odd_rows(states+j, stride, derivs+j, nstates, N, De, Do, first, last, e, o);
+  }
+
+  delete[] e;
+  delete[] o;
+}
+
+
+// Process-wide cache of pseudospectral nodes, quadrature weights and
+// differentiation matrices. The tables depend only on the collocation method,
+// the number of intervals, the hp segment degree and the differentiation
+// matrix option, so they are computed once and reused by every phase, mesh
+// iteration and call to psopt().
+
+struct ps_table_str {
+      string          method;
+      string          diff_matrix;
+      int             N;
+      int             degree;
+      DMatrix         snodes;
+      DMatrix         sindex;
+      DMatrix         w;
+      DMatrix         P;
+      DMatrix         D;
+      DMatrix         De;
+      DMatrix         Do;
+      ps_table_str*   next;
+};
+
+static ps_table_str*  ps_table_cache = NULL;
+
+static std::mutex     ps_table_mutex;
+
+
+void get_ps_nodes(int N, DMatrix& snodes, DMatrix& sindex, DMatrix& w, DMatrix& P, DMatrix& D, DMatrix& De, DMatrix& Do, Workspace* workspace)
+{
+// Returns the sorted collocation nodes, sorting index, weights, Legendre
+// Vandermonde matrix and differentiation matrix for the collocation method in
+// use, taking them from the cache when they have been computed before.
+// De and Do receive the even-odd split of D, and are empty when it is not
+// used.
+
+  const string& method      = workspace->algorithm->collocation_method;
+  const string& diff_matrix = workspace->differential_defects;
+
+  int degree = use_hp_collocation(*workspace->algorithm)? workspace->algorithm->hp_segment_degree : 0;
+
+  std::lock_guard<std::mutex> lock(ps_table_mutex);
+
+  ps_table_str* entry;
+
+  for (entry = ps_table_cache; entry != NULL; entry = entry->next) {
+      if ( entry->N == N && entry->degree == degree && entry->method == method && entry->diff_matrix == diff_matrix )
+          break;
+  }
+
+  if (entry == NULL) {
+
+      entry = new ps_table_str;
+
+      entry->method      = method;
+      entry->diff_matrix = diff_matrix;
+      entry->N           = N;
+      entry->degree      = degree;
+
+      entry->D.Resize(N+1,N+1);
+      entry->D.FillWithZeros();
+
+      if ( method == "Legendre" ) {
+          lglnodes( N, entry->snodes, entry->w, entry->P, entry->D, workspace );
+      }
+      else if ( method == "Chebyshev" ) {
+          cglnodes( N, entry->snodes, entry->w, entry->D, workspace );
+      }
+      else if ( method == "Legendre-hp" ) {
+          hp_lgl_nodes( N, degree, entry->snodes, entry->w, entry->D );
+      }
+      else {
+          delete entry;
+          error_message("get_ps_nodes: collocation method is not pseudospectral");
+      }
+
+      sort( entry->snodes, entry->sindex );
+
+      entry->w = (entry->w)(entry->sindex);
+
+      // The block-sparse hp matrix is better used as it is
+      if ( method != "Legendre-hp" ) {
+          even_odd_split_diffmat( entry->D, entry->De, entry->Do );
+      }
+
+      entry->next    = ps_table_cache;
+      ps_table_cache = entry;
+  }
+
+  snodes = entry->snodes;
+  sindex = entry->sindex;
+  w      = entry->w;
+  D      = entry->D;
+  De     = entry->De;
+  Do     = entry->Do;
+
+  if ( method == "Legendre" ) {
+      P = entry->P;
+  }
+
+}
+
+
+void clear_ps_nodes_cache()
+{
+  std::lock_guard<std::mutex> lock(ps_table_mutex);
+
+  while (ps_table_cache != NULL) {
+      ps_table_str* entry = ps_table_cache;
+      ps_table_cache = entry->next;
+      delete entry;
+  }
+
+  clear_fft_plan_cache();
+
+}
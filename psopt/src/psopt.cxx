@@ -60,7 +60,7 @@ void psopt_main(Sol& solution, Prob& problem, Alg& algorithm)
 {
 // PSOPT:  main algorithm
 
-int MAX_STANDARD_PS_NODES = 200;
+int MAX_STANDARD_PS_NODES = 2000;
 
 string startup_message= "\n *******************************************************************************\n * This is PSOPT, an optimal control solver based on pseudospectral and local  *\n * collocation methods, together with large scale nonlinear programming        *";
 
@@ -94,6 +94,7 @@ string contact_notice=  "\n * The author can be contacted at his email address:
   int i, k;
   int iter_nodes;
   int hotflag = 0;
+  string polish_defects;
   int x_phase_offset = 0;
   int lam_phase_offset = 0;
 
@@ -141,6 +142,14 @@ string contact_notice=  "\n * The author can be contacted at his email address:
              workspace->differential_defects = "Hermite-Simpson";
     }
 
+    else if (algorithm.collocation_method == "Lobatto-IIIA") {
+             workspace->differential_defects = "Lobatto-IIIA";
+    }
+
+    else if (use_hp_collocation(algorithm)) {
+             workspace->differential_defects = "standard";
+    }
+
     else if (use_global_collocation(algorithm)) {
           if (algorithm.diff_matrix=="standard") {
              workspace->differential_defects = "standard";
@@ -153,11 +162,20 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 	  else if (algorithm.diff_matrix=="central-differences") {
              workspace->differential_defects = "central-differences";
 	  }
+
+	  else if (algorithm.diff_matrix=="dct") {
+             workspace->differential_defects = "dct";
+	  }
     }
 
 
 
-    if (algorithm.mesh_refinement == "manual" )
+    if ( works.polish_mesh ) {
+          // The previous mesh met the ODE tolerance: solve it again to the full NLP tolerance
+	  workspace->differential_defects = polish_defects;
+    }
+
+    else if (algorithm.mesh_refinement == "manual" )
     {
 	for (i=0; i<nphases; i++)
 	{
@@ -165,6 +183,21 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 	}
     }
 
+    else  if (algorithm.mesh_refinement=="automatic" && use_hp_collocation(algorithm)  ) {
+          // hp-adaptive refinement: raise the degree of smooth segments and split the others
+
+          if ( iter_nodes == 1 ) {
+	    	for (i=0; i<nphases; i++)
+		{
+		    problem.phase[i].current_number_of_intervals    = ( (int) problem.phase[i].nodes(iter_nodes)) -1;
+		}
+	  }
+
+	  else {
+	        hp_refine_mesh(problem,algorithm,solution, workspace);
+	  }
+    }
+
     else  if (algorithm.mesh_refinement=="automatic" && use_global_collocation(algorithm)  ) {
 
           if ( iter_nodes == 1 ) {
@@ -192,7 +225,7 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 		{
 		    problem.phase[i].current_number_of_intervals    = ( (int) problem.phase[i].nodes(iter_nodes)) -1;
 		}
-		if ( workspace->differential_defects != "trapezoidal" && algorithm.switch_order > 0) {
+		if ( workspace->differential_defects != "trapezoidal" && algorithm.switch_order > 0 && !use_lobatto_collocation(algorithm) ) {
 		     workspace->differential_defects = "trapezoidal";
 		}
 	  }
@@ -200,7 +233,7 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 	  else if (iter_nodes == 2) {
 	      bool equi_error = check_for_equidistributed_error(problem,algorithm,solution);
 
-	      if (equi_error && algorithm.switch_order>0) {
+	      if (equi_error && algorithm.switch_order>0 && !use_lobatto_collocation(algorithm) ) {
 		   workspace->differential_defects = "Hermite-Simpson";
 	      }
 	  }
@@ -234,6 +267,15 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 
     }
 
+    if ( use_lobatto_collocation(algorithm) ) {
+          // Lobatto IIIA needs groups of three intervals
+	  for (i=0; i<nphases; i++)
+	  {
+	      int ngroups = MAX( 1, (problem.phase[i].current_number_of_intervals+2)/3 );
+	      problem.phase[i].current_number_of_intervals = 3*ngroups;
+	  }
+    }
+
     works.trace_f_done = false;
 
     works.nvars     = get_number_nlp_vars(problem, workspace);
@@ -257,9 +299,7 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 		    // When using automatic mesh refinement, switch to central differences when the order is too large to avoid numerical problems.
 		    workspace->differential_defects="central-differences";
 		 }
-        	 lglnodes( problem.phase[i].current_number_of_intervals, works.snodes[i], works.w[i], works.P[i], works.D[i], workspace);
-         	 sort(works.snodes[i],works.sindex[i]);
-         	 works.w[i] = (works.w[i])(works.sindex[i]);
+        	 get_ps_nodes( problem.phase[i].current_number_of_intervals, works.snodes[i], works.sindex[i], works.w[i], works.P[i], works.D[i], works.D_even[i], works.D_odd[i], workspace);
 
     	}
     }
@@ -268,14 +308,21 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 
 	    for(i=0; i<nphases; i++)
     	    {
-	         if (problem.phase[i].current_number_of_intervals > MAX_STANDARD_PS_NODES && algorithm.mesh_refinement=="automatic")
+	         if (problem.phase[i].current_number_of_intervals > MAX_STANDARD_PS_NODES && algorithm.mesh_refinement=="automatic" && !use_dct_differentiation(algorithm))
 		 {
 		    // When using automatic mesh refinement, switch to central differences when the order is too large to avoid numerical problems.
 		    workspace->differential_defects="central-differences";
 		 }
-         	cglnodes( problem.phase[i].current_number_of_intervals, works.snodes[i], works.w[i], works.D[i], workspace );
-         	sort(works.snodes[i],works.sindex[i]);
-         	works.w[i] = (works.w[i])(works.sindex[i]);
+         	get_ps_nodes( problem.phase[i].current_number_of_intervals, works.snodes[i], works.sindex[i], works.w[i], works.P[i], works.D[i], works.D_even[i], works.D_odd[i], workspace );
+            }
+
+    }
+
+    else if ( use_hp_collocation(algorithm) ) {
+
+	    for(i=0; i<nphases; i++)
+    	    {
+         	get_hp_nodes( problem.phase[i].current_number_of_intervals, works.hp_breaks[i], works.hp_degrees[i], works.snodes[i], works.sindex[i], works.w[i], works.P[i], works.D[i], works.D_even[i], works.D_odd[i], workspace );
             }
 
     }
@@ -284,11 +331,33 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 
 	    for(i=0; i<nphases; i++)
     	    {
-	        works.snodes[i] = linspace(-1.0, 1.0, problem.phase[i].current_number_of_intervals+1);
+	        if ( use_lobatto_collocation(algorithm) ) {
+		    DMatrix breaks = linspace(-1.0, 1.0, problem.phase[i].current_number_of_intervals/3+1);
+		    lobatto_iiia_nodes( breaks, works.snodes[i] );
+		}
+		else {
+	            works.snodes[i] = linspace(-1.0, 1.0, problem.phase[i].current_number_of_intervals+1);
+		}
             }
 
     }
 
+    if ( use_lobatto_collocation(algorithm) ) {
+	    for(i=0; i<nphases; i++)
+    	    {
+	        lobatto_iiia_weights( works.snodes[i], works.w[i] );
+            }
+    }
+
+    // Barycentric weights for the Lagrange interpolation of the states between the nodes
+
+    if ( use_global_collocation(algorithm) && !use_hp_collocation(algorithm) ) {
+	    for(i=0; i<nphases; i++)
+    	    {
+	        barycentric_weights( works.bary_weights[i], works.snodes[i] );
+            }
+    }
+
 
     // Define initial NLP guess
     if (iter_nodes==1) {
@@ -346,14 +415,45 @@ string contact_notice=  "\n * The author can be contacted at his email address:
     sprintf(workspace->text,"\n");
     psopt_print(workspace,workspace->text);
 
+    set_nlp_tolerance_schedule(problem, algorithm, solution, iter_nodes, number_of_mesh_refinement_iterations, workspace);
+
+    set_hessian_schedule(problem, algorithm, solution, iter_nodes, number_of_mesh_refinement_iterations, workspace);
+
+    works.polish_mesh = false;
+
+    if ( algorithm.nlp_tolerance_schedule == "adaptive" ) {
+      sprintf(workspace->text, "\nNLP tolerance for this mesh:\t\t\t\t%e", works.nlp_tolerance );
+      psopt_print(workspace,workspace->text);
+    }
+
+    if ( algorithm.hessian == "adaptive" ) {
+      sprintf(workspace->text, "\nHessian for this mesh:\t\t\t\t\t%s", solution.mesh_stats[iter_nodes-1].hessian.c_str() );
+      psopt_print(workspace,workspace->text);
+    }
+
     workspace->enable_nlp_counters = true;
 
     chronometer_tic(workspace);
 
     NLP_interface( algorithm, &x0,  ff_num, gg_num, nlp_ncons,  nlp_neq , &xlb, &xub, &lambda, hotflag, 1, workspace, problem.user_data   );
 
+    if ( works.hessian_switch_requested ) {
+      // The limited-memory solve stalled: continue from its last iterate with the exact Hessian
+      psopt_print(workspace,"\n>>> PSOPT: slow NLP progress with the limited-memory Hessian, switching to the exact Hessian\n");
+      works.exact_hessian            = true;
+      works.hessian_switch_requested = false;
+      works.trace_f_done             = false;
+      solution.mesh_stats[iter_nodes-1].hessian = "limited-memory/exact";
+      NLP_interface( algorithm, &x0,  ff_num, gg_num, nlp_ncons,  nlp_neq , &xlb, &xub, &lambda, 1, 1, workspace, problem.user_data   );
+    }
+
     solution.mesh_stats[workspace->current_mesh_refinement_iteration-1].CPU_time = chronometer_toc(workspace);
 
+    if ( solution.mesh_stats[iter_nodes-1].hessian != "limited-memory" ) {
+      sprintf(workspace->text, "\nHessian setup time (sec):\t\t\t\t%e", solution.mesh_stats[iter_nodes-1].hessian_setup_time );
+      psopt_print(workspace,workspace->text);
+    }
+
     workspace->enable_nlp_counters = false;
 
     // Copy the resultant decision vector into the relevant solution variables.
@@ -390,9 +490,12 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 
         int ncons_phase_i =  get_ncons_phase_i(problem,i, workspace);
 
-	solution.dual.costates[i] = lambda(colon(lam_phase_offset+1,lam_phase_offset+nstates*(norder+1) ) ) ;
+	solution.dual.costates[i].Resize(nstates, norder+1);
 
-	solution.dual.costates[i] = reshape(solution.dual.costates[i], nstates, norder+1);
+	for(k=1;k<=norder+1;k++) {
+	    offset = lam_phase_offset+get_defect_offset(problem,i,k,workspace);
+	    (solution.dual.costates[i])(colon(),k) = lambda(colon(offset+1,offset+nstates));
+	}
 
 	workspace->prev_costates[i]      = solution.dual.costates[i];
 
@@ -400,13 +503,32 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 	tf = (solution.nodes[i])("end");
 
 
-	if ( algorithm.collocation_method=="Legendre" ) {
+	if ( algorithm.collocation_method=="Legendre" || use_hp_collocation(algorithm) ) {
 	    for(k=1;k<=norder+1;k++) {
 		   (solution.dual.costates[i])(colon(),k) = (solution.dual.costates[i])(colon(),k)/(works.w[i])(k);  // See PhD thesis by Huntington (2006).
 	    }
 	}
 
-	if (use_local_collocation(algorithm)) {
+	if (use_lobatto_collocation(algorithm)) {
+	    // The Lobatto IIIA adjoint is the Lobatto IIIB scheme: the costate at stage m of a group is
+	    // sum_i a_im*nu_i/b_m, where nu_i are the multipliers of the stage equations of the group.
+	    double A[16], c[4];
+	    lobatto_iiia_tableau(A, c);
+	    DMatrix nu = solution.dual.costates[i];
+	    for(int g=1;g<=norder/3;g++) {
+	         int k0 = 3*(g-1)+1;
+	         hk = (solution.nodes[i])(k0+3)-(solution.nodes[i])(k0);
+	         for(int m=0;m<4;m++) {
+	              DMatrix lam = zeros(nstates,1);
+	              for(int s=1;s<4;s++) {
+	                   lam += (A[4*s+m]/A[12+m])*nu(colon(),k0+s-1);
+	              }
+	              (solution.dual.costates[i])(colon(),k0+m) = lam*(tf-t0)/(2.0*hk);
+	         }
+	    }
+	}
+
+	else if (use_local_collocation(algorithm)) {
        for(k=1;k<=norder;k++) {
 	         // For local collocation, this is an estimate of the costate.
 	         hk = (solution.nodes[i])(k+1)-(solution.nodes[i])(k);
@@ -434,9 +556,10 @@ string contact_notice=  "\n * The author can be contacted at his email address:
    solution.dual.costates[i] = solution.dual.costates[i]/problem.scale.objective;
 
    if ( algorithm.scaling=="automatic" ) {
-	  solution.dual.costates[i] = reshape(solution.dual.costates[i], nstates*(norder+1), 1 );
-          solution.dual.costates[i] = elemProduct( solution.dual.costates[i],  (*works.constraint_scaling)(colon(lam_phase_offset+1,lam_phase_offset+nstates*(norder+1) )) );
-	  solution.dual.costates[i] = reshape(solution.dual.costates[i], nstates, norder+1);
+	  for(k=1;k<=norder+1;k++) {
+	      offset = lam_phase_offset+get_defect_offset(problem,i,k,workspace);
+	      (solution.dual.costates[i])(colon(),k) = elemProduct( (solution.dual.costates[i])(colon(),k),  (*works.constraint_scaling)(colon(offset+1,offset+nstates)) );
+	  }
    }
 
    if ( algorithm.collocation_method == "Chebyshev") {
@@ -533,7 +656,7 @@ string contact_notice=  "\n * The author can be contacted at his email address:
     }
 
 
-	if ( use_local_collocation(algorithm) ) {
+	if ( use_local_collocation(algorithm) && !use_lobatto_collocation(algorithm) ) {
         // use linear extrapolation to approximate the costate values at the collocation nodes...
         pint = solution.dual.costates[i](colon(),colon(1,norder));
 		for(int k=1;k<=norder;k++) {
@@ -561,7 +684,7 @@ string contact_notice=  "\n * The author can be contacted at his email address:
      }
 
 
-	offset = lam_phase_offset+nstates*(norder+1);
+	offset = lam_phase_offset+get_event_offset(problem,i,workspace);
 
 	if (   algorithm.nlp_method == "IPOPT"   ) {
                 solution.dual.costates[i] = -solution.dual.costates[i];
@@ -583,10 +706,12 @@ string contact_notice=  "\n * The author can be contacted at his email address:
                 solution.dual.events[i] = -solution.dual.events[i];
     }
 
-	offset = offset+nevents;
 	if (npath>0) {
-	     solution.dual.path[i]      = -lambda(colon(offset+1,offset+npath*(norder+1)));
-	     solution.dual.path[i]      = reshape(solution.dual.path[i], npath, norder+1);
+	     solution.dual.path[i].Resize(npath, norder+1);
+	     for(k=1;k<=norder+1;k++) {
+	         offset = lam_phase_offset+get_path_offset(problem,i,k,workspace);
+	         (solution.dual.path[i])(colon(),k) = -lambda(colon(offset+1,offset+npath));
+	     }
 	     workspace->prev_path[i] = -(solution.dual.path[i]);
 	     if (use_local_collocation(algorithm)) {
         	for (k=1;k<=norder;k++) {
@@ -606,6 +731,13 @@ string contact_notice=  "\n * The author can be contacted at his email address:
                         (solution.dual.path[i])(colon(),k) = -(solution.dual.path[i])(colon(),k)*(2.0/(hk+hk_1));
                     }
         	    }
+           	    if ( algorithm.collocation_method == "Lobatto-IIIA") {
+           	        // The path constraints are enforced at the nodes, so the multipliers are
+           	        // divided by the Lobatto quadrature weights in time units.
+                        double tk0 = (solution.nodes[i])(1);
+                        double tkf = (solution.nodes[i])("end");
+                        (solution.dual.path[i])(colon(),k) = -(solution.dual.path[i])(colon(),k)/( 0.5*(tkf-tk0)*(works.w[i])(k) );
+           	    }
            	    if ( algorithm.collocation_method == "Hermite-Simpson") {
            	        // These are the path constraint adjoint estimates for Hermite-Simpson discretization
            	        // See Betts (2010), p. 177.
@@ -651,7 +783,7 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 //                }
 	     }
 
-	     if ( algorithm.collocation_method == "Legendre") {
+	     if ( algorithm.collocation_method == "Legendre" || use_hp_collocation(algorithm) ) {
              for (k=1;k<=norder+1;k++) {
 	     		(solution.dual.path[i])(colon(),k) = -(solution.dual.path[i])(colon(),k)/(works.w[i])(k);  // See PhD thesis by Huntington (2006).
 	     		(solution.dual.path[i])(colon(),k) = (solution.dual.path[i])(colon(),k)*(2.0/(tf-t0));
@@ -685,15 +817,14 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 
          if (algorithm.scaling=="automatic") {
              for (k=1;k<=norder+1;k++) {
-  	            solution.dual.path[i](colon(),k) =elemProduct( solution.dual.path[i](colon(),k),(*works.constraint_scaling)(colon(offset+(k-1)*npath+1,offset+k*npath)));
+                    offset = lam_phase_offset+get_path_offset(problem,i,k,workspace);
+  	            solution.dual.path[i](colon(),k) =elemProduct( solution.dual.path[i](colon(),k),(*works.constraint_scaling)(colon(offset+1,offset+npath)));
   	         }
          }
          solution.dual.path[i] /= problem.scale.objective;
 
 	}
 
-    offset = offset + npath*(norder+1);
-
 
     compute_derivatives_trajectory( workspace->Xdot[i], problem, solution, iphase, workspace );
 
@@ -722,7 +853,7 @@ string contact_notice=  "\n * The author can be contacted at his email address:
            *solution.dual.linkages = (*solution.dual.linkages)&problem.scale.linkages;
          }
          if (algorithm.scaling=="automatic") {
-           *solution.dual.linkages = elemProduct( (*solution.dual.linkages),   (*works.constraint_scaling)(colon(offset+1,offset+problem.nlinkages))    );
+           *solution.dual.linkages = elemProduct( (*solution.dual.linkages),   (*works.constraint_scaling)(colon(lam_phase_offset+1,lam_phase_offset+problem.nlinkages))    );
          }
          *solution.dual.linkages /= problem.scale.objective;
 
@@ -749,6 +880,14 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 
 
 
+       if (mr_phase_convergence_count == problem.nphases && works.nlp_tolerance > algorithm.nlp_tolerance && iter_nodes < number_of_mesh_refinement_iterations) {
+	    psopt_print(workspace,"\n>>> PSOPT: the ODE tolerance has been met with a loose NLP tolerance,");
+	    psopt_print(workspace,"\n>>> the same mesh is now solved to algorithm.nlp_tolerance\n");
+	    works.polish_mesh = true;
+	    polish_defects    = workspace->differential_defects;
+	    continue;
+       }
+
        if (mr_phase_convergence_count == problem.nphases ) {
 	    psopt_print(workspace,"\n>>> PSOPT: automatic mesh refinement iterations converged as the maximum");
 	    psopt_print(workspace,"\n>>> relative error in all phases is lower than algorithm.ode_tolerance\n");
@@ -757,7 +896,7 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 
     }
 
-    if (algorithm.mesh_refinement == "automatic" && iter_nodes>= algorithm.mr_min_extrapolation_points && use_global_collocation(algorithm) && iter_nodes<number_of_mesh_refinement_iterations  )
+    if (algorithm.mesh_refinement == "automatic" && iter_nodes>= algorithm.mr_min_extrapolation_points && use_global_collocation(algorithm) && !use_hp_collocation(algorithm) && iter_nodes<number_of_mesh_refinement_iterations  )
     {
 
 	   // Calculate the next number of nodes for each phase
@@ -790,6 +929,10 @@ string contact_notice=  "\n * The author can be contacted at his email address:
 
   }
 
+  // Free the nodes, weights and differentiation matrices kept for the mesh refinement iterations
+
+  clear_ps_nodes_cache();
+
 
 
   return;
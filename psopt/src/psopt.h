@@ -93,6 +93,7 @@ using namespace std;
 #include <adolc/adouble.h>
 #include <adolc/sparse/sparsedrivers.h>
 #include <adolc/taping.h>
+#include <adolc/externfcts.h>
 #endif
 
 
@@ -116,10 +117,16 @@ using namespace std;
 #include <adolc/adouble.h>
 #include <adolc/sparse/sparsedrivers.h>
 #include <adolc/taping.h>
+#include <adolc/externfcts.h>
 #endif
 
 #endif
 
+#ifdef USE_OPENMP
+#include <omp.h>
+#include <adolc/adolc_openmp.h>
+#endif
+
 #include <string>
 using std::string;
 
@@ -173,9 +180,14 @@ int     n_con_evals;
 int     n_jacobian_evals;
 int     n_hessian_evals;
 int     n_ode_rhs_evals;
+int     n_error_rhs_evals;
 double  epsilon_max;
 double  CPU_time;
 string  method;
+double  nlp_tolerance;
+int     nlp_iter_max;
+string  hessian;
+double  hessian_setup_time;
 } MeshStats;
 
 
@@ -203,13 +215,19 @@ struct alg_str {
   string    hessian;
   string    defect_scaling;
   string    diff_matrix;
+  string    nlp_variable_ordering;
   string    parameter_statistics;
   double    jac_sparsity_ratio;
   double    hess_sparsity_ratio;
   int       print_level; // 1: detailed output on screen and files (default), 0: no output
   int       save_sparsity_pattern;
   int       nsteps_error_integration;
+  string    error_integration; // "simpson" (fixed steps) or "gauss-kronrod" (adaptive G7/K15) for the ODE error
   int       parameter_estimation_norm;
+  int       nlp_threads; // threads used by the numerical NLP function evaluations (needs OpenMP)
+  int       hp_segment_degree; // polynomial degree of each segment with "Legendre-hp" collocation
+  int       hp_max_degree;     // largest segment degree reached by hp-adaptive mesh refinement
+  string    nlp_tolerance_schedule; // "fixed" or "adaptive": loose NLP tolerances on early meshes
 
 
   double    ode_tolerance;
@@ -218,10 +236,13 @@ struct alg_str {
   int       mr_min_extrapolation_points;
   int       mr_initial_increment;
   double    mr_kappa;
+  double    mr_coarsening_factor; // local refinement merges intervals whose predicted error is below this fraction of ode_tolerance (0: no coarsening)
   int       mr_M1;
   string    mesh_refinement;
   int       switch_order;
   double    ipopt_max_cpu_time;
+  double    mr_nlp_tolerance_factor; // loose NLP tolerance as a fraction of the previous mesh error
+  int       mr_nlp_iter_max;         // NLP iteration limit on meshes solved with a loose tolerance
 
 
 };
@@ -456,6 +477,90 @@ typedef struct {
     adouble* gad;
 } GRWORK;
 
+// Scratch arrays used to evaluate the constraints of a block of nodes, so that
+// blocks can be evaluated by different threads without sharing workspace buffers.
+
+typedef struct {
+    adouble* resid;
+    adouble* derivatives;
+    adouble* path;
+    adouble* derivatives_next;
+    adouble* path_next;
+    adouble* states_bar;
+    adouble* derivatives_bar;
+    adouble* path_bar;
+    adouble* derivs_traj;
+    adouble* states;       // Point values passed to the DAE by the ODE error evaluation
+    adouble* controls;
+    adouble* parameters;
+    double*  interp;       // Interpolated states, derivatives, controls and barycentric coefficients
+    double*  u_nodes;      // A state trajectory and its derivative, for the even-odd products
+    double*  du_nodes;
+} EvalScratch;
+
+// Memoised natural spline coefficients of the state and control trajectories of a phase,
+// valid for one evaluation of the decision vector xad. The entries are discarded when
+// invalidate_spline_cache() is called or when a different decision vector is passed.
+
+typedef struct {
+    long      stamp;       // Value of workspace->spline_cache_stamp when the entries were computed
+    adouble*  xad;         // Decision vector the entries were computed from
+    bool      time_valid;
+    adouble*  time;        // Node times in the original time scale
+    bool*     valid;       // One flag per trajectory: the states first, then the controls
+    adouble** y;           // Node values of each trajectory
+    adouble** d2y;         // Spline second derivatives of each trajectory
+    bool*     d2y_valid;
+} SplineCache;
+
+// Double precision interpolants of the states and controls of a phase, built once
+// from the NLP solution so that the discretisation error can be swept over many
+// time points without rebuilding the interpolating polynomials or splines. The
+// interpolant is not modified when evaluated, so it may be shared between threads.
+
+typedef struct {
+    int      iphase;
+    int      nnodes;
+    int      nstates;
+    int      ncontrols;
+    int      nparameters;
+    bool     lagrange;     // Barycentric Lagrange (true) or natural cubic spline (false) for the states
+    DMatrix  time;         // 1 x nnodes node times in the original time scale
+    DMatrix  X;            // nstates x nnodes node values of the states
+    DMatrix  U;            // ncontrols x nnodes node values of the controls
+    DMatrix  d2X;          // Spline second derivatives of the states (spline case only)
+    DMatrix  d2U;          // Spline second derivatives of the controls
+    DMatrix  w;            // Barycentric weights (Lagrange case only)
+    DMatrix  p;            // Static parameters of the phase
+} PhaseInterpolant;
+
+// Continuous time representation of the solution returned by psopt(), built once by
+// build_solution_interpolant() and sampled by evaluate_solution_interpolant().
+
+typedef struct {
+    int               nphases;
+    int               max_states;    // Maximum number of states over all the phases
+    int               max_controls;
+    int               max_nodes;
+    PhaseInterpolant* phase;         // The rows of phase[i].X are the states followed by the costates
+} SolutionInterpolant;
+
+// Interpolant of a function tabulated on a rectangular grid, built once by build_interpolation_table()
+// and evaluated by table_interpolation(), typically within the DAE. For cubic tables, the values and
+// all the mixed partial derivatives at each grid point are stored, so that each evaluation only
+// involves the corners of one grid cell.
+
+#define MAX_TABLE_DIMENSIONS 4
+
+typedef struct {
+    int      ndim;
+    int      npoints[MAX_TABLE_DIMENSIONS];
+    DMatrix  grid[MAX_TABLE_DIMENSIONS];     // Grid points along each dimension
+    double   spacing[MAX_TABLE_DIMENSIONS];  // Grid spacing along each dimension, or 0 if it is not uniform
+    bool     cubic;                          // Cubic Hermite (true) or multilinear (false) patches
+    int      nderiv;                         // Coefficients per grid point: 2^ndim if cubic, 1 otherwise
+    DMatrix  coeffs;                         // nderiv x number of grid points, the first dimension varying fastest
+} InterpolationTable;
 
 typedef struct {
   int nsegments;
@@ -489,6 +594,11 @@ struct work_str {
    DMatrix*  sindex;
    DMatrix*  w;
    DMatrix*  D;
+   DMatrix*  D_even;
+   DMatrix*  D_odd;
+   DMatrix*  bary_weights;   // Barycentric weights of the nodes of each phase (global collocation)
+   SplineCache* spline_cache;    // Memoised interpolation data of each phase
+   long      spline_cache_stamp;
    DMatrix*  D2;
    DMatrix*  snodes;
    DMatrix*  old_snodes;
@@ -538,12 +648,16 @@ struct work_str {
    DMatrix*  xp;
    DMatrix*  emax_history;
    DMatrix*  order_reduction;
+   DMatrix*  hp_breaks;
+   DMatrix*  hp_degrees;
    DMatrix*  old_relative_errors;
    DMatrix*  error_scaling_weights;
+   DMatrix*  inv_variable_scaling;
 
 
    double    obj_scaling;
    GRWORK*   grw;
+   EvalScratch* eval_scratch;
    int       nvars;
    int       ncons;
    int       **current_nodes;
@@ -572,6 +686,7 @@ struct work_str {
    double*   G2;
    adouble*  xad;
    adouble*  gad;
+   adouble*  xunscaled;
    adouble**  states;
    adouble**  controls;
    adouble**  parameters;
@@ -586,11 +701,13 @@ struct work_str {
    adouble**  states_traj;
    adouble**  derivs_traj;
    adouble**  second_derivs_traj;
+   adouble**  dct_xin;      // Per-phase arguments of the DCT external function
+   adouble**  dct_yout;
    adouble*   linkages;
    adouble*   fgad;
    adouble*   time_array_tmp;
    adouble*   single_trajectory_tmp;
-   adouble*   L_ad_tmp;
+   double*    bary_weights_tmp;
    adouble*   u_spline;
    adouble*   z_spline;
    adouble*   y2a_spline;
@@ -616,6 +733,13 @@ struct work_str {
    FILE*      mesh_statistics;
    FILE*      mesh_statistics_tex;
    int        current_mesh_refinement_iteration;
+   double     nlp_tolerance;
+   int        nlp_iter_max;
+   bool       polish_mesh;
+   bool       exact_hessian;
+   bool       hessian_switch_requested;
+   int        stall_reference_iter;
+   double     stall_reference_error;
    bool       auto_linked_flag;
    bool       enable_nlp_counters;
    string     differential_defects;
@@ -628,6 +752,20 @@ struct work_str {
   int tag_hess 	;
   int tag_fg 	;
   int tag_gc    ;
+  int tag_ode   ;
+
+// per-phase tapes used with IPOPT, tape nphases holds the linkage constraints
+
+  int  ntapes;
+  int* tag_g_tape;
+  int* tag_hess_tape;
+  int* jac_nnz_tape;
+  unsigned int** jac_rind_tape;
+  unsigned int** jac_cind_tape;
+  double**       jac_values_tape;
+  int* hess_nnz_tape;
+  int* hess_start_tape;
+  int* hess_map;
   void *user_data;
 
 };
@@ -672,6 +810,42 @@ void lglnodes(int N, DMatrix& x, DMatrix& w, DMatrix& P, DMatrix& D, Workspace*
 
 void cglnodes(int N, DMatrix& x, DMatrix& w,  DMatrix& D, Workspace* workspace);
 
+void symmetric_tridiagonal_eigenvalues(int n, double* d, double* e);
+
+void lgl_nodes_golub_welsch(int N, DMatrix& x, DMatrix& PN);
+
+void barycentric_diffmat(DMatrix& D, DMatrix& x, DMatrix& lambda);
+
+void hp_uniform_mesh(int N, int degree, DMatrix& breaks, DMatrix& degrees);
+
+void hp_lgl_mesh_nodes(DMatrix& breaks, DMatrix& degrees, DMatrix& x, DMatrix& w, DMatrix& D);
+
+void hp_lgl_nodes(int N, int degree, DMatrix& x, DMatrix& w, DMatrix& D);
+
+void get_hp_nodes(int N, DMatrix& breaks, DMatrix& degrees, DMatrix& snodes, DMatrix& sindex, DMatrix& w, DMatrix& P, DMatrix& D, DMatrix& De, DMatrix& Do, Workspace* workspace);
+
+bool even_odd_split_diffmat(DMatrix& D, DMatrix& De, DMatrix& Do);
+
+void even_odd_diff_product(const double* u, int ustride, double* du, int dustride, int N, DMatrix& De, DMatrix& Do, int first, int last);
+
+void even_odd_diff_product_ad(adouble* states, int stride, adouble* derivs, int nstates, int N, DMatrix& De, DMatrix& Do, int first, int last);
+
+void get_ps_nodes(int N, DMatrix& snodes, DMatrix& sindex, DMatrix& w, DMatrix& P, DMatrix& D, DMatrix& De, DMatrix& Do, Workspace* workspace);
+
+void clear_ps_nodes_cache();
+
+void chebyshev_dct_derivative(const double* u, int ustride, double* du, int dustride, int N);
+
+void chebyshev_dct_derivative_transpose(const double* v, int vstride, double* dv, int dvstride, int N);
+
+void chebyshev_dct_derivative_ad(adouble* states, int stride, adouble* derivs, int nstates, int N, adouble* xin, adouble* yout);
+
+void allocate_dct_buffers(adouble** xin, adouble** yout, int N);
+
+void chebyshev_differentiate(DMatrix& X, DMatrix& t, DMatrix& Xdot);
+
+void clear_fft_plan_cache();
+
 void copy_decision_variables(Sol& solution, DMatrix& x, Prob& problem, Alg& algorithm, Workspace* workspace);
 
 double ff( DMatrix& x );
@@ -696,6 +870,12 @@ void hot_start_nlp_guess(DMatrix& x0,DMatrix& lambda, Sol& solution,Prob& proble
 
 void lagrange_interpolation(DMatrix& y, DMatrix& x, DMatrix& pointx, DMatrix& pointy);
 
+void barycentric_weights(double* w, double* x, int n);
+
+void barycentric_weights(DMatrix& w, DMatrix& pointx);
+
+void barycentric_interpolation(DMatrix& Y, DMatrix& X, DMatrix& pointx, DMatrix& Pointy, DMatrix& w);
+
 double smooth_fabs(double x, double eps);
 
 adouble smooth_fabs(adouble x, double eps);
@@ -708,8 +888,22 @@ void JacobianRow( void fun(DMatrix& x, DMatrix* f, Workspace* ), DMatrix& x, int
 void JacobianColumn( void fun(DMatrix& x, DMatrix* f, Workspace* ), DMatrix& x, DMatrix& xlb, DMatrix& xub, int jCol,
                 DMatrix* JacColumn, GRWORK* grw, Workspace* workspace );
 
+void build_phase_interpolant(PhaseInterpolant& pint, int iphase, adouble* xad, Workspace* workspace);
+
+void evaluate_phase_interpolant(PhaseInterpolant& pint, double time, double* x, double* xdot, double* u, double* c);
+
+void build_solution_interpolant(SolutionInterpolant& sint, Sol& solution, Alg& algorithm);
+
+void evaluate_solution_interpolant(SolutionInterpolant& sint, DMatrix& time, DMatrix* states, DMatrix* controls, DMatrix* derivatives, DMatrix* costates);
+
+int  get_phase_at_time(SolutionInterpolant& sint, double time);
+
+void free_solution_interpolant(SolutionInterpolant& sint);
+
 void evaluate_matrix_of_integrated_errors_in_phase(DMatrix& eta, int iphase, adouble* xad, int nsteps, Workspace* workspace);
 
+void evaluate_matrix_of_integrated_errors_threaded(DMatrix* eta, adouble* xad, int nsteps, Workspace* workspace);
+
 void evaluate_solution(Prob& problem,Alg& algorithm,Sol& solution, Workspace* workspace);
 
 void compute_next_mesh_size( Prob& problem, Alg& algorithm, Sol& solution, Workspace* workspace );
@@ -720,6 +914,22 @@ void estimate_order_reduction(Prob& problem,Alg& algorithm,Sol& solution, Worksp
 
 void zero_order_reduction(Prob& problem,Alg& algorithm,Sol& solution, Workspace* workspace);
 
+double legendre_coefficient_decay_rate(DMatrix& u, int first, int p);
+
+void hp_refine_mesh(Prob& problem,Alg& algorithm,Sol& solution, Workspace* workspace);
+
+void set_nlp_tolerance_schedule(Prob& problem, Alg& algorithm, Sol& solution, int iter_nodes, int number_of_mesh_refinement_iterations, Workspace* workspace);
+
+void set_hessian_schedule(Prob& problem, Alg& algorithm, Sol& solution, int iter_nodes, int number_of_mesh_refinement_iterations, Workspace* workspace);
+
+void lobatto_iiia_tableau(double* A, double* c);
+
+void lobatto_iiia_nodes(DMatrix& breaks, DMatrix& snodes);
+
+void lobatto_iiia_weights(DMatrix& snodes, DMatrix& w);
+
+void lobatto_group_view(DMatrix& snodes, DMatrix& epsilon, DMatrix& breaks, DMatrix& epsilon_g);
+
 void construct_new_mesh(Prob& problem,Alg& algorithm,Sol& solution, Workspace* workspace);
 
 bool check_for_equidistributed_error(Prob& problem,Alg& algorithm,Sol& solution);
@@ -728,12 +938,32 @@ bool use_local_collocation(Alg & algorithm);
 
 bool use_global_collocation(Alg & algorithm);
 
+bool use_hp_collocation(Alg & algorithm);
+
+bool use_lobatto_collocation(Alg & algorithm);
+
+bool use_dct_differentiation(Alg & algorithm);
+
 void bilinear_interpolation(adouble* z, adouble& x, adouble& y, DMatrix& X, DMatrix& Y, DMatrix& Z);
 
 void spline_2d_interpolation(adouble* z, adouble& x, adouble& y, DMatrix& X, DMatrix& Y, DMatrix& Z, Workspace* workspace);
 
 void smooth_bilinear_interpolation(adouble* z, adouble& x, adouble& y, DMatrix& X, DMatrix& Y, DMatrix& Z);
 
+void build_interpolation_table(InterpolationTable& table, int ndim, DMatrix* grids, DMatrix& values, const string& method);
+
+void build_interpolation_table(InterpolationTable& table, DMatrix& X, DMatrix& Z, const string& method);
+
+void build_interpolation_table(InterpolationTable& table, DMatrix& X, DMatrix& Y, DMatrix& Z, const string& method);
+
+double table_interpolation(double* x, InterpolationTable& table);
+
+void table_interpolation(adouble* z, adouble* x, InterpolationTable& table);
+
+void table_interpolation(adouble* z, adouble& x, InterpolationTable& table);
+
+void table_interpolation(adouble* z, adouble& x, adouble& y, InterpolationTable& table);
+
 void smooth_linear_interpolation(adouble* y, adouble& x, adouble* Xdata, adouble* Ydata, int n);
 
 void get_times(adouble *t0, adouble *tf, adouble* xad, int iphase, Workspace* workspace);
@@ -852,10 +1082,16 @@ int get_number_of_phases(Prob& problem);
 
 void lagrange_interpolation_ad(adouble* y, adouble& x, adouble* pointx, adouble* pointy, int npoints, Workspace* workspace);
 
+void barycentric_interpolation_ad(adouble* y, adouble& x, adouble* pointx, adouble* pointy, double* w, int npoints);
+
 void linear_interpolation(adouble* y, adouble& x, adouble* pointx, adouble* pointy, int npoints);
 
 void linear_interpolation(DMatrix& y, double x, DMatrix& pointx, DMatrix& pointy, int npoints);
 
+void linear_interpolation(DMatrix& y, double x, DMatrix& pointx, DMatrix& pointy, int npoints, int* cursor);
+
+int locate_interval(double x, double* pointx, int npoints, int* cursor);
+
 void linear_interpolation(DMatrix& y, DMatrix& x, DMatrix& pointx, DMatrix& pointy, int npoints);
 
 void linear_interpolation(adouble* y, adouble x, DMatrix& pointx, DMatrix& pointy, int npoints);
@@ -866,6 +1102,14 @@ void spline_interpolation(adouble* y, adouble& x, adouble* pointx, adouble* poin
 
 void spline_interpolation(adouble* y, adouble& x, DMatrix& Xdata, DMatrix& Ydata, int n);
 
+void spline_second_derivative(DMatrix& xdata, DMatrix& ydata, int n,  DMatrix& d2y);
+
+void spline_second_derivative(adouble* x, adouble* y, int n,  adouble* d2y, Workspace* workspace);
+
+void spline_interpolation_with_second_derivative(adouble* y, adouble& x, adouble* xdata, adouble* ydata, adouble* y2d, int n);
+
+void invalidate_spline_cache(Workspace* workspace);
+
 void zoh_interpolation(adouble* y, adouble x, DMatrix& pointx, DMatrix& pointy, int npoints);
 
 
@@ -875,6 +1119,22 @@ adouble get_final_time(adouble* xad, int iphase, Workspace* workspace);
 
 void get_parameters(adouble* parameters, adouble* xad, int iphase, Workspace* workspace);
 
+void define_inverse_variable_scaling(Prob& problem, Workspace* workspace);
+
+void unscale_decision_variables(adouble* xad, adouble* xun, Workspace* workspace);
+
+void unscale_phase_variables(adouble* xad, adouble* xun, int i, Workspace* workspace);
+
+void get_unscaled_times(adouble *t0, adouble *tf, adouble* xun, int iphase, Workspace* workspace);
+
+adouble* get_unscaled_states_ptr(adouble* xun, int iphase, int k, Workspace* workspace);
+
+adouble* get_unscaled_controls_ptr(adouble* xun, int iphase, int k, Workspace* workspace);
+
+adouble* get_unscaled_controls_bar_ptr(adouble* xun, int iphase, int k, Workspace* workspace);
+
+adouble* get_unscaled_parameters_ptr(adouble* xun, int iphase, Workspace* workspace);
+
 bool useAutomaticDifferentiation(Alg& algorithm);
 
 void gg_ad( adouble* xad, adouble* gad, Workspace* workspace );
@@ -883,6 +1143,33 @@ double ff_num(DMatrix& x, Workspace* workspace);
 
 void gg_num( DMatrix& x, DMatrix* g, Workspace* workspace );
 
+int gg_ad_nodes( adouble* xad, adouble* xun, adouble* gad, adouble* derivs_traj, int i, int kfirst, int klast,
+                 int phase_offset, EvalScratch* scratch, Workspace* workspace );
+
+void gg_ad_events( adouble* xad, adouble* xun, adouble* gad, int i, int phase_offset, Workspace* workspace );
+
+void gg_ad_linkages( adouble* xad, adouble* gad, int phase_offset, Workspace* workspace );
+
+bool use_threaded_evaluation(Alg& algorithm);
+
+void gg_num_threaded( DMatrix& x, DMatrix* g, Workspace* workspace );
+
+double ff_num_threaded(DMatrix& x, Workspace* workspace);
+
+adouble ff_ad_phase(adouble* xad, adouble* xun, int i, Workspace* workspace);
+
+void gg_ad_phase( adouble* xad, adouble* xun, adouble* gad, int i, int phase_offset, Workspace* workspace );
+
+void scale_constraints_ad( adouble* gad, int first, int last, Workspace* workspace );
+
+adouble ff_ad_integrand(adouble* xad, adouble* xun, int i, int kfirst, int klast, adouble* states_bar, Workspace* workspace);
+
+int get_evaluation_blocks(Prob& problem, int* nitems, int nthreads, int align, int* block_phase, int* block_first, int* block_last);
+
+void allocate_eval_scratch(EvalScratch* scratch, Prob& problem, Alg& algorithm);
+
+void free_eval_scratch(EvalScratch* scratch);
+
 void fg_ad( adouble* x, adouble* fg, Workspace* workspace);
 
 void compute_derivatives_trajectory( DMatrix& Xdot, Prob& problem, Sol& solution,  int i, Workspace* workspace );
@@ -1009,6 +1296,22 @@ double nint(double x);
 
 int get_iphase_offset(Prob& problem, int iphase,Workspace* workspace);
 
+bool use_node_major_ordering(Alg& algorithm);
+
+int get_control_offset(Prob& problem, int i, int k, Workspace* workspace);
+
+int get_state_offset(Prob& problem, int i, int k, Workspace* workspace);
+
+int get_state_stride(Prob& problem, int i, Workspace* workspace);
+
+int get_defect_offset(Prob& problem, int i, int k, Workspace* workspace);
+
+int get_path_offset(Prob& problem, int i, int k, Workspace* workspace);
+
+int get_event_offset(Prob& problem, int i, Workspace* workspace);
+
+void mtrx_mul_trans_strided(adouble* a, int lda, double* b, adouble* ab, int na, int ma, int nb, int mb);
+
 adouble ff_ad(adouble* xad, Workspace* workspace);
 
 
@@ -1039,6 +1342,39 @@ void rkf_propagate( void (*dae)(adouble* derivatives, adouble* path, adouble* st
         DMatrix& new_time_vector,
 	DMatrix& new_control_trajectory, Workspace* workspace);
 
+void dopri_propagate( void (*dae)(adouble* derivatives, adouble* path, adouble* states,
+         adouble* controls, adouble* parameters, adouble& time,
+        adouble* xad, int iphase, Workspace* workspace),
+        DMatrix& control_trajectory,
+        DMatrix& time_vector,
+        DMatrix& initial_state,
+	DMatrix& parameters,
+        double tolerance,
+        double hmin,
+	double hmax,
+        Prob & problem,
+        int iphase,
+        DMatrix& output_times,
+        DMatrix& state_trajectory,
+	DMatrix& output_controls, Workspace* workspace);
+
+void rosenbrock_propagate( void (*dae)(adouble* derivatives, adouble* path, adouble* states,
+         adouble* controls, adouble* parameters, adouble& time,
+        adouble* xad, int iphase, Workspace* workspace),
+        DMatrix& control_trajectory,
+        DMatrix& time_vector,
+        DMatrix& initial_state,
+	DMatrix& parameters,
+        double tolerance,
+        double hmin,
+	double hmax,
+        Prob & problem,
+        int iphase,
+        DMatrix& output_times,
+        DMatrix& state_trajectory,
+	DMatrix& output_controls,
+	const string& jacobian_method, Workspace* workspace);
+
 
 void auto_split_observations(Prob& problem, DMatrix& observation_nodes, DMatrix& observations);
 
@@ -170,6 +170,70 @@ void determine_scaling_factors_for_variables(Sol& solution, Prob& problem, Alg&
 
 }
 
+void define_inverse_variable_scaling(Prob& problem, Workspace* workspace)
+{
+     // Builds a vector with the reciprocals of the scaling factors of all NLP variables,
+     // following the same layout as the decision vector, so that the unscaled variables
+     // can be recovered with a single product per variable in each evaluation.
+
+     int i, k;
+
+     int x_phase_offset = 0;
+
+     DMatrix& inv_scaling = *workspace->inv_variable_scaling;
+
+     inv_scaling = ones(workspace->nvars,1);
+
+     for(i=0; i<problem.nphases; i++)
+     {
+	int norder    = problem.phase[i].current_number_of_intervals;
+	int ncontrols = problem.phase[i].ncontrols;
+	int nstates   = problem.phase[i].nstates;
+        int nparam    = problem.phase[i].nparameters;
+        int offset2   = (ncontrols+nstates)*(norder+1);
+
+	DMatrix& control_scaling = problem.phase[i].scale.controls;
+	DMatrix& state_scaling   = problem.phase[i].scale.states;
+        DMatrix& param_scaling   = problem.phase[i].scale.parameters;
+        double   time_scaling    = problem.phase[i].scale.time;
+
+	int nvars_phase_i = get_nvars_phase_i(problem,i, workspace);
+
+	int j;
+
+	for (k=1; k<=norder+1; k++) {
+	    int uk = x_phase_offset+get_control_offset(problem,i,k,workspace);
+	    int xk = x_phase_offset+get_state_offset(problem,i,k,workspace);
+	    for (j=1; j<=ncontrols; j++) {
+		inv_scaling(uk+j) = 1.0/control_scaling(j);
+	    }
+	    for (j=1; j<=nstates; j++) {
+		inv_scaling(xk+j) = 1.0/state_scaling(j);
+	    }
+	}
+
+	for (j=1; j<=nparam; j++) {
+	    inv_scaling(x_phase_offset+offset2+j) = 1.0/param_scaling(j);
+	}
+
+        if ( need_midpoint_controls(*workspace->algorithm, workspace) ) {
+	   for (k=1; k<=norder; k++) {
+	      for (j=1; j<=ncontrols; j++) {
+		  inv_scaling(x_phase_offset+offset2+nparam+(k-1)*ncontrols+j) = 1.0/control_scaling(j);
+	      }
+	   }
+        }
+
+	inv_scaling(x_phase_offset+nvars_phase_i-1) = 1.0/time_scaling;
+	inv_scaling(x_phase_offset+nvars_phase_i)   = 1.0/time_scaling;
+
+        x_phase_offset += nvars_phase_i;
+
+     }
+
+}
+
+
 void determine_objective_scaling(DMatrix& X,Sol& solution, Prob& problem, Alg& algorithm, Workspace* workspace )
 {
 
@@ -387,7 +451,7 @@ void determine_constraint_scaling_factors(DMatrix & X, Sol& solution, Prob& prob
 
   		for( j=1;j<=nstates;j++) {
 
-                	l = offset + (k-1)*nstates+j;
+                	l = offset + get_defect_offset(problem,i,k,workspace)+j;
 
         		(*workspace->constraint_scaling)(l) = state_scaling(j);
 
@@ -132,21 +132,30 @@ void psopt_level2_setup(Prob& problem, Alg& algorithm)
   algorithm.hessian                     = "limited-memory";
   algorithm.collocation_method          = "Legendre";
   algorithm.diff_matrix                 = "standard";
+  algorithm.nlp_variable_ordering       = "standard";
   algorithm.print_level                 = 1;
   algorithm.save_sparsity_pattern       = 0;
   algorithm.nsteps_error_integration    = 10;
+  algorithm.error_integration           = "simpson";
   algorithm.ode_tolerance                = 1.e-3;
   algorithm.mr_max_increment_factor     = 0.4;
   algorithm.mr_max_iterations		= 7;
   algorithm.mr_min_extrapolation_points = 2;
   algorithm.mr_initial_increment        = 5;
   algorithm.mr_kappa                    = 0.1;
+  algorithm.mr_coarsening_factor        = 0.0;
   algorithm.mr_M1                       = 5;
   algorithm.mesh_refinement 		= "manual";
   algorithm.switch_order                = 2;
   algorithm.parameter_statistics        = "yes";
   algorithm.parameter_estimation_norm   = 2;
+  algorithm.nlp_threads                 = 1;
+  algorithm.hp_segment_degree           = 4;
+  algorithm.hp_max_degree               = 10;
   algorithm.ipopt_max_cpu_time          = 3600.0;
+  algorithm.nlp_tolerance_schedule      = "fixed";
+  algorithm.mr_nlp_tolerance_factor     = 1.e-2;
+  algorithm.mr_nlp_iter_max             = 500;
 
 
   problem.multi_segment_flag = false;
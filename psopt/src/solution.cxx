@@ -141,6 +141,7 @@ void initialize_solution(Sol& solution, Prob& problem, Alg& algorithm, Workspace
       solution.mesh_stats[i].n_con_evals = 0;
       solution.mesh_stats[i].n_obj_evals = 0;
       solution.mesh_stats[i].n_ode_rhs_evals = 0;
+      solution.mesh_stats[i].n_error_rhs_evals = 0;
       solution.mesh_stats[i].n_jacobian_evals = 0;
       solution.mesh_stats[i].n_hessian_evals = 0;
    }
@@ -175,3 +176,164 @@ void resize_solution(Sol& solution, Prob& problem, Alg& algorithm)
 }
 
 
+
+static void build_phase_interpolant_from_solution(PhaseInterpolant& pint, int iphase, Sol& solution, Alg& algorithm)
+{
+// Builds the interpolant of a phase from the node values stored in solution. The rows of pint.X
+// hold the states followed by the costates, so that both are interpolated with the same rule as
+// the states in build_phase_interpolant().
+
+     int i         = iphase-1;
+     Prob* problem = solution.problem;
+     int nnodes    = length(solution.nodes[i]);
+     int nstates   = problem->phase[i].nstates;
+     int ncontrols = problem->phase[i].ncontrols;
+     int nparam    = problem->phase[i].nparameters;
+     DMatrix& costates = solution.dual.costates[i];
+     DMatrix Yj(1,nnodes);
+     DMatrix d2Yj(1,nnodes);
+     int j, k;
+
+     pint.iphase      = iphase;
+     pint.nnodes      = nnodes;
+     pint.nstates     = 2*nstates;
+     pint.ncontrols   = ncontrols;
+     pint.nparameters = nparam;
+     pint.lagrange    = use_global_collocation(algorithm) && !use_hp_collocation(algorithm) && nnodes<=100;
+
+     pint.time = solution.nodes[i];
+     pint.time.Resize(1,nnodes);
+
+     pint.X.Resize(2*nstates,nnodes);
+     for (k=1; k<=nnodes; k++) {
+	  for (j=1; j<=nstates; j++) {
+	       pint.X(j,k)         = (solution.states[i])(j,k);
+	       pint.X(nstates+j,k) = ( costates.GetNoRows()==nstates && costates.GetNoCols()==nnodes ) ? costates(j,k) : 0.0;
+	  }
+     }
+
+     pint.U.Resize(MAX(ncontrols,1),nnodes);
+     for (k=1; k<=nnodes; k++) {
+	  for (j=1; j<=ncontrols; j++) pint.U(j,k) = (solution.controls[i])(j,k);
+     }
+
+     pint.p.Resize(MAX(nparam,1),1);
+     for (j=1; j<=nparam; j++) pint.p(j) = (solution.parameters[i])(j);
+
+     if (pint.lagrange) {
+	  barycentric_weights(pint.w, pint.time);
+     }
+     else {
+	  pint.d2X.Resize(2*nstates,nnodes);
+	  for (j=1; j<=2*nstates; j++) {
+	       Yj = pint.X(j,colon());
+	       spline_second_derivative(pint.time, Yj, nnodes, d2Yj);
+	       pint.d2X(j,colon()) = d2Yj;
+	  }
+     }
+
+     pint.d2U.Resize(MAX(ncontrols,1),nnodes);
+     for (j=1; j<=ncontrols; j++) {
+	  Yj = pint.U(j,colon());
+	  spline_second_derivative(pint.time, Yj, nnodes, d2Yj);
+	  pint.d2U(j,colon()) = d2Yj;
+     }
+}
+
+void build_solution_interpolant(SolutionInterpolant& sint, Sol& solution, Alg& algorithm)
+{
+// Builds a continuous time representation of the solution returned by psopt(), so that
+// the states, controls, state derivatives and costates can be evaluated at arbitrary times
+// by evaluate_solution_interpolant(). With global collocation the states and costates are
+// represented by the barycentric Lagrange polynomials through the nodes of each phase,
+// otherwise by natural cubic splines. The controls are always represented by natural cubic
+// splines. The interpolant must be released with free_solution_interpolant().
+
+     int nphases = solution.problem->nphases;
+     int i;
+
+     sint.nphases      = nphases;
+     sint.max_states   = 0;
+     sint.max_controls = 0;
+     sint.max_nodes    = 0;
+     sint.phase        = new PhaseInterpolant[nphases];
+
+     for (i=0; i<nphases; i++) {
+	  if ( length(solution.nodes[i]) < 2 ) {
+	       error_message("The solution has no nodes in call to build_solution_interpolant()");
+	  }
+	  build_phase_interpolant_from_solution(sint.phase[i], i+1, solution, algorithm);
+	  sint.max_states   = MAX(sint.max_states,   sint.phase[i].nstates/2);
+	  sint.max_controls = MAX(sint.max_controls, sint.phase[i].ncontrols);
+	  sint.max_nodes    = MAX(sint.max_nodes,    sint.phase[i].nnodes);
+     }
+}
+
+void free_solution_interpolant(SolutionInterpolant& sint)
+{
+     delete[] sint.phase;
+     sint.phase   = NULL;
+     sint.nphases = 0;
+}
+
+int get_phase_at_time(SolutionInterpolant& sint, double time)
+{
+// Returns the index of the first phase whose final time is not less than time, or the last phase.
+// Times before the initial time of that phase (before the first phase, or within a gap between
+// phases) are therefore assigned to the phase that follows them.
+
+     int i;
+
+     for (i=0; i<sint.nphases-1; i++) {
+	  if ( time <= (sint.phase[i].time)("end") ) break;
+     }
+
+     return i+1;
+}
+
+void evaluate_solution_interpolant(SolutionInterpolant& sint, DMatrix& time, DMatrix* states, DMatrix* controls, DMatrix* derivatives, DMatrix* costates)
+{
+// Evaluates the states, controls, state derivatives and costates at the values in the vector time,
+// which may span several phases. Each output is resized to (maximum number of states or controls over
+// all phases) x length(time), and rows that do not exist in the phase of a time point are set to zero.
+// Any of the outputs may be NULL if it is not needed. Times outside a phase are clamped to its limits.
+
+     int M  = length(time);
+     int nx = sint.max_states;
+     int nu = sint.max_controls;
+     int k, j, iphase;
+
+     DMatrix C(1,sint.max_nodes);
+     DMatrix XL(1,2*nx+1), XLdot(1,2*nx+1), U(1,nu+1);
+
+     double* c    = C.GetPr();
+     double* xl   = XL.GetPr();
+     double* xldot= XLdot.GetPr();
+     double* u    = U.GetPr();
+
+     if (states)      { states->Resize(MAX(nx,1),M);      states->FillWithZeros(); }
+     if (controls)    { controls->Resize(MAX(nu,1),M);    controls->FillWithZeros(); }
+     if (derivatives) { derivatives->Resize(MAX(nx,1),M); derivatives->FillWithZeros(); }
+     if (costates)    { costates->Resize(MAX(nx,1),M);    costates->FillWithZeros(); }
+
+     for (k=1; k<=M; k++) {
+	  iphase = get_phase_at_time(sint, time(k));
+	  PhaseInterpolant& pint = sint.phase[iphase-1];
+	  int ns = pint.nstates/2;
+	  double t = time(k);
+	  double* tn = pint.time.GetPr();
+	  if (t < tn[0])              t = tn[0];
+	  if (t > tn[pint.nnodes-1])  t = tn[pint.nnodes-1];
+
+	  evaluate_phase_interpolant(pint, t, xl, xldot, u, c);
+
+	  for (j=1; j<=ns; j++) {
+	       if (states)      (*states)(j,k)      = xl[j-1];
+	       if (derivatives) (*derivatives)(j,k) = xldot[j-1];
+	       if (costates)    (*costates)(j,k)    = xl[ns+j-1];
+	  }
+	  if (controls) {
+	       for (j=1; j<=pint.ncontrols; j++) (*controls)(j,k) = u[j-1];
+	  }
+     }
+}
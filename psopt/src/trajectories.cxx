@@ -38,13 +38,12 @@ void get_individual_control_trajectory(adouble *control_traj, int control_index,
     int k;
     int i = iphase-1;
     Prob& problem = *workspace->problem;
-    int ncontrols = problem.phase[i].ncontrols;
     int norder    = problem.phase[i].current_number_of_intervals;
     int iphase_offset = get_iphase_offset(problem,iphase, workspace);
     DMatrix& control_scaling = problem.phase[i].scale.controls;
 
     for(k=1;k<=norder+1;k++) {
-	  control_traj[k-1] = xad[iphase_offset+(k-1)*ncontrols+control_index-1]/control_scaling(control_index);
+	  control_traj[k-1] = xad[iphase_offset+get_control_offset(problem,i,k,workspace)+control_index-1]/control_scaling(control_index);
     }
 
 }
@@ -54,15 +53,12 @@ void get_individual_state_trajectory(adouble *state_traj, int state_index, int i
     int k;
     int i = iphase-1;
     Prob& problem = *workspace->problem;
-    int ncontrols = problem.phase[i].ncontrols;
-    int nstates   = problem.phase[i].nstates;
     int norder    = problem.phase[i].current_number_of_intervals;
     int iphase_offset = get_iphase_offset(problem,iphase, workspace);
-    int offset1   = ncontrols*(norder+1);
     DMatrix& state_scaling = problem.phase[i].scale.states;
 
     for(k=1;k<=norder+1;k++) {
-	  state_traj[k-1] = xad[iphase_offset+offset1+(k-1)*nstates+state_index-1]/state_scaling(state_index);
+	  state_traj[k-1] = xad[iphase_offset+get_state_offset(problem,i,k,workspace)+state_index-1]/state_scaling(state_index);
     }
 
 }
@@ -91,6 +87,8 @@ void compute_derivatives_trajectory( DMatrix& Xdot, Prob& problem, Sol& solution
 	  iph = iphase;
 	}
 
+	invalidate_spline_cache(workspace);
+
 	states        = workspace->states[i];
 	derivatives   = workspace->derivatives[i];
         controls      = workspace->controls[i];
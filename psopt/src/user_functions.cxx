@@ -32,61 +32,155 @@ Author:    Professor Victor M. Becerra
 #include "psopt.h"
 
 
+// The node times and the trajectories of the states and controls, and their spline second
+// derivatives, are memoised per phase for the decision vector being evaluated, so that repeated
+// queries at different times (as made by time delay models, once per node) only cost an interval
+// search and a cubic. The cache is not used from within parallel regions, as it is shared.
+
+
+void invalidate_spline_cache(Workspace* workspace)
+{
+// Discards the memoised interpolation data. To be called when the values held by the decision
+// vector change, or when its adoubles are re-initialised for a new tape.
+
+     workspace->spline_cache_stamp++;
+}
+
+
+static SplineCache* get_spline_cache(int iphase, adouble* xad, Workspace* workspace)
+{
+     int i = iphase-1;
+     Prob& problem = *workspace->problem;
+     int norder = problem.phase[i].current_number_of_intervals;
+     int ntraj  = problem.phase[i].nstates + problem.phase[i].ncontrols;
+     SplineCache* cache = &workspace->spline_cache[i];
+     adouble t0, tf;
+     int k;
+
+#ifdef USE_OPENMP
+     if (omp_in_parallel()) return NULL;
+#endif
+
+     if ( cache->stamp != workspace->spline_cache_stamp || cache->xad != xad ) {
+	  cache->stamp      = workspace->spline_cache_stamp;
+	  cache->xad        = xad;
+	  cache->time_valid = false;
+	  for (k=0; k<ntraj; k++) {
+	       cache->valid[k]     = false;
+	       cache->d2y_valid[k] = false;
+	  }
+     }
+
+     if ( !cache->time_valid ) {
+	  get_times( &t0, &tf, xad, iphase, workspace);
+	  for (k=1; k<=norder+1; k++) {
+	       cache->time[k-1] = convert_to_original_time_ad( (workspace->snodes[i])(k), t0, tf );
+	  }
+	  cache->time_valid = true;
+     }
+
+     return cache;
+}
+
+
+static void get_trajectory_data(adouble** time_array, adouble** traj, adouble** d2y, bool control, int index, int iphase, adouble* xad, Workspace* workspace)
+{
+// Returns pointers to the node times and to the node values of a state (control=false) or a control
+// trajectory, and, if d2y is not NULL, to its spline second derivatives. Outside the cache, the data
+// are computed into the workspace temporary arrays.
+
+     int k;
+     int i = iphase-1;
+     Prob& problem = *workspace->problem;
+     int norder = problem.phase[i].current_number_of_intervals;
+     int nstates = problem.phase[i].nstates;
+     int itraj  = control? nstates+index-1 : index-1;
+     adouble t0, tf;
+
+     SplineCache* cache = get_spline_cache(iphase, xad, workspace);
+
+     if (cache == NULL) {
+	  *time_array = workspace->time_array_tmp;
+	  *traj       = workspace->single_trajectory_tmp;
+	  if (control)
+	       get_individual_control_trajectory(*traj, index, iphase, xad, workspace);
+	  else
+	       get_individual_state_trajectory(*traj, index, iphase, xad, workspace);
+	  get_times( &t0, &tf, xad, iphase, workspace);
+	  for (k=1; k<=norder+1; k++) {
+	       (*time_array)[k-1] = convert_to_original_time_ad( (workspace->snodes[i])(k), t0, tf );
+	  }
+	  if (d2y) {
+	       *d2y = workspace->y2a_spline;
+	       spline_second_derivative(*time_array, *traj, norder+1, *d2y, workspace );
+	  }
+	  return;
+     }
+
+     if ( !cache->valid[itraj] ) {
+	  if (control)
+	       get_individual_control_trajectory(cache->y[itraj], index, iphase, xad, workspace);
+	  else
+	       get_individual_state_trajectory(cache->y[itraj], index, iphase, xad, workspace);
+	  cache->valid[itraj] = true;
+     }
+
+     if ( d2y && !cache->d2y_valid[itraj] ) {
+	  spline_second_derivative(cache->time, cache->y[itraj], norder+1, cache->d2y[itraj], workspace );
+	  cache->d2y_valid[itraj] = true;
+     }
+
+     *time_array = cache->time;
+     *traj       = cache->y[itraj];
+     if (d2y) *d2y = cache->d2y[itraj];
+}
+
 
 void get_delayed_control(adouble* delayed_control, int control_index, int iphase, adouble& time, double delay, adouble* xad, Workspace* workspace)
 {
 
- int k;
  int i = iphase-1;
  Prob& problem = *workspace->problem;
  int norder = problem.phase[i].current_number_of_intervals;
- adouble t0, tf;
  adouble delayed_time;
- adouble* time_array = workspace->time_array_tmp;;
- adouble* single_control_traj = workspace->single_trajectory_tmp;
- get_individual_control_trajectory(single_control_traj, control_index, iphase, xad, workspace);
- get_times( &t0, &tf, xad, iphase, workspace);
- for (k=1; k<=norder+1; k++) {
-	time_array[k-1]  =  convert_to_original_time_ad( (workspace->snodes[i])(k), t0, tf );
- }
+ adouble* time_array;
+ adouble* single_control_traj;
+ adouble* d2y;
+ get_trajectory_data(&time_array, &single_control_traj, &d2y, true, control_index, iphase, xad, workspace);
+ adouble& t0 = time_array[0];
  if ( time-delay>t0 ) // Careful because this if-then statement may not be differentiable
         delayed_time= time-delay;
  else
           delayed_time=t0; // what is best to do here?
 
- spline_interpolation( delayed_control, delayed_time, time_array, single_control_traj, norder+1, workspace);
+ spline_interpolation_with_second_derivative( delayed_control, delayed_time, time_array, single_control_traj, d2y, norder+1);
 
 }
 
 void get_delayed_state(adouble* delayed_state, int state_index, int iphase, adouble& time, double delay, adouble* xad, Workspace* workspace)
 {
 
- int k;
  int i= iphase-1;
  Prob& problem = *workspace->problem;
  Alg&  algorithm=*workspace->algorithm;
  int norder = problem.phase[i].current_number_of_intervals;
- adouble t0, tf;
- double ts;
  adouble delayed_time;
- adouble* time_array = workspace->time_array_tmp;
- adouble* single_state_traj =  workspace->single_trajectory_tmp;
- get_individual_state_trajectory(single_state_traj, state_index, iphase, xad, workspace);
- get_times( &t0, &tf, xad, iphase, workspace);
- for (k=1; k<=norder+1; k++) {
-        ts = (workspace->snodes[i])(k);
-	time_array[k-1]  =  convert_to_original_time_ad( ts, t0, tf );
- }
+ adouble* time_array;
+ adouble* single_state_traj;
+ adouble* d2y;
+ bool lagrange = use_global_collocation(algorithm) && !use_hp_collocation(algorithm) &&  norder<100;
+ get_trajectory_data(&time_array, &single_state_traj, lagrange? NULL : &d2y, false, state_index, iphase, xad, workspace);
+ adouble& t0 = time_array[0];
  if ( time-delay>t0 )
         delayed_time= time-delay;
  else
           delayed_time=t0; // nothing best to do here...
 
- if ( use_global_collocation(algorithm) &&  norder<100  ) {
- 	lagrange_interpolation_ad( delayed_state, delayed_time, time_array, single_state_traj, norder+1, workspace);
+ if ( lagrange ) {
+	barycentric_interpolation_ad( delayed_state, delayed_time, time_array, single_state_traj, workspace->bary_weights[i].GetPr(), norder+1);
  }
- else if ( workspace->differential_defects == "Hermite-Simpson" || workspace->differential_defects == "trapezoidal" ) {
-	spline_interpolation( delayed_state, delayed_time, time_array, single_state_traj, norder+1, workspace);
+ else if ( workspace->differential_defects == "Hermite-Simpson" || workspace->differential_defects == "trapezoidal" || workspace->differential_defects == "Lobatto-IIIA" || use_hp_collocation(algorithm) ) {
+	spline_interpolation_with_second_derivative( delayed_state, delayed_time, time_array, single_state_traj, d2y, norder+1);
  }
 
 }
@@ -94,28 +188,22 @@ void get_delayed_state(adouble* delayed_state, int state_index, int iphase, adou
 void get_interpolated_state(adouble* interp_state, int state_index, int iphase, adouble& time, adouble* xad, Workspace* workspace)
 {
 
- int k;
  int i = iphase-1;
  Prob& problem = *workspace->problem;
  Alg&  algorithm=*workspace->algorithm;
  int norder = problem.phase[i].current_number_of_intervals;
- adouble t0, tf;
- double ts;
-
- adouble* time_array = workspace->time_array_tmp;
- adouble* single_state_traj =  workspace->single_trajectory_tmp;
- get_individual_state_trajectory(single_state_traj, state_index, iphase, xad, workspace);
- get_times( &t0, &tf, xad, iphase, workspace);
- for (k=1; k<=norder+1; k++) {
-        ts = (workspace->snodes[i])(k);
-	time_array[k-1]  =  convert_to_original_time_ad( ts, t0, tf );
- }
+ adouble* time_array;
+ adouble* single_state_traj;
+ adouble* d2y;
+ bool lagrange = use_global_collocation(algorithm) && !use_hp_collocation(algorithm) && norder<100;
+
+ get_trajectory_data(&time_array, &single_state_traj, lagrange? NULL : &d2y, false, state_index, iphase, xad, workspace);
 
- if (  use_global_collocation(algorithm) && norder<100 ) {
- 	lagrange_interpolation_ad( interp_state, time, time_array, single_state_traj, norder+1, workspace);
+ if ( lagrange ) {
+	barycentric_interpolation_ad( interp_state, time, time_array, single_state_traj, workspace->bary_weights[i].GetPr(), norder+1);
  }
  else  {
-	spline_interpolation( interp_state, time, time_array, single_state_traj, norder+1, workspace);
+	spline_interpolation_with_second_derivative( interp_state, time, time_array, single_state_traj, d2y, norder+1);
  }
 
 }
@@ -124,23 +212,16 @@ void get_interpolated_state(adouble* interp_state, int state_index, int iphase,
 void get_interpolated_control(adouble* interp_control, int control_index, int iphase, adouble& time, adouble* xad, Workspace* workspace)
 {
 
- int k;
  int i = iphase-1;
  Prob& problem = *workspace->problem;
  int norder = problem.phase[i].current_number_of_intervals;
- adouble t0, tf;
- double ts;
-
- adouble* time_array = workspace->time_array_tmp;
- adouble* single_control_traj =  workspace->single_trajectory_tmp;
- get_individual_control_trajectory(single_control_traj, control_index, iphase, xad, workspace);
- get_times( &t0, &tf, xad, iphase, workspace);
- for (k=1; k<=norder+1; k++) {
-        ts = (workspace->snodes[i])(k);
-	time_array[k-1]  =  convert_to_original_time_ad( ts, t0, tf );
- }
+ adouble* time_array;
+ adouble* single_control_traj;
+ adouble* d2y;
+
+ get_trajectory_data(&time_array, &single_control_traj, &d2y, true, control_index, iphase, xad, workspace);
 
- spline_interpolation( interp_control, time, time_array, single_control_traj, norder+1, workspace);
+ spline_interpolation_with_second_derivative( interp_control, time, time_array, single_control_traj, d2y, norder+1);
 
 }
 
@@ -783,7 +783,7 @@ adouble convert_to_original_time_ad(double tbar,adouble& t0,adouble& tf)
 bool use_local_collocation(Alg & algorithm)
 {
 
-     if (algorithm.collocation_method == "trapezoidal" || algorithm.collocation_method=="Hermite-Simpson")
+     if (algorithm.collocation_method == "trapezoidal" || algorithm.collocation_method=="Hermite-Simpson" || algorithm.collocation_method=="Lobatto-IIIA")
          return true;
      else return false;
 
@@ -798,6 +798,27 @@ bool use_global_collocation(Alg & algorithm)
 }
 
 
+bool use_lobatto_collocation(Alg & algorithm)
+{
+     // Four stage Lobatto IIIA local collocation over groups of three intervals
+     return (algorithm.collocation_method == "Lobatto-IIIA");
+}
+
+
+bool use_hp_collocation(Alg & algorithm)
+{
+     // Multi-interval Legendre collocation: a global method on a block-sparse differentiation matrix
+     return (algorithm.collocation_method == "Legendre-hp");
+}
+
+
+bool use_dct_differentiation(Alg & algorithm)
+{
+     // Chebyshev collocation with the state derivatives computed by the discrete cosine transform
+     return (algorithm.collocation_method == "Chebyshev" && algorithm.diff_matrix == "dct");
+}
+
+
 
 
 bool need_midpoint_controls(Alg& algorithm, Workspace* workspace)
@@ -842,6 +863,44 @@ void mtrx_mul_trans(adouble* a,double* b,adouble* ab,int na,int ma,int nb,int mb
 }
 
 
+void mtrx_mul_trans_strided(adouble* a, int lda, double* b, adouble* ab, int na, int ma, int nb, int mb)
+{
+  int i,j,k;
+  adouble sum;
+
+  /* as mtrx_mul_trans(), but the columns of matrix a[na,ma] are lda elements apart,
+     so that a may be read in place from a larger array */
+  if (ma!=mb) {error_message("matrix dimension error in mtrx_mul_trans_strided()"); return;}
+  for (i=0; i<na; i++)
+  {
+    for (j=0; j<mb; j++)
+    {
+      sum=0.0;
+      for (k=0; k<nb; k++)
+      {
+        if (MTR(b,j,k,nb)!=0)
+	sum=sum+MTR(a,i,k,lda)*MTR(b,j,k,nb);
+      }
+      MTR(ab,i,j,na)=sum;
+    }
+  }
+
+}
+
+
+#ifdef USE_OPENMP
+bool use_threaded_evaluation(Alg& algorithm)
+{
+   return ( algorithm.nlp_threads > 1 );
+}
+#else
+bool use_threaded_evaluation(Alg& /* algorithm */)
+{
+   return false;
+}
+#endif
+
+
 bool useAutomaticDifferentiation(Alg& algorithm)
 {
    if ( algorithm.derivatives=="automatic" )
@@ -886,7 +945,6 @@ void copy_decision_variables(Sol& solution, DMatrix& x, Prob& problem, Alg& algo
 	int ncontrols = problem.phase[i].ncontrols;
 	int nstates   = problem.phase[i].nstates;
         int nparam    = problem.phase[i].nparameters;
-	int offset1   = ncontrols*(norder+1);
         int offset2   = (ncontrols+nstates)*(norder+1);
 
 	int nvars_phase_i = get_nvars_phase_i(problem,i,workspace);
@@ -895,10 +953,12 @@ void copy_decision_variables(Sol& solution, DMatrix& x, Prob& problem, Alg& algo
 	double    tf  = x(iphase_offset + nvars_phase_i)/time_scaling;
 
 	for (k=1; k<=norder+1; k++) {
+                int uk = iphase_offset+get_control_offset(problem,i,k,workspace);
+                int xk = iphase_offset+get_state_offset(problem,i,k,workspace);
                 if (ncontrols>0) {
-		    (solution.controls[i])(colon(),k) = elemDivision(x(colon(iphase_offset+(k-1)*ncontrols+1,iphase_offset+k*ncontrols) ) , control_scaling);
+		    (solution.controls[i])(colon(),k) = elemDivision(x(colon(uk+1,uk+ncontrols) ) , control_scaling);
                 }
-		(solution.states[i])(colon(),k)   = elemDivision(x(colon(iphase_offset+(k-1)*nstates+1+offset1, iphase_offset + k*nstates+offset1)), state_scaling);
+		(solution.states[i])(colon(),k)   = elemDivision(x(colon(xk+1, xk+nstates)), state_scaling);
 		(solution.nodes[i])(1,k)          =  convert_to_original_time( (workspace->snodes[i])(k), t0, tf );
 	}
 
@@ -39,35 +39,56 @@ void validate_user_input(Prob& problem, Alg& algorithm, Workspace* workspace)
 
     if (algorithm.nlp_method != "IPOPT" && algorithm.nlp_method!="SNOPT")
        error_message("Incorrect NLP method specified. Valid options are \"IPOPT\" and \"SNOPT\" ");
-    if (algorithm.collocation_method != "Legendre" && algorithm.collocation_method!="Chebyshev" && algorithm.collocation_method!="trapezoidal" && algorithm.collocation_method!="Hermite-Simpson")
-       error_message("Incorrect pseudospectral method specified. Valid options are \"Legendre\" , \"Chebyshev\", \"trapezoidal\", and \"Hermite-Simpson\" ");
+    if (algorithm.collocation_method != "Legendre" && algorithm.collocation_method!="Chebyshev" && algorithm.collocation_method!="Legendre-hp" && algorithm.collocation_method!="trapezoidal" && algorithm.collocation_method!="Hermite-Simpson" && algorithm.collocation_method!="Lobatto-IIIA")
+       error_message("Incorrect pseudospectral method specified. Valid options are \"Legendre\" , \"Chebyshev\", \"Legendre-hp\", \"trapezoidal\", \"Hermite-Simpson\" and \"Lobatto-IIIA\" ");
     if (algorithm.scaling != "automatic" && algorithm.scaling!="user")
        error_message("Incorrect scaling option specified. Valid options are \"automatic\" and \"user\" ");
     if (algorithm.defect_scaling != "state-based" && algorithm.defect_scaling!="jacobian-based")
        error_message("Incorrect differential defect scaling option specified. Valid options are \"state-based\" and \"jacobian-based\" ");
     if (algorithm.derivatives != "automatic" && algorithm.derivatives!="numerical")
        error_message("Incorrect derivatives option specified. Valid options are \"automatic\" and \"numerical\" ");
-    if (algorithm.hessian != "exact" && algorithm.hessian!="limited-memory")
-       error_message("Incorrect algorithm.hessian option specified. Valid options are \"limited-memory\" and \"exact\" ");
-    if (algorithm.hessian == "exact" && algorithm.nlp_method !="IPOPT") {
-       sprintf(workspace->text,"\n*** Warning: the 'exact' algorithm.hessian option is only available with the IPOPT solver");
+    if (algorithm.hessian != "exact" && algorithm.hessian!="limited-memory" && algorithm.hessian!="adaptive")
+       error_message("Incorrect algorithm.hessian option specified. Valid options are \"limited-memory\", \"exact\" and \"adaptive\" ");
+    if (algorithm.hessian != "limited-memory" && algorithm.nlp_method !="IPOPT") {
+       sprintf(workspace->text,"\n*** Warning: the '%s' algorithm.hessian option is only available with the IPOPT solver", algorithm.hessian.c_str());
        psopt_print(workspace,workspace->text);
     }
-    if (algorithm.diff_matrix != "standard" && algorithm.diff_matrix!="diff_matrix" && algorithm.diff_matrix!="central-differences" &&  algorithm.diff_matrix!="reduced-roundoff" )
-       error_message("Incorrect algorithm.diff_matrix option specified. Valid options are \"standard\", \"reduced-roundoff\" , \"central-differences\" ");
+    if (algorithm.diff_matrix != "standard" && algorithm.diff_matrix!="diff_matrix" && algorithm.diff_matrix!="central-differences" &&  algorithm.diff_matrix!="reduced-roundoff" && algorithm.diff_matrix!="dct" )
+       error_message("Incorrect algorithm.diff_matrix option specified. Valid options are \"standard\", \"reduced-roundoff\" , \"central-differences\", \"dct\" ");
+    if (algorithm.diff_matrix == "dct" && algorithm.collocation_method != "Chebyshev")
+       error_message("The \"dct\" algorithm.diff_matrix option is only available with Chebyshev collocation");
+    if (algorithm.nlp_variable_ordering != "standard" && algorithm.nlp_variable_ordering != "node-major")
+       error_message("Incorrect algorithm.nlp_variable_ordering option specified. Valid options are \"standard\" and \"node-major\" ");
 
 
-    if (algorithm.hessian == "exact" && algorithm.derivatives !="automatic") {
-       sprintf(workspace->text,"\n*** Warning: the 'exact' algorithm.hessian option is only available with automatic derivatives");
+    if (algorithm.hessian != "limited-memory" && algorithm.derivatives !="automatic") {
+       sprintf(workspace->text,"\n*** Warning: the '%s' algorithm.hessian option is only available with automatic derivatives", algorithm.hessian.c_str());
        psopt_print(workspace,workspace->text);
     }
     if (algorithm.nlp_tolerance <= 0)
        error_message("algorithm.nlp_tolerance must be positive");
     if (algorithm.nlp_iter_max <= 0)
        error_message("algorithm.iter_max must be positive");
+    if (algorithm.nlp_tolerance_schedule != "fixed" && algorithm.nlp_tolerance_schedule != "adaptive")
+       error_message("Incorrect algorithm.nlp_tolerance_schedule option specified. Valid options are \"fixed\" and \"adaptive\" ");
+    if (algorithm.mr_nlp_tolerance_factor <= 0)
+       error_message("algorithm.mr_nlp_tolerance_factor must be positive");
+    if (algorithm.mr_nlp_iter_max <= 0)
+       error_message("algorithm.mr_nlp_iter_max must be positive");
 
     if (algorithm.nsteps_error_integration <= 0)
        error_message("algorithm.nsteps_error_integration must be positive");
+    if (algorithm.error_integration != "simpson" && algorithm.error_integration != "gauss-kronrod")
+       error_message("Incorrect algorithm.error_integration option specified. Valid options are \"simpson\" and \"gauss-kronrod\" ");
+
+    if (algorithm.nlp_threads <= 0)
+       error_message("algorithm.nlp_threads must be positive");
+
+    if (algorithm.hp_segment_degree <= 0)
+       error_message("algorithm.hp_segment_degree must be positive");
+
+    if (algorithm.hp_max_degree < algorithm.hp_segment_degree)
+       error_message("algorithm.hp_max_degree must not be smaller than algorithm.hp_segment_degree");
 
     if (algorithm.ode_tolerance <= 0)
        error_message("algorithm.ode_tolerance must be positive");
@@ -85,6 +106,9 @@ void validate_user_input(Prob& problem, Alg& algorithm, Workspace* workspace)
     if (algorithm.mr_kappa <= 0 || algorithm.mr_kappa>1.0 )
        error_message("algorithm.mr_kappa must be in the interval (0,1]");
 
+    if (algorithm.mr_coarsening_factor < 0 || algorithm.mr_coarsening_factor >= 1.0 )
+       error_message("algorithm.mr_coarsening_factor must be in the interval [0,1)");
+
     if (algorithm.mr_M1 <= 0  )
        error_message("algorithm.mr_M1 must be positive");
 
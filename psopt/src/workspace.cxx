@@ -47,6 +47,11 @@ void initialize_workspace_vars(Prob& problem, Alg& algorithm, Sol& solution, Wor
   workspace->sindex    = new DMatrix[nphases];
   workspace->w         = new DMatrix[nphases];
   workspace->D         = new DMatrix[nphases];
+  workspace->D_even    = new DMatrix[nphases];
+  workspace->D_odd     = new DMatrix[nphases];
+  workspace->bary_weights = new DMatrix[nphases];
+  workspace->spline_cache = new SplineCache[nphases];
+  workspace->spline_cache_stamp = 0;
   workspace->snodes    = new DMatrix[nphases];
   workspace->old_snodes= new DMatrix[nphases];
   workspace->xlb       = new DMatrix;
@@ -85,8 +90,11 @@ void initialize_workspace_vars(Prob& problem, Alg& algorithm, Sol& solution, Wor
   workspace->xp           = new DMatrix;
   workspace->emax_history = new DMatrix[nphases];
   workspace->order_reduction=new DMatrix[nphases];
+  workspace->hp_breaks    = new DMatrix[nphases];
+  workspace->hp_degrees   = new DMatrix[nphases];
   workspace->old_relative_errors = new DMatrix[nphases];
   workspace->error_scaling_weights = new DMatrix[nphases];
+  workspace->inv_variable_scaling  = new DMatrix;
 
 
   (*workspace->linkage).Resize(problem.nlinkages,1);
@@ -108,7 +116,7 @@ void initialize_workspace_vars(Prob& problem, Alg& algorithm, Sol& solution, Wor
 	workspace->jGcol     = new int[(int) (algorithm.jac_sparsity_ratio*max_nvars*max_ncons)];
 	workspace->jac_Aij   = new double[(int) (algorithm.jac_sparsity_ratio*max_nvars*max_ncons)];
 	workspace->jac_Gij   = new double[(int) (algorithm.jac_sparsity_ratio*max_nvars*max_ncons)];
-	if (algorithm.hessian == "exact" ) {
+	if (algorithm.hessian != "limited-memory" ) {
 		workspace->hess_ir   = new unsigned int[(int) (algorithm.hess_sparsity_ratio*max_nvars*max_nvars)];
 		workspace->hess_jc   = new unsigned int[(int) (algorithm.hess_sparsity_ratio*max_nvars*max_nvars)];
 		workspace->lambda_d  = new double [max_ncons];
@@ -125,6 +133,7 @@ void initialize_workspace_vars(Prob& problem, Alg& algorithm, Sol& solution, Wor
   }
   workspace->xad       = new adouble[max_nvars];
   workspace->gad       = new adouble[max_ncons];
+  workspace->xunscaled = new adouble[max_nvars];
   workspace->fgad      = new adouble[max_ncons+1];
   workspace->fg        = new double[max_ncons+1];
   workspace->nrm_row   = new double[max_ncons+1];
@@ -142,6 +151,8 @@ void initialize_workspace_vars(Prob& problem, Alg& algorithm, Sol& solution, Wor
   workspace->path            = new adouble*[nphases];
   workspace->states_traj     = new adouble*[nphases];
   workspace->derivs_traj     = new adouble*[nphases];
+  workspace->dct_xin         = new adouble*[nphases];
+  workspace->dct_yout        = new adouble*[nphases];
   workspace->linkages        = new adouble[problem.nlinkages];
   workspace->states_next     = new adouble*[nphases];
   workspace->controls_next   = new adouble*[nphases];
@@ -161,13 +172,22 @@ void initialize_workspace_vars(Prob& problem, Alg& algorithm, Sol& solution, Wor
 
   workspace->trace_f_done    = false;
 
+  workspace->nlp_tolerance   = algorithm.nlp_tolerance;
+  workspace->nlp_iter_max    = algorithm.nlp_iter_max;
+  workspace->polish_mesh     = false;
+  workspace->exact_hessian   = (algorithm.hessian == "exact");
+  workspace->hessian_switch_requested = false;
+
   workspace->time_array_tmp = new adouble[max_nodes +1];
   workspace->single_trajectory_tmp = new adouble[max_nodes +1];
-  workspace->L_ad_tmp = new adouble[max_nodes +1];
+  workspace->bary_weights_tmp = new double[2*(max_nodes +1)];
   workspace->u_spline   = new adouble[max_nodes +1];
   workspace->z_spline   = new adouble[max_nodes +1];
   workspace->y2a_spline = new adouble[max_nodes +1];
 
+  workspace->eval_scratch = new EvalScratch;
+  allocate_eval_scratch(workspace->eval_scratch, problem, algorithm);
+
 
  for(i=0; i< problem.nphases; i++)
   {
@@ -222,6 +242,30 @@ void initialize_workspace_vars(Prob& problem, Alg& algorithm, Sol& solution, Wor
         workspace->states_traj[i]= new adouble[problem.phase[i].nstates*(max_nodes +1)];
         workspace->derivs_traj[i]= new adouble[problem.phase[i].nstates*(max_nodes +1)];
 
+        if ( use_dct_differentiation(algorithm) ) {
+            allocate_dct_buffers(&workspace->dct_xin[i], &workspace->dct_yout[i], max_nodes);
+        }
+        else {
+            workspace->dct_xin[i]  = NULL;
+            workspace->dct_yout[i] = NULL;
+        }
+
+        SplineCache& cache = workspace->spline_cache[i];
+        cache.stamp      = -1;
+        cache.xad        = NULL;
+        cache.time_valid = false;
+        cache.time       = new adouble[max_nodes+1];
+        cache.valid      = new bool[nstates+ncontrols];
+        cache.d2y_valid  = new bool[nstates+ncontrols];
+        cache.y          = new adouble*[nstates+ncontrols];
+        cache.d2y        = new adouble*[nstates+ncontrols];
+        for (int j=0; j<nstates+ncontrols; j++) {
+             cache.valid[j]     = false;
+             cache.d2y_valid[j] = false;
+             cache.y[j]         = new adouble[max_nodes+1];
+             cache.d2y[j]       = new adouble[max_nodes+1];
+        }
+
 
   }
 
@@ -261,6 +305,29 @@ void initialize_workspace_vars(Prob& problem, Alg& algorithm, Sol& solution, Wor
   workspace->tag_fg 	     = 4;
   workspace->tag_gc       = 5;
 
+  workspace->ntapes          = nphases+1;
+  workspace->tag_ode         = 6 + 2*(nphases+1);
+  workspace->tag_g_tape      = new int[nphases+1];
+  workspace->tag_hess_tape   = new int[nphases+1];
+  workspace->jac_nnz_tape    = new int[nphases+1];
+  workspace->jac_rind_tape   = new unsigned int*[nphases+1];
+  workspace->jac_cind_tape   = new unsigned int*[nphases+1];
+  workspace->jac_values_tape = new double*[nphases+1];
+  workspace->hess_nnz_tape   = new int[nphases+1];
+  workspace->hess_start_tape = new int[nphases+1];
+  workspace->hess_map        = NULL;
+
+  for(i=0; i<=nphases; i++) {
+      workspace->tag_g_tape[i]      = 6 + 2*i;
+      workspace->tag_hess_tape[i]   = 7 + 2*i;
+      workspace->jac_nnz_tape[i]    = 0;
+      workspace->jac_rind_tape[i]   = NULL;
+      workspace->jac_cind_tape[i]   = NULL;
+      workspace->jac_values_tape[i] = NULL;
+      workspace->hess_nnz_tape[i]   = 0;
+      workspace->hess_start_tape[i] = 0;
+  }
+
   workspace->user_data = problem.user_data;
 
 }
@@ -333,3 +400,68 @@ void resize_workspace_vars(Prob& problem, Alg& algorithm, Sol& solution, Workspa
 
 }
 
+
+
+void allocate_eval_scratch(EvalScratch* scratch, Prob& problem, Alg& algorithm)
+{
+  // Sizes are the maximum over all phases, so the same scratch serves any phase.
+
+  int i;
+  int max_nstates = 1;
+  int max_npath   = 1;
+  int max_traj    = 1;
+  int max_ncontrols = 1;
+  int max_nparameters = 1;
+  int max_interp  = 1;
+  int max_points  = 1;
+
+  for(i=0; i< problem.nphases; i++)
+  {
+        int nstates   = problem.phase[i].nstates;
+        int max_nodes = get_max_nodes(problem,i+1, &algorithm);
+
+        max_nstates = MAX(max_nstates, nstates);
+        max_npath   = MAX(max_npath, problem.phase[i].npath);
+        max_traj    = MAX(max_traj, nstates*(max_nodes+1));
+        max_ncontrols   = MAX(max_ncontrols, problem.phase[i].ncontrols);
+        max_nparameters = MAX(max_nparameters, problem.phase[i].nparameters);
+        max_interp  = MAX(max_interp, 2*nstates + problem.phase[i].ncontrols + max_nodes+1);
+        max_points  = MAX(max_points, max_nodes+1);
+  }
+
+  scratch->resid            = new adouble[max_nstates];
+  scratch->derivatives      = new adouble[max_nstates];
+  scratch->path             = new adouble[max_npath];
+  scratch->derivatives_next = new adouble[max_nstates];
+  scratch->path_next        = new adouble[max_npath];
+  scratch->states_bar       = new adouble[max_nstates];
+  scratch->derivatives_bar  = new adouble[max_nstates];
+  scratch->path_bar         = new adouble[max_npath];
+  scratch->derivs_traj      = new adouble[max_traj];
+  scratch->states           = new adouble[max_nstates];
+  scratch->controls         = new adouble[max_ncontrols];
+  scratch->parameters       = new adouble[max_nparameters];
+  scratch->interp           = new double[max_interp];
+  scratch->u_nodes          = new double[max_points];
+  scratch->du_nodes         = new double[max_points];
+
+}
+
+void free_eval_scratch(EvalScratch* scratch)
+{
+  delete[] scratch->resid;
+  delete[] scratch->derivatives;
+  delete[] scratch->path;
+  delete[] scratch->derivatives_next;
+  delete[] scratch->path_next;
+  delete[] scratch->states_bar;
+  delete[] scratch->derivatives_bar;
+  delete[] scratch->path_bar;
+  delete[] scratch->derivs_traj;
+  delete[] scratch->states;
+  delete[] scratch->controls;
+  delete[] scratch->parameters;
+  delete[] scratch->interp;
+  delete[] scratch->u_nodes;
+  delete[] scratch->du_nodes;
+}